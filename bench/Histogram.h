@@ -0,0 +1,98 @@
+#ifndef BENCH_HISTOGRAM_H
+#define BENCH_HISTOGRAM_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//HdrHistogram-style log-linear latency histogram: 3 significant digits over the whole
+//range with fixed memory, so percentiles stay exact enough without storing samples.
+//values are nanoseconds
+class Histogram {
+private:
+    static const int SUB_BUCKET_HALF_MAGNITUDE = 10;
+    static const int64_t SUB_BUCKET_HALF_COUNT = 1 << SUB_BUCKET_HALF_MAGNITUDE;
+    static const int64_t SUB_BUCKET_MASK = (SUB_BUCKET_HALF_COUNT << 1) - 1;
+    static const int BUCKET_COUNT = 43;    //values below 2^53 ns (~100 days), plenty
+    static const int64_t HIGHEST_VALUE = (1LL << 53) - 1;
+
+    std::vector<int64_t> counts;
+    int64_t total;
+    int64_t min_value;
+    int64_t max_value;
+    double sum;
+
+    static int countsIndex(int64_t value) {
+        int pow2_ceiling = 64 - __builtin_clzll(value | SUB_BUCKET_MASK);
+        int bucket = pow2_ceiling - (SUB_BUCKET_HALF_MAGNITUDE + 1);
+        int64_t sub_bucket = value >> bucket;
+        return ((bucket + 1) << SUB_BUCKET_HALF_MAGNITUDE) + (sub_bucket - SUB_BUCKET_HALF_COUNT);
+    }
+
+    //highest value that lands in the same slot, so percentiles never under-report
+    static int64_t highestEquivalent(int index) {
+        int bucket = (index >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+        int64_t sub_bucket = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+        if (bucket < 0) {
+            sub_bucket -= SUB_BUCKET_HALF_COUNT;
+            bucket = 0;
+        }
+        return ((sub_bucket + 1) << bucket) - 1;
+    }
+
+public:
+    Histogram()
+        : counts((BUCKET_COUNT + 1) << SUB_BUCKET_HALF_MAGNITUDE, 0),
+          total(0), min_value(INT64_MAX), max_value(0), sum(0) {}
+
+    void record(int64_t value) {
+        if (value < 0) {
+            value = 0;
+        } else if (value > HIGHEST_VALUE) {
+            value = HIGHEST_VALUE;
+        }
+        counts[countsIndex(value)]++;
+        total++;
+        sum += value;
+        if (value < min_value) min_value = value;
+        if (value > max_value) max_value = value;
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        if (other.min_value < min_value) min_value = other.min_value;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+
+    int64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+
+        int64_t target = (int64_t)(p / 100.0 * total + 0.5);
+        if (target < 1) {
+            target = 1;
+        }
+
+        int64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= target) {
+                int64_t value = highestEquivalent(i);
+                return value < max_value ? value : max_value;
+            }
+        }
+        return max_value;
+    }
+
+    int64_t getCount() const { return total; }
+    int64_t getMin() const { return total ? min_value : 0; }
+    int64_t getMax() const { return max_value; }
+    double getMean() const { return total ? sum / total : 0; }
+};
+
+#endif
@@ -0,0 +1,727 @@
+//load generator for the HTTP server: drives it over loopback with a configurable
+//request mix, concurrency, keep-alive and pipeline depth, and writes RPS plus
+//latency percentiles to a JSON file (see `make bench`)
+
+#include "Histogram.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+enum RequestType { STATIC, LOGIN, UPLOAD, FILES, TYPE_COUNT };
+static const char* TYPE_NAMES[TYPE_COUNT] = { "static", "login", "upload", "files" };
+
+struct Options {
+    std::string host;
+    int port;
+    int concurrency;
+    int threads;
+    double duration;
+    double warmup;
+    int pipeline;
+    bool keep_alive;
+    int weights[TYPE_COUNT];
+    double upload_mb;
+    std::string static_path;
+    std::string output;
+    std::string compare;
+    double max_regression;
+
+    Options() : host("127.0.0.1"), port(8080), concurrency(32), threads(0), duration(10),
+                warmup(1), pipeline(1), keep_alive(true), upload_mb(1),
+                static_path("/index.html"), output("bench-results.json"), max_regression(10) {
+        weights[STATIC] = 70;
+        weights[LOGIN] = 10;
+        weights[UPLOAD] = 5;
+        weights[FILES] = 15;
+    }
+};
+
+//per worker thread results, merged at the end
+struct Stats {
+    Histogram overall;
+    Histogram by_type[TYPE_COUNT];
+    long long requests[TYPE_COUNT];
+    long long bytes_received;
+    long long status_errors;     //4xx/5xx responses
+    long long socket_errors;     //resets, failed connects, truncated responses
+    long long reconnects;
+
+    Stats() : bytes_received(0), status_errors(0), socket_errors(0), reconnects(0) {
+        memset(requests, 0, sizeof(requests));
+    }
+};
+
+struct Pending {
+    RequestType type;
+    long long start_ns;
+};
+
+struct ClientConn {
+    int fd;
+    std::string out;
+    size_t out_sent;
+    std::string in;
+    std::deque<Pending> inflight;
+    bool want_write;
+
+    ClientConn() : fd(-1), out_sent(0), want_write(false) {}
+};
+
+static long long nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --host ADDR             server address (127.0.0.1)\n"
+              << "  --port N                server port (8080)\n"
+              << "  --concurrency N         open connections (32)\n"
+              << "  --threads N             worker threads (min(concurrency, cores))\n"
+              << "  --duration SEC          measured run time (10)\n"
+              << "  --warmup SEC            unmeasured ramp-up before that (1)\n"
+              << "  --pipeline N            requests in flight per connection (1)\n"
+              << "  --no-keepalive          new connection per request\n"
+              << "  --mix static=70,login=10,upload=5,files=15\n"
+              << "                          relative weights of each request type\n"
+              << "  --upload-mb N           size of the /upload file (1)\n"
+              << "  --static-path PATH      path for static requests (/index.html)\n"
+              << "  --out FILE              JSON results (bench-results.json)\n"
+              << "  --compare FILE          fail if RPS or p99 regressed against an earlier run\n"
+              << "  --max-regression PCT    tolerance for --compare (10)\n";
+}
+
+static bool parseMix(const std::string& mix, int* weights) {
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        weights[i] = 0;
+    }
+
+    std::istringstream stream(mix);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals_pos = item.find('=');
+        if (equals_pos == std::string::npos) {
+            return false;
+        }
+
+        std::string name = item.substr(0, equals_pos);
+        int weight = atoi(item.c_str() + equals_pos + 1);
+        bool found = false;
+        for (int i = 0; i < TYPE_COUNT; i++) {
+            if (name == TYPE_NAMES[i]) {
+                weights[i] = weight;
+                found = true;
+            }
+        }
+        if (!found || weight < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--no-keepalive") {
+            opts.keep_alive = false;
+        } else if (arg == "--help" || !has_value) {
+            return false;
+        } else if (arg == "--host") {
+            opts.host = argv[++i];
+        } else if (arg == "--port") {
+            opts.port = atoi(argv[++i]);
+        } else if (arg == "--concurrency") {
+            opts.concurrency = atoi(argv[++i]);
+        } else if (arg == "--threads") {
+            opts.threads = atoi(argv[++i]);
+        } else if (arg == "--duration") {
+            opts.duration = atof(argv[++i]);
+        } else if (arg == "--warmup") {
+            opts.warmup = atof(argv[++i]);
+        } else if (arg == "--pipeline") {
+            opts.pipeline = atoi(argv[++i]);
+        } else if (arg == "--mix") {
+            if (!parseMix(argv[++i], opts.weights)) {
+                return false;
+            }
+        } else if (arg == "--upload-mb") {
+            opts.upload_mb = atof(argv[++i]);
+        } else if (arg == "--static-path") {
+            opts.static_path = argv[++i];
+        } else if (arg == "--out") {
+            opts.output = argv[++i];
+        } else if (arg == "--compare") {
+            opts.compare = argv[++i];
+        } else if (arg == "--max-regression") {
+            opts.max_regression = atof(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+
+    if (opts.concurrency < 1 || opts.pipeline < 1 || opts.duration <= 0) {
+        return false;
+    }
+
+    //without keep-alive every response ends the connection, nothing to pipeline into
+    if (!opts.keep_alive) {
+        opts.pipeline = 1;
+    }
+
+    if (opts.threads <= 0) {
+        opts.threads = std::min<int>(opts.concurrency, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    opts.threads = std::min(opts.threads, opts.concurrency);
+
+    int total_weight = 0;
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        total_weight += opts.weights[i];
+    }
+    return total_weight > 0;
+}
+
+//raw request bytes for each type, built once and reused for every send
+static std::vector<std::string> buildRequests(const Options& opts) {
+    std::vector<std::string> requests(TYPE_COUNT);
+    std::string connection = opts.keep_alive ? "keep-alive" : "close";
+    std::string common = "Host: " + opts.host + "\r\n"
+                         "User-Agent: loadgen\r\n"
+                         "Connection: " + connection + "\r\n";
+
+    requests[STATIC] = "GET " + opts.static_path + " HTTP/1.1\r\n" + common + "\r\n";
+    requests[FILES] = "GET /files HTTP/1.1\r\n" + common + "\r\n";
+
+    std::string login_body = "username=bench&password=bench";
+    requests[LOGIN] = "POST /login HTTP/1.1\r\n" + common +
+                      "Content-Type: application/x-www-form-urlencoded\r\n"
+                      "Content-Length: " + std::to_string(login_body.length()) + "\r\n\r\n" +
+                      login_body;
+
+    //letters only, so the payload can never contain the boundary
+    size_t upload_size = (size_t)(opts.upload_mb * 1024 * 1024);
+    std::string payload(upload_size, 'a');
+    unsigned seed = 12345;
+    for (size_t i = 0; i < upload_size; i++) {
+        seed = seed * 1103515245 + 12345;
+        payload[i] = 'a' + (seed >> 16) % 26;
+    }
+
+    std::string boundary = "----loadgenBoundary7MA4YWxkTrZu0gW";
+    std::string body = "--" + boundary + "\r\n"
+                       "Content-Disposition: form-data; name=\"description\"\r\n\r\n"
+                       "loadgen upload\r\n"
+                       "--" + boundary + "\r\n"
+                       "Content-Disposition: form-data; name=\"file\"; filename=\"loadgen-upload.bin\"\r\n"
+                       "Content-Type: application/octet-stream\r\n\r\n" +
+                       payload + "\r\n"
+                       "--" + boundary + "--\r\n";
+    requests[UPLOAD] = "POST /upload HTTP/1.1\r\n" + common +
+                       "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+                       "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+
+    return requests;
+}
+
+class Worker {
+private:
+    const Options& opts;
+    const std::vector<std::string>& requests;
+    long long measure_start_ns;
+    long long end_ns;
+    int epoll_fd;
+    std::vector<ClientConn> conns;
+    unsigned long long rng;
+    int total_weight;
+    bool draining;
+
+    RequestType pickType() {
+        //xorshift64, cheap and good enough for a request mix
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+
+        int roll = rng % total_weight;
+        for (int i = 0; i < TYPE_COUNT; i++) {
+            if (roll < opts.weights[i]) {
+                return (RequestType)i;
+            }
+            roll -= opts.weights[i];
+        }
+        return STATIC;
+    }
+
+    //non-blocking connect: a SYN dropped by a full accept queue costs a 1s+ retransmit,
+    //which must not stall every other connection on this worker. the first request
+    //sits in c.out until EPOLLOUT says the handshake finished
+    bool connectConn(ClientConn& c) {
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (c.fd < 0) {
+            return false;
+        }
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opts.port);
+        inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr);
+
+        if (connect(c.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            close(c.fd);
+            c.fd = -1;
+            return false;
+        }
+
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = &c;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c.fd, &ev);
+
+        c.out.clear();
+        c.out_sent = 0;
+        c.in.clear();
+        c.inflight.clear();
+        c.want_write = true;
+        return true;
+    }
+
+    void reconnect(ClientConn& c) {
+        if (c.fd != -1) {
+            close(c.fd);
+            c.fd = -1;
+        }
+        stats.reconnects++;
+
+        if (!draining && !connectConn(c)) {
+            stats.socket_errors++;
+            return;
+        }
+        issue(c);
+    }
+
+    void setWantWrite(ClientConn& c, bool want) {
+        if (c.want_write == want) {
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = want ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.ptr = &c;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.want_write = want;
+    }
+
+    //top the connection back up to the pipeline depth
+    void issue(ClientConn& c) {
+        if (c.fd == -1 || draining) {
+            return;
+        }
+
+        long long now = nowNs();
+        while ((int)c.inflight.size() < opts.pipeline) {
+            RequestType type = pickType();
+            c.out += requests[type];
+            Pending pending;
+            pending.type = type;
+            pending.start_ns = now;
+            c.inflight.push_back(pending);
+        }
+        flush(c);
+    }
+
+    void flush(ClientConn& c) {
+        while (c.out_sent < c.out.length()) {
+            ssize_t n = send(c.fd, c.out.data() + c.out_sent, c.out.length() - c.out_sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    setWantWrite(c, true);
+                    return;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                stats.socket_errors++;
+                reconnect(c);
+                return;
+            }
+            c.out_sent += n;
+        }
+
+        c.out.clear();
+        c.out_sent = 0;
+        setWantWrite(c, false);
+    }
+
+    //end of a chunked body starting at pos (after the terminating 0 chunk), npos until it's all in
+    static size_t chunkedEnd(const std::string& in, size_t pos) {
+        while (true) {
+            size_t line_end = in.find("\r\n", pos);
+            if (line_end == std::string::npos) {
+                return std::string::npos;
+            }
+            size_t size = strtoull(in.c_str() + pos, nullptr, 16);
+            if (size == 0) {
+                return line_end + 4 <= in.length() ? line_end + 4 : std::string::npos;
+            }
+            pos = line_end + 2 + size + 2;
+            if (pos > in.length()) {
+                return std::string::npos;
+            }
+        }
+    }
+
+    //consume every complete response in the input buffer
+    void parseResponses(ClientConn& c) {
+        while (!c.inflight.empty()) {
+            size_t headers_end = c.in.find("\r\n\r\n");
+            if (headers_end == std::string::npos) {
+                return;
+            }
+
+            std::string headers = c.in.substr(0, headers_end);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+            long long content_length = 0;
+            size_t cl_pos = headers.find("content-length:");
+            if (cl_pos != std::string::npos) {
+                content_length = atoll(headers.c_str() + cl_pos + 15);
+            }
+
+            size_t total = headers_end + 4 + content_length;
+            if (headers.find("transfer-encoding: chunked") != std::string::npos) {
+                total = chunkedEnd(c.in, headers_end + 4);
+                if (total == std::string::npos) {
+                    return;
+                }
+            }
+            if (c.in.length() < total) {
+                return;
+            }
+
+            int status = headers.length() > 12 ? atoi(headers.c_str() + 9) : 0;
+            c.in.erase(0, total);
+
+            Pending pending = c.inflight.front();
+            c.inflight.pop_front();
+
+            long long now = nowNs();
+            if (pending.start_ns >= measure_start_ns && now <= end_ns) {
+                long long latency = now - pending.start_ns;
+                stats.overall.record(latency);
+                stats.by_type[pending.type].record(latency);
+                stats.requests[pending.type]++;
+                stats.bytes_received += total;
+                if (status >= 400 || status == 0) {
+                    stats.status_errors++;
+                }
+            }
+        }
+    }
+
+    void onReadable(ClientConn& c) {
+        char buffer[65536];
+
+        while (true) {
+            ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+
+            if (n > 0) {
+                c.in.append(buffer, n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            //closed: expected after a Connection: close response, an error mid-response
+            parseResponses(c);
+            if (!c.inflight.empty() && !draining) {
+                stats.socket_errors++;
+            }
+            reconnect(c);
+            return;
+        }
+
+        parseResponses(c);
+        if (opts.keep_alive) {
+            issue(c);
+        }
+    }
+
+public:
+    Stats stats;
+
+    Worker(const Options& opts, const std::vector<std::string>& requests, int connections,
+           long long measure_start_ns, long long end_ns, unsigned seed)
+        : opts(opts), requests(requests), measure_start_ns(measure_start_ns), end_ns(end_ns),
+          epoll_fd(-1), conns(connections), rng(seed * 2654435761ULL + 1), total_weight(0),
+          draining(false) {
+        for (int i = 0; i < TYPE_COUNT; i++) {
+            total_weight += opts.weights[i];
+        }
+    }
+
+    ~Worker() {
+        for (auto& c : conns) {
+            if (c.fd != -1) {
+                close(c.fd);
+            }
+        }
+        if (epoll_fd != -1) {
+            close(epoll_fd);
+        }
+    }
+
+    void run() {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        for (auto& c : conns) {
+            if (!connectConn(c)) {
+                stats.socket_errors++;
+                continue;
+            }
+            issue(c);
+        }
+
+        struct epoll_event events[256];
+        while (true) {
+            long long now = nowNs();
+            if (now >= end_ns) {
+                break;
+            }
+
+            int timeout_ms = (int)std::min<long long>((end_ns - now) / 1000000 + 1, 100);
+            int count = epoll_wait(epoll_fd, events, 256, timeout_ms);
+
+            for (int i = 0; i < count; i++) {
+                ClientConn& c = *static_cast<ClientConn*>(events[i].data.ptr);
+                if (c.fd == -1) {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(c);
+                }
+                if (c.fd != -1 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                    onReadable(c);
+                }
+            }
+        }
+
+        draining = true;
+    }
+};
+
+//pull "key": number out of a previous results file, looking after an optional section marker
+static double findJsonNumber(const std::string& json, const std::string& section, const std::string& key) {
+    size_t start = section.empty() ? 0 : json.find("\"" + section + "\"");
+    if (start == std::string::npos) {
+        return -1;
+    }
+    size_t pos = json.find("\"" + key + "\":", start);
+    if (pos == std::string::npos) {
+        return -1;
+    }
+    return atof(json.c_str() + pos + key.length() + 3);
+}
+
+static void writeLatency(std::ostream& out, const Histogram& h, const std::string& indent) {
+    out << indent << "\"min\": " << h.getMin() / 1000.0 << ",\n"
+        << indent << "\"mean\": " << h.getMean() / 1000.0 << ",\n"
+        << indent << "\"p50\": " << h.percentile(50) / 1000.0 << ",\n"
+        << indent << "\"p90\": " << h.percentile(90) / 1000.0 << ",\n"
+        << indent << "\"p99\": " << h.percentile(99) / 1000.0 << ",\n"
+        << indent << "\"p999\": " << h.percentile(99.9) / 1000.0 << ",\n"
+        << indent << "\"p9999\": " << h.percentile(99.99) / 1000.0 << ",\n"
+        << indent << "\"max\": " << h.getMax() / 1000.0 << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    //wait for the server to come up (make bench starts it right before us)
+    bool reachable = false;
+    for (int attempt = 0; attempt < 50 && !reachable; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opts.port);
+        inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr);
+        reachable = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if (!reachable) {
+            usleep(100000);
+        }
+    }
+    if (!reachable) {
+        std::cerr << "ERROR: Could not connect to " << opts.host << ":" << opts.port << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> requests = buildRequests(opts);
+
+    std::cout << "Running " << opts.duration << "s (+" << opts.warmup << "s warmup) against "
+              << opts.host << ":" << opts.port << ": " << opts.concurrency << " connections, "
+              << opts.threads << " threads, pipeline " << opts.pipeline
+              << (opts.keep_alive ? ", keep-alive" : ", no keep-alive") << std::endl;
+
+    long long start_ns = nowNs();
+    long long measure_start_ns = start_ns + (long long)(opts.warmup * 1e9);
+    long long end_ns = measure_start_ns + (long long)(opts.duration * 1e9);
+
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opts.threads; i++) {
+        //spread connections as evenly as possible
+        int connections = opts.concurrency / opts.threads + (i < opts.concurrency % opts.threads ? 1 : 0);
+        workers.push_back(new Worker(opts, requests, connections, measure_start_ns, end_ns, i + 1));
+    }
+    for (auto worker : workers) {
+        threads.push_back(std::thread(&Worker::run, worker));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Stats total;
+    for (auto worker : workers) {
+        total.overall.merge(worker->stats.overall);
+        for (int i = 0; i < TYPE_COUNT; i++) {
+            total.by_type[i].merge(worker->stats.by_type[i]);
+            total.requests[i] += worker->stats.requests[i];
+        }
+        total.bytes_received += worker->stats.bytes_received;
+        total.status_errors += worker->stats.status_errors;
+        total.socket_errors += worker->stats.socket_errors;
+        total.reconnects += worker->stats.reconnects;
+        delete worker;
+    }
+
+    long long completed = total.overall.getCount();
+    double rps = completed / opts.duration;
+    double mb_per_sec = total.bytes_received / opts.duration / (1024.0 * 1024.0);
+
+    std::cout << "Requests: " << completed << "  RPS: " << rps << "  MB/s: " << mb_per_sec << std::endl;
+    std::cout << "Errors: " << total.status_errors << " status, " << total.socket_errors << " socket" << std::endl;
+    std::cout << "Latency (us): p50 " << total.overall.percentile(50) / 1000.0
+              << "  p90 " << total.overall.percentile(90) / 1000.0
+              << "  p99 " << total.overall.percentile(99) / 1000.0
+              << "  p99.9 " << total.overall.percentile(99.9) / 1000.0
+              << "  max " << total.overall.getMax() / 1000.0 << std::endl;
+
+    std::ofstream out(opts.output);
+    if (!out.is_open()) {
+        std::cerr << "ERROR: Could not write " << opts.output << std::endl;
+        return 1;
+    }
+
+    out << "{\n"
+        << "  \"rps\": " << rps << ",\n"
+        << "  \"requests\": " << completed << ",\n"
+        << "  \"mb_per_sec\": " << mb_per_sec << ",\n"
+        << "  \"status_errors\": " << total.status_errors << ",\n"
+        << "  \"socket_errors\": " << total.socket_errors << ",\n"
+        << "  \"reconnects\": " << total.reconnects << ",\n"
+        << "  \"config\": {\n"
+        << "    \"host\": \"" << opts.host << "\",\n"
+        << "    \"port\": " << opts.port << ",\n"
+        << "    \"concurrency\": " << opts.concurrency << ",\n"
+        << "    \"threads\": " << opts.threads << ",\n"
+        << "    \"duration_s\": " << opts.duration << ",\n"
+        << "    \"warmup_s\": " << opts.warmup << ",\n"
+        << "    \"pipeline\": " << opts.pipeline << ",\n"
+        << "    \"keep_alive\": " << (opts.keep_alive ? "true" : "false") << ",\n"
+        << "    \"upload_mb\": " << opts.upload_mb << ",\n"
+        << "    \"static_path\": \"" << opts.static_path << "\",\n"
+        << "    \"mix\": {";
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        out << (i ? ", " : "") << "\"" << TYPE_NAMES[i] << "\": " << opts.weights[i];
+    }
+    out << "}\n"
+        << "  },\n"
+        << "  \"latency_us\": {\n";
+    writeLatency(out, total.overall, "    ");
+    out << "  },\n"
+        << "  \"by_type\": {\n";
+    bool first = true;
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        if (opts.weights[i] == 0) {
+            continue;
+        }
+        out << (first ? "" : ",\n") << "    \"" << TYPE_NAMES[i] << "\": {\n"
+            << "      \"requests\": " << total.requests[i] << ",\n"
+            << "      \"rps\": " << total.requests[i] / opts.duration << ",\n";
+        writeLatency(out, total.by_type[i], "      ");
+        out << "    }";
+        first = false;
+    }
+    out << "\n  }\n"
+        << "}\n";
+    out.close();
+
+    std::cout << "Results written to " << opts.output << std::endl;
+
+    //regression gate against an earlier results file
+    if (!opts.compare.empty()) {
+        std::ifstream previous_file(opts.compare);
+        if (!previous_file.is_open()) {
+            std::cerr << "ERROR: Could not read " << opts.compare << std::endl;
+            return 1;
+        }
+        std::stringstream ss;
+        ss << previous_file.rdbuf();
+        std::string previous = ss.str();
+
+        double old_rps = findJsonNumber(previous, "", "rps");
+        double old_p99 = findJsonNumber(previous, "latency_us", "p99");
+        double new_p99 = total.overall.percentile(99) / 1000.0;
+        double tolerance = opts.max_regression / 100.0;
+
+        std::cout << "Baseline " << opts.compare << ": RPS " << old_rps << " -> " << rps
+                  << ", p99 " << old_p99 << "us -> " << new_p99 << "us" << std::endl;
+
+        bool regressed = false;
+        if (old_rps > 0 && rps < old_rps * (1 - tolerance)) {
+            std::cerr << "REGRESSION: RPS dropped more than " << opts.max_regression << "%" << std::endl;
+            regressed = true;
+        }
+        if (old_p99 > 0 && new_p99 > old_p99 * (1 + tolerance)) {
+            std::cerr << "REGRESSION: p99 latency grew more than " << opts.max_regression << "%" << std::endl;
+            regressed = true;
+        }
+        if (regressed) {
+            return 2;
+        }
+    }
+
+    return total.socket_errors > 0 && completed == 0 ? 1 : 0;
+}
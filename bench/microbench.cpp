@@ -0,0 +1,498 @@
+//microbenchmarks for the request/response hot paths: ns/op plus heap allocations/op
+//(counted by replacing the global operator new) for every parser and helper.
+//inputs come from a JSONL corpus (requests.jsonl in the repo root by default) so
+//form bodies and encoded strings look like real text, with a built-in fallback
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Server.h"
+#include "Template.h"
+#include "Hpack.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+//allocation counters, bumped by the operator new replacements below
+static unsigned long long alloc_count = 0;
+static unsigned long long alloc_bytes = 0;
+
+void* operator new(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+//keep the optimizer from dropping a result we never read
+template <typename T>
+static void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result {
+    std::string name;
+    unsigned long long iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double alloc_bytes_per_op;
+};
+
+struct Options {
+    std::string corpus;
+    std::string filter;
+    std::string json;
+    double min_time;
+
+    Options() : corpus("requests.jsonl"), min_time(0.2) {}
+};
+
+static Options opts;
+static std::vector<Result> results;
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//run fn in growing batches until one batch takes min_time, then report that batch
+template <typename F>
+static void bench(const std::string& name, F fn) {
+    if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos) {
+        return;
+    }
+
+    //the parsers log every field to stdout, which would swamp what we're measuring
+    std::streambuf* saved_out = std::cout.rdbuf(nullptr);
+    std::streambuf* saved_err = std::cerr.rdbuf(nullptr);
+
+    fn();   //warm up caches and any lazy statics
+
+    unsigned long long iterations = 1;
+    double elapsed = 0;
+    unsigned long long allocs = 0;
+    unsigned long long bytes = 0;
+
+    while (true) {
+        unsigned long long allocs_before = alloc_count;
+        unsigned long long bytes_before = alloc_bytes;
+        double start = nowSeconds();
+
+        for (unsigned long long i = 0; i < iterations; i++) {
+            fn();
+        }
+
+        elapsed = nowSeconds() - start;
+        allocs = alloc_count - allocs_before;
+        bytes = alloc_bytes - bytes_before;
+
+        if (elapsed >= opts.min_time || iterations >= (1ULL << 40)) {
+            break;
+        }
+
+        //aim a little past min_time based on what we just saw
+        double scale = elapsed > 0 ? opts.min_time * 1.4 / elapsed : 100;
+        if (scale > 100) {
+            scale = 100;
+        }
+        iterations = (unsigned long long)(iterations * scale) + 1;
+    }
+
+    std::cout.rdbuf(saved_out);
+    std::cerr.rdbuf(saved_err);
+    std::cout.clear();
+    std::cerr.clear();
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = elapsed * 1e9 / iterations;
+    result.allocs_per_op = (double)allocs / iterations;
+    result.alloc_bytes_per_op = (double)bytes / iterations;
+    results.push_back(result);
+
+    printf("%-44s %12.1f ns/op %10.1f allocs/op %12.1f B/op %12llu iters\n",
+           name.c_str(), result.ns_per_op, result.allocs_per_op,
+           result.alloc_bytes_per_op, iterations);
+    fflush(stdout);
+}
+
+//minimal JSON string extraction: every "key": "value" string value on a line
+static void extractJsonStrings(const std::string& line, std::vector<std::string>& out) {
+    size_t pos = 0;
+    bool is_value = false;
+
+    while ((pos = line.find('"', pos)) != std::string::npos) {
+        std::string value;
+        size_t i = pos + 1;
+
+        for (; i < line.length() && line[i] != '"'; i++) {
+            if (line[i] == '\\' && i + 1 < line.length()) {
+                char escaped = line[++i];
+                switch (escaped) {
+                    case 'n': value += '\n'; break;
+                    case 't': value += '\t'; break;
+                    case 'r': value += '\r'; break;
+                    case 'u': value += '?'; i += 4; break;     //good enough for a corpus
+                    default: value += escaped; break;
+                }
+            } else {
+                value += line[i];
+            }
+        }
+
+        //strings alternate key, value in the flat objects we read
+        if (is_value) {
+            out.push_back(value);
+        }
+        is_value = !is_value;
+        pos = i + 1;
+    }
+}
+
+static std::vector<std::string> loadCorpus(const std::string& path) {
+    std::vector<std::string> corpus;
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        extractJsonStrings(line, corpus);
+    }
+
+    if (corpus.empty()) {
+        std::cerr << "Corpus " << path << " not found or empty, using built-in strings" << std::endl;
+        corpus.push_back("Quarterly report (final).pdf");
+        corpus.push_back("hello world & good morning = 100% done");
+        corpus.push_back("The quick brown fox jumps over the lazy dog, then does it again; "
+                         "C++ & \"quotes\" / slashes \\ and unicode caf\xc3\xa9 r\xc3\xa9sum\xc3\xa9.");
+        corpus.push_back("user@example.com");
+        corpus.push_back("a/b/c d.txt");
+    }
+
+    return corpus;
+}
+
+static std::string multipartBody(const std::string& boundary, size_t file_size) {
+    std::string payload(file_size, 'x');
+    for (size_t i = 0; i < file_size; i++) {
+        payload[i] = 'a' + (i * 7919) % 26;
+    }
+
+    return "--" + boundary + "\r\n"
+           "Content-Disposition: form-data; name=\"description\"\r\n\r\n"
+           "benchmark upload\r\n"
+           "--" + boundary + "\r\n"
+           "Content-Disposition: form-data; name=\"file\"; filename=\"bench.bin\"\r\n"
+           "Content-Type: application/octet-stream\r\n\r\n" +
+           payload + "\r\n"
+           "--" + boundary + "--\r\n";
+}
+
+static std::string formatSize(size_t bytes) {
+    if (bytes >= 1024 * 1024) {
+        return std::to_string(bytes / (1024 * 1024)) + "MB";
+    }
+    if (bytes >= 1024) {
+        return std::to_string(bytes / 1024) + "KB";
+    }
+    return std::to_string(bytes) + "B";
+}
+
+static void writeJson(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "ERROR: Could not write " << path << std::endl;
+        return;
+    }
+
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"allocs_per_op\": " << r.allocs_per_op
+            << ", \"alloc_bytes_per_op\": " << r.alloc_bytes_per_op << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+
+    std::cout << "Results written to " << path << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            opts.corpus = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            opts.json = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            opts.min_time = atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--corpus FILE.jsonl] [--filter SUBSTRING] [--json OUT] [--min-time SEC]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> corpus = loadCorpus(opts.corpus);
+
+    //encoded forms of the corpus, and a form body built from it like a browser would
+    std::vector<std::string> encoded;
+    std::string form_body;
+    for (size_t i = 0; i < corpus.size(); i++) {
+        encoded.push_back(HttpRequest::urlEncode(corpus[i]));
+        form_body += (i ? "&" : "") + std::string("field") + std::to_string(i % 8) + "=" + encoded.back();
+        if (form_body.length() > 8192) {
+            break;
+        }
+    }
+
+    size_t corpus_bytes = 0;
+    for (const auto& text : corpus) {
+        corpus_bytes += text.length();
+    }
+    std::cout << "Corpus: " << corpus.size() << " strings, " << corpus_bytes << " bytes from "
+              << opts.corpus << std::endl << std::endl;
+
+    const std::string cookie_header = "session_id=sess_0123456789abcdef; username=alice; "
+                                      "theme=dark; _ga=GA1.2.1234567890.1234567890; lang=en-US";
+
+    const std::string get_request =
+        "GET /uploads/Quarterly%20report%20(final).pdf?download=1 HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Referer: http://localhost:8080/files\r\n"
+        "Cookie: " + cookie_header + "\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "\r\n";
+
+    const std::string form_request =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: " + std::to_string(form_body.length()) + "\r\n"
+        "\r\n" + form_body;
+
+    //HttpRequest::parse
+    bench("HttpRequest::parse/get", [&]() {
+        HttpRequest request;
+        doNotOptimize(request.parse(get_request));
+    });
+
+    bench("HttpRequest::parse/form_" + formatSize(form_body.length()), [&]() {
+        HttpRequest request;
+        doNotOptimize(request.parse(form_request));
+    });
+
+    //cookies
+    HttpRequest cookie_request;
+    cookie_request.parse(get_request);
+
+    //the accessors parse on first use and cache: a copy of a parsed request starts with an empty
+    //cache, so "first" is the parse (plus the copy), getCookie the lookups handlers repeat
+    bench("HttpRequest::getCookies/first", [&]() {
+        HttpRequest request = cookie_request;
+        doNotOptimize(request.getCookies());
+    });
+
+    bench("HttpRequest::getCookie", [&]() {
+        std::string_view value = cookie_request.getCookie("session_id");
+        doNotOptimize(value);
+    });
+
+    //getFormData
+    HttpRequest form_request_parsed;
+    form_request_parsed.parse(form_request);
+
+    bench("HttpRequest::getFormData/" + formatSize(form_body.length()), [&]() {
+        HttpRequest request = form_request_parsed;
+        doNotOptimize(request.getFormData());
+    });
+
+    //parseMultipartFormData at several body sizes
+    const std::string boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+    const size_t multipart_sizes[] = { 1024, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+
+    for (size_t size : multipart_sizes) {
+        std::string body = multipartBody(boundary, size);
+        std::string raw = "POST /upload HTTP/1.1\r\n"
+                          "Host: localhost:8080\r\n"
+                          "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+                          "Content-Length: " + std::to_string(body.length()) + "\r\n"
+                          "\r\n" + body;
+
+        HttpRequest upload_request;
+        upload_request.parse(raw);
+
+        bench("HttpRequest::getUploadedFiles/" + formatSize(size), [&]() {
+            HttpRequest request = upload_request;
+            doNotOptimize(request.getUploadedFiles());
+            doNotOptimize(request.getMultipartFields());
+        });
+    }
+
+    //url coding over the whole corpus, reported per string
+    size_t corpus_index = 0;
+    bench("HttpRequest::urlDecode/corpus", [&]() {
+        std::string decoded = HttpRequest::urlDecode(encoded[corpus_index]);
+        doNotOptimize(decoded);
+        corpus_index = (corpus_index + 1) % encoded.size();
+    });
+
+    corpus_index = 0;
+    bench("HttpRequest::urlEncode/corpus", [&]() {
+        std::string encoded_text = HttpRequest::urlEncode(corpus[corpus_index]);
+        doNotOptimize(encoded_text);
+        corpus_index = (corpus_index + 1) % corpus.size();
+    });
+
+    bench("HttpRequest::urlDecode/path", [&]() {
+        std::string decoded = HttpRequest::urlDecode("/uploads/Quarterly%20report%20%28final%29.pdf");
+        doNotOptimize(decoded);
+    });
+
+    //HttpResponse::build
+    std::string page(4096, 'x');
+    bench("HttpResponse::build/4KB", [&]() {
+        HttpResponse response;
+        response.setStatus(200);
+        response.setHeader("Server", "MyHTTPServer/1.0");
+        response.setHeader("Connection", "keep-alive");
+        response.setHeader("Content-Type", "text/html");
+        response.setBody(page);
+        std::string raw = response.build();
+        doNotOptimize(raw);
+    });
+
+    bench("HttpResponse::build/redirect_cookies", [&]() {
+        HttpResponse response;
+        response.setStatus(302);
+        response.setHeader("Location", "/dashboard");
+        response.setCookie("session_id", "sess_0123456789abcdef", 3600, "/");
+        response.setCookie("username", "alice", 3600, "/");
+        response.setBody("<html><body>Redirecting to dashboard...</body></html>");
+        std::string raw = response.build();
+        doNotOptimize(raw);
+    });
+
+    //Server helpers
+    const char* paths[] = {
+        "/index.html", "/style.css", "/images/logo.png", "/uploads/report.pdf",
+        "/uploads/archive.zip", "/uploads/notes", "/app.js", "/uploads/photo.JPEG"
+    };
+    size_t path_count = sizeof(paths) / sizeof(paths[0]);
+
+    size_t path_index = 0;
+    bench("Server::getContentType", [&]() {
+        std::string type = Server::getContentType(paths[path_index]);
+        doNotOptimize(type);
+        path_index = (path_index + 1) % path_count;
+    });
+
+    const std::string unsafe_paths[] = {
+        "/index.html", "/uploads/Quarterly report (final).pdf", "/../etc/passwd",
+        "/uploads/%2e%2e/%2E%2E/etc/shadow", "/a/very/long/but/perfectly/normal/path/to/some/file.html"
+    };
+    size_t unsafe_count = sizeof(unsafe_paths) / sizeof(unsafe_paths[0]);
+
+    path_index = 0;
+    std::string canonical;
+    bench("HttpRequest::canonicalPath", [&]() {
+        doNotOptimize(HttpRequest::canonicalPath(unsafe_paths[path_index], canonical));
+        path_index = (path_index + 1) % unsafe_count;
+    });
+
+    //Template: the /files page with one piece of FILES_PAGE_SIZE cards, as the server streams it
+    Template files_page;
+    if (files_page.load("templates/files.html")) {
+        TemplateData data;
+        data.set("total", std::to_string(FILES_PAGE_SIZE)).set("has_files", "1");
+        TemplateData piece;
+        std::vector<TemplateData>& cards = piece.rows("files");
+        for (size_t i = 0; i < FILES_PAGE_SIZE; i++) {
+            std::string name = corpus[i % corpus.size()];
+            cards.emplace_back();
+            cards.back().set("icon", "[FILE]").set("name", name).set("url", HttpRequest::urlEncode(name));
+        }
+        
+        bench("Template::render/files_" + std::to_string(FILES_PAGE_SIZE), [&]() {
+            std::string html;
+            files_page.renderBefore("files", data, html);
+            files_page.renderRows("files", piece, html);
+            files_page.renderAfter("files", data, html);
+            doNotOptimize(html);
+        });
+    }
+    
+    corpus_index = 0;
+    bench("Template::appendEscaped/corpus", [&]() {
+        std::string escaped;
+        Template::appendEscaped(escaped, corpus[corpus_index]);
+        doNotOptimize(escaped);
+        corpus_index = (corpus_index + 1) % corpus.size();
+    });
+
+    //HPACK: a request header block (RFC 7541 C.4.1, :authority Huffman coded) and the headers
+    //of a static file response, with the tables as warm as they are mid-connection
+    const uint8_t request_block[] = {
+        0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff
+    };
+    HpackDecoder decoder;
+    std::vector<HpackHeader> headers;
+    bench("HpackDecoder::decode/request", [&]() {
+        doNotOptimize(decoder.decode(request_block, sizeof(request_block), 65536, headers));
+    });
+    
+    HpackEncoder encoder;
+    bench("HpackEncoder::encode/response", [&]() {
+        std::string block;
+        encoder.begin(block);
+        encoder.encode(":status", "200", block);
+        encoder.encode("content-length", "18342", block);
+        encoder.encode("content-type", "text/css", block);
+        encoder.encode("etag", "\"2322f11b29e10f93\"", block);
+        encoder.encode("server", "MyHTTPServer/1.0", block);
+        encoder.encode("vary", "Accept-Encoding", block);
+        doNotOptimize(block);
+    });
+
+    if (!opts.json.empty()) {
+        std::cout << std::endl;
+        writeJson(opts.json);
+    }
+
+    return 0;
+}
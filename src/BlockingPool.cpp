@@ -0,0 +1,102 @@
+#include "BlockingPool.h"
+#include <iostream>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+BlockingPool::BlockingPool(int threads, size_t max_queued)
+    : max_queued(max_queued), stopping(false) {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        std::cerr << "ERROR: Failed to create the blocking pool eventfd" << std::endl;
+    }
+
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&BlockingPool::workerLoop, this);
+    }
+}
+
+//queued work still runs (an upload half moved into the store is worse than a slow exit),
+//completions that didn't make it back to the loop are dropped
+BlockingPool::~BlockingPool() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (event_fd >= 0) {
+        close(event_fd);
+    }
+}
+
+bool BlockingPool::submit(Job work, Job done) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queue.size() >= max_queued || workers.empty() || event_fd < 0) {
+            return false;
+        }
+        queue.push_back(Task{std::move(work), std::move(done)});
+    }
+    queue_ready.notify_one();
+    return true;
+}
+
+void BlockingPool::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        task.work();
+        post(std::move(task.done));
+    }
+}
+
+void BlockingPool::post(Job done) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        first = finished.empty();
+        finished.push_back(std::move(done));
+    }
+
+    //one wakeup per batch: the loop drains everything that's finished when it gets to it
+    if (first) {
+        uint64_t one = 1;
+        ssize_t ignored = write(event_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void BlockingPool::runCompletions() {
+    uint64_t count;
+    ssize_t ignored = read(event_fd, &count, sizeof(count));
+    (void)ignored;
+
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        ready.swap(finished);
+    }
+
+    for (auto& done : ready) {
+        done();
+    }
+}
+
+void BlockingPool::setMaxQueued(size_t max) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    max_queued = max;
+}
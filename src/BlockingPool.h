@@ -0,0 +1,65 @@
+#ifndef BLOCKING_POOL_H
+#define BLOCKING_POOL_H
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define BLOCKING_POOL_THREADS 4
+#define BLOCKING_POOL_QUEUE 1024    //queued jobs before submit() refuses more
+
+//worker threads for filesystem work (writes, unlinks, hashing uploads) so the event loop
+//never waits on the disk. a job's work runs on a worker and must not touch loop-owned state
+//(catalog, sessions, connections); its done callback runs afterwards on the loop thread,
+//which calls runCompletions() whenever eventFd() turns readable
+class BlockingPool {
+public:
+    typedef std::function<void()> Job;
+
+private:
+    struct Task {
+        Job work;
+        Job done;
+    };
+
+    std::vector<std::thread> workers;
+    size_t max_queued;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::deque<Task> queue;
+    bool stopping;
+
+    std::mutex finished_mutex;
+    std::vector<Job> finished;      //done callbacks waiting for the loop
+    int event_fd;
+
+    void workerLoop();
+
+public:
+    BlockingPool(int threads = BLOCKING_POOL_THREADS, size_t max_queued = BLOCKING_POOL_QUEUE);
+    ~BlockingPool();
+
+    BlockingPool(const BlockingPool&) = delete;
+    BlockingPool& operator=(const BlockingPool&) = delete;
+
+    //false when the queue is full (the caller should do the work itself)
+    bool submit(Job work, Job done);
+
+    //from any thread: run done on the loop thread, for work that finished somewhere other
+    //than the pool's own workers (e.g. SubmissionLog's writer)
+    void post(Job done);
+
+    int eventFd() const { return event_fd; }
+
+    //change the queue limit (config reload); jobs already queued stay
+    void setMaxQueued(size_t max);
+
+    //loop thread: run the done callbacks of finished jobs
+    void runCompletions();
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "Config.h"
+#include "BlockingPool.h"
+#include "FileCache.h"
+#include "PageCache.h"
+#include "SubmissionLog.h"
+#include "Server.h"
+#include "Tls.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+
+ServerConfig::ServerConfig()
+    : port(0), io("epoll"), buffer_size(DEFAULT_BUFFER_SIZE), recv_buffers(DEFAULT_RECV_BUFFERS),
+      uploads("./uploads"), templates("./templates"), workers(BLOCKING_POOL_THREADS), sha256(false),
+      tls_session_timeout(TLS_SESSION_TIMEOUT), pool_queue(BLOCKING_POOL_QUEUE),
+      file_cache_mb(FILE_CACHE_BUDGET_MB), page_cache_ttl_ms(PAGE_CACHE_TTL_MS),
+      page_cache_entries(PAGE_CACHE_MAX_ENTRIES), submissions_sync(SUBMISSION_SYNC_MS),
+      max_header_size(DEFAULT_MAX_HEADER_SIZE), max_form_body(MAX_FORM_BODY),
+      max_upload_body(MAX_UPLOAD_BODY), max_put_body(MAX_PUT_BODY), drain_timeout(DEFAULT_DRAIN_TIMEOUT) {
+}
+
+static std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+}
+
+//an integer within [min, max]; with sizes a k, m or g suffix multiplies by 1024s
+static bool parseNumber(const std::string& value, bool size, long long min, long long max, long long& out) {
+    const char* start = value.c_str();
+    char* end;
+    errno = 0;
+    long long n = strtoll(start, &end, 10);
+    if (end == start || errno != 0) {
+        return false;
+    }
+
+    if (size && *end != '\0') {
+        int shift = 0;
+        switch (tolower(*end)) {
+            case 'k': shift = 10; break;
+            case 'm': shift = 20; break;
+            case 'g': shift = 30; break;
+            default: return false;
+        }
+        if (n > (max >> shift)) {
+            return false;
+        }
+        n <<= shift;
+        end++;
+    }
+
+    if (*end != '\0' || n < min || n > max) {
+        return false;
+    }
+    out = n;
+    return true;
+}
+
+static bool parseBool(const std::string& value, bool& out) {
+    if (value == "true" || value == "yes" || value == "on" || value == "1") {
+        out = true;
+    } else if (value == "false" || value == "no" || value == "off" || value == "0") {
+        out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool isSwitch(const std::string& key) {
+    return key == "sha256" || key == "nodelay";
+}
+
+bool ServerConfig::set(const std::string& key, const std::string& value, std::string& error) {
+    long long n = 0;
+    bool ok = true;
+    const long long big = 1LL << 50;
+
+    if (key == "port") {
+        ok = parseNumber(value, false, 0, 65535, n) && (port = n, true);
+    } else if (key == "io") {
+        ok = value == "epoll" || value == "uring" || value == "io_uring";
+        io = value;
+    } else if (key == "buffer_size") {
+        ok = parseNumber(value, true, 1024, 1 << 20, n) && (buffer_size = n, true);
+    } else if (key == "recv_buffers") {
+        //the io_uring buffer ring indexes with a mask
+        ok = parseNumber(value, false, 1, 32768, n) && (n & (n - 1)) == 0 && (recv_buffers = n, true);
+    } else if (key == "www") {
+        www = value;
+    } else if (key == "uploads") {
+        ok = !value.empty();
+        uploads = value;
+    } else if (key == "templates") {
+        ok = !value.empty();
+        templates = value;
+    } else if (key == "workers") {
+        ok = parseNumber(value, false, 1, 256, n) && (workers = n, true);
+    } else if (key == "sha256") {
+        ok = parseBool(value, sha256);
+    } else if (key == "upgrade_socket") {
+        upgrade_socket = value;
+    } else if (key == "tls_cert") {
+        tls_cert = value;
+    } else if (key == "tls_key") {
+        tls_key = value;
+    } else if (key == "tls_session_timeout") {
+        ok = parseNumber(value, false, 0, 7 * 24 * 3600, n) && (tls_session_timeout = n, true);
+    } else if (key == "backlog") {
+        ok = parseNumber(value, false, 1, 1 << 20, n) && (socket.backlog = n, true);
+    } else if (key == "nodelay") {
+        ok = parseBool(value, socket.nodelay);
+    } else if (key == "defer_accept") {
+        ok = parseNumber(value, false, 0, 3600, n) && (socket.defer_accept = n, true);
+    } else if (key == "fastopen") {
+        ok = parseNumber(value, false, 0, 1 << 20, n) && (socket.fastopen_queue = n, true);
+    } else if (key == "rcvbuf") {
+        ok = parseNumber(value, true, 0, 1 << 30, n) && (socket.rcvbuf = n, true);
+    } else if (key == "sndbuf") {
+        ok = parseNumber(value, true, 0, 1 << 30, n) && (socket.sndbuf = n, true);
+    } else if (key == "pool_queue") {
+        ok = parseNumber(value, false, 1, 1 << 24, n) && (pool_queue = n, true);
+    } else if (key == "file_cache_mb") {
+        ok = parseNumber(value, false, 0, 1 << 30, n) && (file_cache_mb = n, true);
+    } else if (key == "page_cache_ttl_ms") {
+        ok = parseNumber(value, false, 0, 3600 * 1000, n) && (page_cache_ttl_ms = n, true);
+    } else if (key == "page_cache_entries") {
+        ok = parseNumber(value, false, 1, 1 << 24, n) && (page_cache_entries = n, true);
+    } else if (key == "submissions_sync") {
+        ok = parseNumber(value, false, -1, 60 * 1000, n) && (submissions_sync = n, true);
+    } else if (key == "max_header_size") {
+        ok = parseNumber(value, true, 1024, 16 << 20, n) && (max_header_size = n, true);
+    } else if (key == "max_form_body") {
+        ok = parseNumber(value, true, 0, big, n) && (max_form_body = n, true);
+    } else if (key == "max_upload_body") {
+        ok = parseNumber(value, true, 0, big, n) && (max_upload_body = n, true);
+    } else if (key == "max_put_body") {
+        ok = parseNumber(value, true, 0, big, n) && (max_put_body = n, true);
+    } else if (key == "drain_timeout") {
+        ok = parseNumber(value, false, 0, 24 * 3600, n) && (drain_timeout = n, true);
+    } else {
+        error = "unknown setting " + key;
+        return false;
+    }
+
+    if (!ok) {
+        error = "invalid value for " + key + ": " + value;
+    }
+    return ok;
+}
+
+bool ServerConfig::loadFile(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "could not open " + path;
+        return false;
+    }
+
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            error = path + ":" + std::to_string(number) + ": expected key = value";
+            return false;
+        }
+        if (!set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error)) {
+            error = path + ":" + std::to_string(number) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ServerConfig::load(int argc, char* argv[], ServerConfig& config, std::string& error) {
+    config = ServerConfig();
+
+    //the file first, so flags win wherever they are on the command line
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc) {
+            config.config_file = argv[i + 1];
+        } else if (arg.compare(0, 9, "--config=") == 0) {
+            config.config_file = arg.substr(9);
+        }
+    }
+    if (!config.config_file.empty() && !config.loadFile(config.config_file, error)) {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            error = "unexpected argument " + arg;
+            return false;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        bool has_value = false;
+        size_t equals = key.find('=');
+        if (equals != std::string::npos) {
+            value = key.substr(equals + 1);
+            key.resize(equals);
+            has_value = true;
+        }
+        std::replace(key.begin(), key.end(), '-', '_');
+
+        if (key == "config") {
+            i += has_value ? 0 : 1;
+            continue;
+        }
+        if (!has_value && isSwitch(key)) {
+            value = "true";
+        } else if (!has_value && key.compare(0, 3, "no_") == 0 && isSwitch(key.substr(3))) {
+            key = key.substr(3);
+            value = "false";
+        } else if (!has_value) {
+            if (i + 1 >= argc) {
+                error = arg + " needs a value";
+                return false;
+            }
+            value = argv[++i];
+        }
+
+        if (!config.set(key, value, error)) {
+            return false;
+        }
+    }
+
+    if (config.tls_cert.empty() != config.tls_key.empty()) {
+        error = "tls_cert and tls_key go together";
+        return false;
+    }
+    return true;
+}
+
+std::string ServerConfig::restartChanges(const ServerConfig& next) const {
+    std::string changed;
+    auto note = [&changed](bool differs, const char* key) {
+        if (differs) {
+            changed += (changed.empty() ? "" : ", ") + std::string(key);
+        }
+    };
+    note(listenPort() != next.listenPort(), "port");
+    note(io != next.io, "io");
+    note(buffer_size != next.buffer_size, "buffer_size");
+    note(recv_buffers != next.recv_buffers, "recv_buffers");
+    note(www != next.www, "www");
+    note(uploads != next.uploads, "uploads");
+    note(templates != next.templates, "templates");
+    note(workers != next.workers, "workers");
+    note(sha256 != next.sha256, "sha256");
+    note(upgrade_socket != next.upgrade_socket, "upgrade_socket");
+    note(useTls() != next.useTls(), "tls_cert");
+    return changed;
+}
+
+void ServerConfig::printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--config FILE] [--setting value ...]\n"
+              << "settings (also `setting = value` in the config file; * = restart to change):\n"
+              << "  port N*              8080, or 8443 with TLS\n"
+              << "  io epoll|uring*      event loop\n"
+              << "  buffer-size BYTES*   per recv / io_uring buffer (8k)\n"
+              << "  recv-buffers N*      io_uring provided buffers, a power of two (512)\n"
+              << "  www DIR*             serve DIR's files over the embedded www/\n"
+              << "  uploads DIR*         (./uploads)\n"
+              << "  templates DIR*       (./templates)\n"
+              << "  workers N*           blocking pool threads (4)\n"
+              << "  sha256*              also record SHA-256 of uploads\n"
+              << "  upgrade-socket PATH* hand the listener to a new server started with the same PATH\n"
+              << "  tls-cert PEM, tls-key PEM   HTTPS (turning it on or off*)\n"
+              << "  tls-session-timeout S      resumption lifetime (3600)\n"
+              << "  backlog N, nodelay / no-nodelay, defer-accept S, fastopen N,\n"
+              << "  rcvbuf BYTES, sndbuf BYTES  listener tuning, see Socket.h\n"
+              << "  pool-queue N         jobs queued for the blocking pool (1024)\n"
+              << "  file-cache-mb MB     small files kept mapped, 0 = off (256)\n"
+              << "  page-cache-ttl-ms MS, page-cache-entries N   rendered pages, ttl 0 = off (1000, 1024)\n"
+              << "  submissions-sync MS  form log commit window, -1 = never fsync (10)\n"
+              << "  max-header-size BYTES (64k)\n"
+              << "  max-form-body, max-upload-body, max-put-body BYTES   (1m, 1g, 64g)\n"
+              << "  drain-timeout S      SIGTERM: how long open connections get to finish (30)\n"
+              << "SIGHUP reloads the file and flags, SIGTERM drains and exits (twice: at once)" << std::endl;
+}
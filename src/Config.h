@@ -0,0 +1,74 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "Socket.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_TLS_PORT 8443           //with tls_cert and tls_key the server speaks HTTPS
+#define DEFAULT_BUFFER_SIZE 8192        //bytes per recv (each io_uring provided buffer)
+#define DEFAULT_RECV_BUFFERS 512        //io_uring provided buffers, a power of two
+#define DEFAULT_MAX_HEADER_SIZE 65536
+#define DEFAULT_DRAIN_TIMEOUT 30        //seconds SIGTERM waits for open connections to finish
+
+//everything that can be tuned without a rebuild. built-in defaults, then the config file
+//(--config FILE: `key = value` lines, # comments), then command-line flags over it
+//(--key value or --key=value, dashes for underscores; --key/--no-key for switches).
+//SIGHUP reads the file and flags again: the settings under "restart" keep their startup
+//values, everything else applies to the running server without dropping connections
+struct ServerConfig {
+    std::string config_file;
+
+    //restart: listener, event loop, content roots, worker threads
+    int port;                       //0: DEFAULT_PORT, or DEFAULT_TLS_PORT with TLS
+    std::string io;                 //epoll or uring
+    size_t buffer_size;
+    unsigned recv_buffers;
+    std::string www;                //overrides the embedded www/, empty for none
+    std::string uploads;
+    std::string templates;
+    int workers;                    //BlockingPool threads
+    bool sha256;                    //also record SHA-256 of uploads
+    std::string upgrade_socket;     //Unix socket for hot upgrades (Handoff), empty for none
+
+    //TLS: turning it on or off takes a restart, a reload re-reads the certificate and key
+    std::string tls_cert;
+    std::string tls_key;
+    int tls_session_timeout;        //seconds
+
+    //reload: applied to the listener (new connections) and the server
+    SocketOptions socket;
+    size_t pool_queue;
+    size_t file_cache_mb;
+    int page_cache_ttl_ms;
+    size_t page_cache_entries;
+    int submissions_sync;           //ms, SubmissionLog's commit window (-1: never fsync)
+    size_t max_header_size;
+    uint64_t max_form_body;         //request body limits, see Server::admitRequest()
+    uint64_t max_upload_body;
+    uint64_t max_put_body;
+    int drain_timeout;              //seconds
+
+    ServerConfig();
+
+    bool useTls() const { return !tls_cert.empty(); }
+    int listenPort() const { return port != 0 ? port : useTls() ? DEFAULT_TLS_PORT : DEFAULT_PORT; }
+
+    //one setting as spelled in the file; false with error set for an unknown key or bad value.
+    //sizes take a k/m/g suffix
+    bool set(const std::string& key, const std::string& value, std::string& error);
+
+    //`key = value` lines from path over the current values
+    bool loadFile(const std::string& path, std::string& error);
+
+    //the restart settings next changes, e.g. "io, workers" (empty if none), for a reload to warn about
+    std::string restartChanges(const ServerConfig& next) const;
+
+    //defaults, --config's file and then the other flags; false with error set
+    static bool load(int argc, char* argv[], ServerConfig& config, std::string& error);
+    static void printUsage(const char* program);
+};
+
+#endif
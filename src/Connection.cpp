@@ -0,0 +1,717 @@
+#include "Connection.h"
+#include "Http2Session.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+Connection::Connection(int fd, Server& server, TlsContext* tls_context)
+    : fd(fd), server(server), headers_end(std::string::npos), header_size(0),
+      content_length(-1), expect_continue(false), close_after_output(false), draining(false), h2(nullptr),
+      h2_allowed(true), tls(nullptr), seal_output(false), upload_remaining(0), upload_offset(0),
+      self(std::make_shared<Connection*>(this)), last_deferred_id(0) {
+    if (tls_context != nullptr) {
+        tls = new TlsSession(*tls_context, fd);
+    }
+}
+
+Connection::~Connection() {
+    *self = nullptr;
+    delete h2;
+    delete tls;
+
+    //gone before its body was complete
+    server.abortPut(upload);
+
+    for (const auto& chunk : output) {
+        if (chunk.file_fd != -1) {
+            ::close(chunk.file_fd);
+        }
+    }
+
+    ::close(fd);
+}
+
+void Connection::onReceive(const char* data, size_t len) {
+    if (!tls) {
+        receive(data, len);
+        return;
+    }
+
+    std::string plain;
+    bool closed;
+    if (!tls->decrypt(data, len, plain, closed)) {
+        //nothing more can be read, and nothing sent would be understood
+        close_after_output = true;
+        return;
+    }
+    if (!plain.empty() && !close_after_output) {
+        receive(plain.data(), plain.length());
+    }
+    if (closed) {
+        close_after_output = true;
+    }
+}
+
+TlsStatus Connection::continueHandshake() {
+    TlsStatus status = tls->handshake();
+    if (status != TLS_DONE) {
+        return status;
+    }
+
+    std::string protocol = tls->alpn();
+    std::cout << "TLS: " << tls->describe() << (tls->isResumed() ? ", resumed" : "")
+              << (tls->sendsInKernel() ? ", kTLS" : "")
+              << (protocol.empty() ? "" : ", ALPN " + protocol) << std::endl;
+
+    //over TLS HTTP/2 is agreed on by ALPN, never by Upgrade: h2c
+    h2_allowed = protocol == "h2";
+    seal_output = !tls->sendsInKernel();
+
+    //the client may have sent its first request right behind its Finished
+    onReceive(nullptr, 0);
+    return TLS_DONE;
+}
+
+void Connection::receive(const char* data, size_t len) {
+    if (h2) {
+        h2->onReceive(data, len);
+        return;
+    }
+
+    //PUT body bytes the backend couldn't splice go to the file from here
+    if (upload.fd != -1) {
+        size_t body = std::min<uint64_t>(len, upload_remaining);
+        if (!writeUpload(data, body)) {
+            return;
+        }
+        data += body;
+        len -= body;
+    }
+
+    //only the tail of the old input can complete a blank line
+    size_t scan_from = input.length() >= 3 ? input.length() - 3 : 0;
+    input.append(data, len);
+
+    if (headers_end == std::string::npos) {
+        findHeadersEnd(scan_from);
+    }
+
+    processInput();
+}
+
+//handle every complete request in the input; pipelined clients can send several in one read
+void Connection::processInput() {
+    std::string raw_request;
+    bool streamed_body;
+    while (!close_after_output && upload.fd == -1 && !h2 && !checkPreface() &&
+           extractRequest(raw_request, streamed_body)) {
+        if (streamed_body) {
+            startUpload(raw_request);
+        } else {
+            dispatch(raw_request);
+        }
+    }
+
+    //whatever came after the preface or the upgraded request is HTTP/2 frames
+    if (h2 && !input.empty()) {
+        std::string frames;
+        frames.swap(input);
+        h2->onReceive(frames.data(), frames.length());
+    }
+}
+
+//a client with prior knowledge opens with the HTTP/2 preface instead of a request. true while
+//the input may still be that (wait for more) or was (switched)
+bool Connection::checkPreface() {
+    if (!h2_allowed) {
+        return false;
+    }
+    size_t length = std::min<size_t>(input.length(), H2_PREFACE_LENGTH);
+    if (input.compare(0, length, H2_PREFACE, length) != 0) {
+        return false;
+    }
+    if (length == H2_PREFACE_LENGTH) {
+        std::cout << "HTTP/2: prior knowledge" << std::endl;
+        startHttp2();
+    }
+    return true;
+}
+
+//Upgrade: h2c (RFC 7540 section 3.2) on a first request without a body: 101, then HTTP/2
+//with the request as stream 1. false to answer it over HTTP/1.1 as usual
+bool Connection::upgradeToHttp2(const HttpRequest& request, const std::string& raw_request) {
+    std::string upgrade = request.getHeader("upgrade");
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+    std::string settings;
+    if (upgrade.find("h2c") == std::string::npos || request.getVersion() != "HTTP/1.1" ||
+        !request.getBody().empty() ||
+        !Http2Session::decodeSettingsHeader(request.getHeader("http2-settings"), settings)) {
+        return false;
+    }
+
+    std::cout << "HTTP/2: upgraded from HTTP/1.1" << std::endl;
+    output.push_back(OutputChunk());
+    output.back().data = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    startHttp2();
+    h2->startUpgraded(settings, raw_request);
+    return true;
+}
+
+void Connection::drain() {
+    draining = true;
+    if (h2) {
+        h2->shutdown();
+    } else if (input.empty() && upload.fd == -1) {
+        close_after_output = true;
+    }
+}
+
+void Connection::startHttp2() {
+    h2 = new Http2Session(server, output, close_after_output, output_ready);
+    h2_allowed = false;
+
+    //frames are batched in the output queue already; Nagle would hold back the small ones
+    //(a window's worth of DATA after a WINDOW_UPDATE) for the client's delayed ACK
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void Connection::popOutput() {
+    OutputChunk& chunk = output.front();
+    
+    //streamed bodies are produced one piece per drained buffer, so memory stays bounded
+    if (chunk.stream) {
+        chunk.data.clear();
+        chunk.sent = 0;
+        appendStreamPiece(chunk);
+        if (chunk.sealed) {
+            std::string plain;
+            plain.swap(chunk.data);
+            if (!tls->seal(plain.data(), plain.length(), chunk.data)) {
+                chunk.stream = nullptr;
+                close_after_output = true;
+            }
+        }
+        return;
+    }
+
+    if (chunk.file_fd != -1) {
+        ::close(chunk.file_fd);
+    }
+    output.pop_front();
+
+    //HTTP/2 frames are queued only a little ahead of the socket
+    if (h2) {
+        h2->fill();
+    }
+}
+
+//TLS without kTLS: encrypt the chunk's headers and in-memory body into records, just before
+//it goes out (records have to be sealed in the order they are sent). a file body becomes a
+//stream read TLS_SEAL_PIECE at a time, each piece sealed as the previous one drains
+void Connection::sealChunk(OutputChunk& chunk) {
+    chunk.sealed = true;
+
+    std::string plain;
+    plain.swap(chunk.data);
+    if (chunk.static_remaining > 0) {
+        plain.append(chunk.static_data, chunk.static_remaining);
+        chunk.static_data = nullptr;
+        chunk.static_remaining = 0;
+        chunk.static_owner.reset();
+    }
+
+    if (chunk.file_remaining > 0) {
+        int file_fd = chunk.file_fd;    //still closed with the chunk
+        off_t offset = chunk.file_offset;
+        size_t remaining = chunk.file_remaining;
+        chunk.file_remaining = 0;
+        chunk.stream = [this, file_fd, offset, remaining](std::string& out) mutable {
+            size_t start = out.length();
+            out.resize(start + std::min<size_t>(remaining, TLS_SEAL_PIECE));
+            ssize_t n = pread(file_fd, &out[start], out.length() - start, offset);
+            if (n <= 0) {
+                //the file shrank or failed under us, the Content-Length is now a lie
+                out.resize(start);
+                close_after_output = true;
+                return false;
+            }
+            out.resize(start + n);
+            offset += n;
+            remaining -= n;
+            return remaining > 0;
+        };
+    }
+
+    if (!tls->seal(plain.data(), plain.length(), chunk.data)) {
+        chunk.stream = nullptr;
+        close_after_output = true;
+    }
+}
+
+//run the producer for the next piece of a streamed body. chunked pieces are written
+//straight into the output buffer behind a fixed-width size line that's filled in afterwards
+//(chunk sizes may have leading zeros)
+void Connection::appendStreamPiece(OutputChunk& chunk) {
+    bool more = true;
+    size_t start = chunk.data.length();
+
+    while (more && chunk.data.length() == start) {
+        if (!chunk.chunked) {
+            more = chunk.stream(chunk.data);
+            continue;
+        }
+
+        chunk.data.append("00000000\r\n");
+        more = chunk.stream(chunk.data);
+
+        size_t length = chunk.data.length() - start - 10;
+        if (length == 0) {
+            chunk.data.resize(start);   //a zero-size chunk would end the body
+            continue;
+        }
+        for (int i = 7; i >= 0; i--) {
+            chunk.data[start + i] = "0123456789abcdef"[length & 0xF];
+            length >>= 4;
+        }
+        chunk.data.append("\r\n");
+    }
+
+    if (!more) {
+        chunk.stream = nullptr;
+        if (chunk.chunked) {
+            chunk.data.append("0\r\n\r\n");
+        }
+    }
+}
+
+//find end of headers: \r\n\r\n, or \n\n for testing with nc
+void Connection::findHeadersEnd(size_t scan_from) {
+    for (size_t i = scan_from; i < input.length(); i++) {
+        if (input[i] != '\n') {
+            continue;
+        }
+
+        if (i >= 3 && input.compare(i - 3, 3, "\r\n\r") == 0) {
+            headers_end = i - 3;
+            header_size = i + 1;
+            return;
+        }
+
+        if (i >= 1 && input[i - 1] == '\n') {
+            headers_end = i - 1;
+            header_size = i + 1;
+            return;
+        }
+    }
+}
+
+//the body length from whole header lines (lowercased): 0 without a Content-Length, -1 for
+//a malformed or repeated one. a name is matched whole at the start of its line, so
+//x-content-length doesn't count, and "content-length :" is refused rather than skipped
+static long long findContentLength(const std::string& headers) {
+    long long length = 0;
+    bool found = false;
+
+    size_t line_start = headers.find('\n');     //past the request line
+    while (line_start != std::string::npos) {
+        line_start++;
+        size_t line_end = headers.find('\n', line_start);
+        size_t end = line_end == std::string::npos ? headers.length() : line_end;
+        if (end > line_start && headers[end - 1] == '\r') {
+            end--;
+        }
+
+        size_t colon = headers.find(':', line_start);
+        if (colon != std::string::npos && colon < end) {
+            size_t name_end = colon;
+            while (name_end > line_start && (headers[name_end - 1] == ' ' || headers[name_end - 1] == '\t')) {
+                name_end--;
+            }
+            if (headers.compare(line_start, name_end - line_start, "content-length") == 0) {
+                if (found || name_end != colon) {
+                    return -1;
+                }
+                found = true;
+
+                size_t value = headers.find_first_not_of(" \t", colon + 1);
+                size_t value_end = end;
+                while (value_end > colon + 1 && (headers[value_end - 1] == ' ' || headers[value_end - 1] == '\t')) {
+                    value_end--;
+                }
+                //18 digits always fit in a long long
+                if (value == std::string::npos || value >= value_end || value_end - value > 18) {
+                    return -1;
+                }
+                for (size_t i = value; i < value_end; i++) {
+                    if (headers[i] < '0' || headers[i] > '9') {
+                        return -1;
+                    }
+                    length = length * 10 + (headers[i] - '0');
+                }
+            }
+        }
+        line_start = line_end;
+    }
+    return length;
+}
+
+//pull one complete request (headers + Content-Length body) off the input buffer.
+//a PUT comes off as soon as its headers are in (streamed_body), the body goes to a file
+bool Connection::extractRequest(std::string& raw_request, bool& streamed_body) {
+    if (headers_end == std::string::npos) {
+        if (input.length() > server.getConfig().max_header_size) {
+            queueError(400, "<html><body><h1>400 Bad Request</h1>"
+                            "<p>Request headers too large.</p></body></html>");
+        }
+        return false;
+    }
+
+    //parse Content-Length once per request
+    if (content_length == -1) {
+        std::string headers = input.substr(0, headers_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+        content_length = findContentLength(headers);
+        if (content_length < 0) {
+            queueError(400, "<html><body><h1>400 Bad Request</h1>"
+                            "<p>Invalid Content-Length.</p></body></html>");
+            return false;
+        }
+
+        //vet the request on its headers before taking any of the body
+        expect_continue = false;
+        bool has_body = content_length > 0 || headers.find("\nexpect:") != std::string::npos;
+        if ((has_body || input.compare(0, 4, "PUT ") == 0) && !admitBody()) {
+            return false;
+        }
+    }
+
+    streamed_body = input.compare(0, 4, "PUT ") == 0;
+    if (streamed_body) {
+        raw_request = input.substr(0, header_size);
+        input.erase(0, header_size);
+        upload_remaining = content_length;
+
+        //what's left in the input starts with the body, startUpload() takes it from there
+        headers_end = std::string::npos;
+        content_length = -1;
+        return true;
+    }
+
+    size_t total_size = header_size + content_length;
+    if (input.length() < total_size) {
+        return false;
+    }
+
+    raw_request = input.substr(0, total_size);
+    input.erase(0, total_size);
+
+    //reset framing state, the rest of the input may already hold the next request
+    headers_end = std::string::npos;
+    content_length = -1;
+    findHeadersEnd(0);
+
+    return true;
+}
+
+void Connection::dispatch(const std::string& raw_request) {
+    //show request info
+    size_t first_line_end = raw_request.find('\n');
+    std::string request_line = raw_request.substr(0, first_line_end);
+    std::cout << "\n " << request_line;
+    std::cout << "   Total size: " << raw_request.length() << " bytes" << std::endl;
+
+    HttpRequest request;
+    if (!request.parse(raw_request)) {
+        std::cerr << "Failed to parse HTTP request" << std::endl;
+        queueError(400, "<html><body><h1>400 Bad Request</h1></body></html>");
+        return;
+    }
+
+    std::cout << "[" << request.getMethod() << " " << request.getPath() << "]" << std::endl;
+
+    if (h2_allowed && !request.getHeader("upgrade").empty() && upgradeToHttp2(request, raw_request)) {
+        return;
+    }
+    h2_allowed = false;
+
+    //create HTTP response and let server handle it
+    HttpResponse response;
+    prepareResponse(request, response);
+    server.handleRequest(request, response);
+    queueResponse(request, response);
+}
+
+//headers are in, the body is upload_remaining bytes, part of which may already be in input
+void Connection::startUpload(const std::string& raw_headers) {
+    std::cout << "\n " << raw_headers.substr(0, raw_headers.find('\n'));
+    std::cout << "   Body: " << upload_remaining << " bytes to file" << std::endl;
+    h2_allowed = false;
+
+    upload_request = HttpRequest();
+    if (!upload_request.parse(raw_headers)) {
+        std::cerr << "Failed to parse HTTP request" << std::endl;
+        queueError(400, "<html><body><h1>400 Bad Request</h1></body></html>");
+        return;
+    }
+
+    HttpResponse response;
+    prepareResponse(upload_request, response);
+
+    if (!server.beginPut(upload_request, upload_remaining, upload, response)) {
+        //the body is never read, so the connection can't carry another request
+        response.setHeader("Connection", "close");
+        close_after_output = true;
+        queueResponse(upload_request, response);
+        return;
+    }
+
+    upload_offset = 0;
+
+    //the destination is ready, let a waiting client start sending
+    if (expect_continue && input.length() < upload_remaining) {
+        queueContinue();
+    }
+
+    size_t body = std::min<uint64_t>(input.length(), upload_remaining);
+    std::string buffered = input.substr(0, body);
+    input.erase(0, body);
+    if (upload_remaining == 0) {
+        finishUpload();
+    } else {
+        writeUpload(buffered.data(), buffered.length());
+    }
+}
+
+bool Connection::writeUpload(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = pwrite(upload.fd, data, len, upload_offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            onUploadFailed();
+            return false;
+        }
+        data += n;
+        len -= n;
+        onUploadWritten(n);
+    }
+    return true;
+}
+
+void Connection::onUploadWritten(size_t len) {
+    upload_offset += len;
+    upload_remaining -= len;
+
+    if (upload_remaining == 0) {
+        finishUpload();
+    }
+}
+
+void Connection::onUploadFailed() {
+    std::cerr << "ERROR: Failed to write upload body: " << strerror(errno) << std::endl;
+    server.abortPut(upload);
+    queueError(500, "<html><body><h1>500 Internal Server Error</h1>"
+                    "<p>Failed to store the upload.</p></body></html>");
+}
+
+void Connection::finishUpload() {
+    HttpResponse response;
+    prepareResponse(upload_request, response);
+    server.finishPut(upload, response);
+    queueResponse(upload_request, response);
+
+    //anything after the body is the next request (processInput() picks it up)
+    findHeadersEnd(0);
+}
+
+//let the server turn the request away before its body is read, and answer Expect: 100-continue.
+//a refused request closes the connection: whatever body is on its way is never read
+bool Connection::admitBody() {
+    HttpRequest request;
+    if (!request.parse(input.substr(0, header_size))) {
+        std::cerr << "Failed to parse HTTP request" << std::endl;
+        queueError(400, "<html><body><h1>400 Bad Request</h1></body></html>");
+        return false;
+    }
+
+    HttpResponse response;
+    prepareResponse(request, response);
+
+    std::string expect = request.getHeader("expect");
+    std::transform(expect.begin(), expect.end(), expect.begin(), ::tolower);
+
+    if (!expect.empty() && expect != "100-continue") {
+        response.setStatus(417);
+        response.setHeader("Content-Type", "text/html");
+        response.setBody("<html><body><h1>417 Expectation Failed</h1></body></html>");
+    } else if (server.admitRequest(request, content_length, response)) {
+        //1xx responses are HTTP/1.1 only; a PUT gets its go-ahead once its file is open
+        expect_continue = !expect.empty() && request.getVersion() == "HTTP/1.1";
+        bool body_pending = input.length() < header_size + (size_t)content_length;
+        if (expect_continue && body_pending && input.compare(0, 4, "PUT ") != 0) {
+            queueContinue();
+        }
+        return true;
+    }
+
+    std::cout << "REFUSED BEFORE BODY: " << request.getMethod() << " " << request.getPath() << std::endl;
+    response.setHeader("Connection", "close");
+    close_after_output = true;
+    queueResponse(request, response);
+    input.clear();
+    return false;
+}
+
+void Connection::queueContinue() {
+    output.push_back(OutputChunk());
+    output.back().data = "HTTP/1.1 100 Continue\r\n\r\n";
+}
+
+//common headers, and whether this connection stays open after the response
+bool Connection::prepareResponse(const HttpRequest& request, HttpResponse& response) {
+    //keep-alive is the default for HTTP/1.1 and opt-in for HTTP/1.0
+    std::string connection_header = request.getHeader("connection");
+    std::transform(connection_header.begin(), connection_header.end(),
+                   connection_header.begin(), ::tolower);
+
+    bool keep_alive = (request.getVersion() == "HTTP/1.1") ?
+                      connection_header != "close" : connection_header == "keep-alive";
+    keep_alive = keep_alive && !draining;
+    if (!keep_alive) {
+        close_after_output = true;
+    }
+
+    response.setHeader("Server", "MyHTTPServer/1.0");
+    response.setHeader("Connection", keep_alive ? "keep-alive" : "close");
+    return keep_alive;
+}
+
+void Connection::queueResponse(const HttpRequest& request, HttpResponse& response) {
+    if (response.isDeferred()) {
+        deferResponse(request, response);
+        return;
+    }
+
+    output.push_back(OutputChunk());
+    fillChunk(output.back(), response, request.getVersion() == "HTTP/1.1", request.getMethod() == "HEAD");
+}
+
+void Connection::fillChunk(OutputChunk& chunk, HttpResponse& response, bool chunked, bool head) {
+    //no chunked encoding before HTTP/1.1: a streamed body runs until the connection closes
+    if (response.hasStreamBody() && !chunked) {
+        response.removeHeader("Transfer-Encoding");
+        response.setHeader("Connection", "close");
+        close_after_output = true;
+    }
+
+    //HEAD: the GET's headers, Content-Length included, and nothing after them. any body
+    //bytes would be read as the start of the next response on this connection
+    if (head) {
+        response.releaseBody();
+        chunk.data = response.build();
+        std::cout << "SENDING: " << chunk.data.length() << " bytes (HEAD)" << std::endl;
+        return;     //the response still owns (and closes) a file body; a stream is never pulled
+    }
+
+    chunk.data = response.build();
+
+    if (response.hasFileBody()) {
+        chunk.file_remaining = response.getFileLength();
+        chunk.file_fd = response.releaseFileBody();
+    } else if (response.hasStaticBody()) {
+        chunk.static_data = response.getStaticBody();
+        chunk.static_remaining = response.getStaticLength();
+        chunk.static_owner = response.releaseStaticOwner();
+    } else if (response.hasStreamBody()) {
+        chunk.stream = response.releaseStreamBody();
+        chunk.chunked = chunked;
+        appendStreamPiece(chunk);   //the first piece goes out with the headers
+        std::cout << "STREAMING: " << chunk.data.length() << " bytes so far" << std::endl;
+        return;
+    }
+
+    std::cout << "SENDING: " << chunk.data.length() + chunk.file_remaining + chunk.static_remaining
+              << " bytes" << std::endl;
+}
+
+//hold the response's place in the output queue while its work runs on the blocking pool
+void Connection::deferResponse(const HttpRequest& request, HttpResponse& response) {
+    uint64_t id = ++last_deferred_id;
+    output.push_back(OutputChunk());
+    output.back().deferred_id = id;
+
+    std::string server_header = response.getHeader("Server");
+    std::string connection_header = response.getHeader("Connection");
+    bool chunked = request.getVersion() == "HTTP/1.1";
+    bool head = request.getMethod() == "HEAD";
+    HttpResponse::DeferredWork work = response.releaseDeferredWork();
+    HttpResponse::DeferredStart start = response.releaseDeferredStart();
+    HttpResponse::DeferredCompletion done = response.releaseDeferredCompletion();
+
+    //the completion runs on the loop thread whether or not the client is still around:
+    //it's where the server records what the work did
+    std::shared_ptr<Connection*> owner = self;
+    auto complete = [owner, id, chunked, head, server_header, connection_header, done](bool notify) {
+        HttpResponse response;
+        response.setHeader("Server", server_header);
+        response.setHeader("Connection", connection_header);
+        done(response);
+
+        Connection* conn = *owner;
+        if (conn != nullptr) {
+            conn->completeDeferred(id, response, chunked, head);
+            if (notify && conn->output_ready) {
+                auto ready = conn->output_ready;     //may close (and free) the connection
+                ready();
+            }
+        }
+    };
+
+    if (start) {
+        std::cout << "DEFERRED: response " << id << std::endl;
+        start([complete]() { complete(true); });
+        return;
+    }
+
+    std::cout << "DEFERRED: response " << id << " to the blocking pool" << std::endl;
+    if (!server.getPool().submit(work, [complete]() { complete(true); })) {
+        //pool backed up: do it here rather than queue without bound
+        work();
+        complete(false);
+    }
+}
+
+void Connection::completeDeferred(uint64_t id, HttpResponse& response, bool chunked, bool head) {
+    for (auto& chunk : output) {
+        if (chunk.deferred_id == id) {
+            chunk.deferred_id = 0;
+            fillChunk(chunk, response, chunked, head);
+            return;
+        }
+    }
+}
+
+//answer with an error page and stop reading from this client
+void Connection::queueError(int code, const std::string& message) {
+    HttpResponse response;
+    response.setStatus(code);
+    response.setHeader("Server", "MyHTTPServer/1.0");
+    response.setHeader("Connection", "close");
+    response.setHeader("Content-Type", "text/html");
+    response.setBody(message);
+
+    output.push_back(OutputChunk());
+    output.back().data = response.build();
+    close_after_output = true;
+}
@@ -0,0 +1,160 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "Server.h"
+#include "HttpRequest.h"
+#include "Tls.h"
+#include <string>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <algorithm>
+#include <sys/types.h>
+
+class Http2Session;
+
+//one queued response: in-memory bytes (headers + body) optionally followed by a file or by
+//bytes that live elsewhere in memory (an embedded asset, sent from where it is).
+//a generated (streamed) body refills data with its next piece each time it has gone out
+struct OutputChunk {
+    std::string data;
+    size_t sent;            //how much of data has gone out already
+    int file_fd;            //file body streamed after data, -1 if none
+    off_t file_offset;
+    size_t file_remaining;
+    const char* static_data;            //the part of a static body not sent yet
+    size_t static_remaining;
+    std::shared_ptr<const void> static_owner;   //what static_data lives in, if it isn't constant
+    HttpResponse::BodyStream stream;    //producer of the rest of the body, empty once done
+    bool chunked;                       //frame stream pieces with Transfer-Encoding: chunked
+    uint64_t deferred_id;               //nonzero while the response is produced off the loop
+    bool sealed;                        //TLS without kTLS: data holds records, not plaintext
+
+    OutputChunk() : sent(0), file_fd(-1), file_offset(0), file_remaining(0), static_data(nullptr),
+                    static_remaining(0), chunked(false), deferred_id(0), sealed(false) {}
+
+    //n bytes of data and then of the static body went out in one send
+    void advance(size_t n) {
+        size_t from_data = std::min(n, data.length() - sent);
+        sent += from_data;
+        static_data += n - from_data;
+        static_remaining -= n - from_data;
+    }
+};
+
+//HTTP/1.1 state for one client, independent of the I/O backend driving it.
+//backends push received bytes in with onReceive() and drain the output queue.
+//a client that opens with the HTTP/2 preface or upgrades with Upgrade: h2c is handed to an
+//Http2Session, which takes over the input and frames its responses into the same queue.
+//on a TLS listener the connection starts with the handshake; after it received bytes are
+//decrypted here, and output is either plaintext for a kTLS socket or sealed into records
+//chunk by chunk as each reaches the front of the queue
+class Connection {
+private:
+    int fd;
+    Server& server;
+
+    std::string input;              //received bytes not yet consumed by a complete request
+    size_t headers_end;             //end of the current request's headers (npos until seen)
+    size_t header_size;             //headers plus the blank line
+    long long content_length;       //-1 until the headers are parsed
+    bool expect_continue;           //client waits for 100 Continue before sending the body
+
+    std::deque<OutputChunk> output;
+    bool close_after_output;        //Connection: close, HTTP/1.0 or a framing error
+    bool draining;                  //the server is stopping: no keep-alive after this request
+
+    Http2Session* h2;               //null while this is HTTP/1.1
+    bool h2_allowed;                //no HTTP/1.1 request yet, so it may still switch
+
+    TlsSession* tls;                //null for plain HTTP
+    bool seal_output;               //TLS in userspace: chunks are encrypted before they go out
+
+    //PUT body being written to a file instead of buffered in input
+    PutUpload upload;
+    HttpRequest upload_request;     //its headers, answered once the body is in
+    uint64_t upload_remaining;
+    off_t upload_offset;
+
+    //deferred responses finish on the loop after this connection may be gone: they hold
+    //this and find it cleared
+    std::shared_ptr<Connection*> self;
+    uint64_t last_deferred_id;
+    std::function<void()> output_ready;
+
+    void receive(const char* data, size_t len);
+    void sealChunk(OutputChunk& chunk);
+    bool checkPreface();
+    bool upgradeToHttp2(const HttpRequest& request, const std::string& raw_request);
+    void startHttp2();
+    void findHeadersEnd(size_t scan_from);
+    bool extractRequest(std::string& raw_request, bool& streamed_body);
+    bool admitBody();
+    void queueContinue();
+    void processInput();
+    void dispatch(const std::string& raw_request);
+    void startUpload(const std::string& raw_headers);
+    bool writeUpload(const char* data, size_t len);
+    void finishUpload();
+    bool prepareResponse(const HttpRequest& request, HttpResponse& response);
+    void queueResponse(const HttpRequest& request, HttpResponse& response);
+    void fillChunk(OutputChunk& chunk, HttpResponse& response, bool chunked, bool head);
+    void deferResponse(const HttpRequest& request, HttpResponse& response);
+    void completeDeferred(uint64_t id, HttpResponse& response, bool chunked, bool head);
+    void queueError(int code, const std::string& message);
+    void appendStreamPiece(OutputChunk& chunk);
+
+public:
+    Connection(int fd, Server& server, TlsContext* tls_context);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    //feed bytes read from the socket; every complete request is handled and its response queued
+    void onReceive(const char* data, size_t len);
+
+    //TLS: until the handshake is done backends call continueHandshake() whenever the socket
+    //is ready for what it last asked for, and neither read nor write it themselves
+    bool isHandshaking() const { return tls != nullptr && !tls->isDone(); }
+    TlsStatus continueHandshake();
+
+    //the peer stopped sending, close once the queued responses are out
+    void onPeerClosed() { close_after_output = true; }
+
+    //the server is shutting down: finish the requests already started (HTTP/2: the open
+    //streams, after a GOAWAY) and then close; between requests, close once the output is out
+    void drain();
+
+    //while a PUT body is arriving backends may splice it from the socket into uploadFd()
+    //at uploadOffset() themselves, reporting each piece that reached the file (not over TLS,
+    //where the body arrives encrypted)
+    bool isReceivingUpload() const { return upload.fd != -1 && tls == nullptr; }
+    int uploadFd() const { return upload.fd; }
+    off_t uploadOffset() const { return upload_offset; }
+    uint64_t uploadRemaining() const { return upload_remaining; }
+    void onUploadWritten(size_t len);
+    void onUploadFailed();
+
+    bool hasOutput() const { return !output.empty(); }
+    bool hasReadyOutput() const { return !output.empty() && output.front().deferred_id == 0; }
+
+    //called when a deferred response got filled in outside of onReceive(), so the backend
+    //can start sending it
+    void setOutputReadyHandler(std::function<void()> handler) { output_ready = std::move(handler); }
+    OutputChunk& frontOutput() {
+        OutputChunk& chunk = output.front();
+        if (seal_output && !chunk.sealed && chunk.deferred_id == 0) {
+            sealChunk(chunk);
+        }
+        return chunk;
+    }
+    void popOutput();   //the front chunk is fully sent (streamed chunks refill instead of going away)
+
+    bool isClosing() const { return close_after_output; }
+    bool shouldClose() const { return close_after_output && output.empty(); }
+    int getFd() const { return fd; }
+};
+
+#endif
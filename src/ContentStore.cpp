@@ -0,0 +1,307 @@
+#include "ContentStore.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+ContentStore::ContentStore(const std::string& uploads_root)
+    : uploads_root(uploads_root), store_root(uploads_root + "/.store"), temp_counter(0) {
+}
+
+void ContentStore::open() {
+    mkdir(store_root.c_str(), 0755);
+    mkdir((store_root + "/tmp").c_str(), 0755);
+
+    size_t blobs = 0;
+    size_t removed = 0;
+
+    //half-written blobs from a crash, and blobs whose last name went away while we were down
+    DIR* top = opendir(store_root.c_str());
+    if (!top) {
+        std::cerr << "Warning: could not open " << store_root << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    struct dirent* shard;
+    while ((shard = readdir(top)) != nullptr) {
+        std::string shard_name = shard->d_name;
+        if (shard_name[0] == '.') {
+            continue;
+        }
+
+        bool is_tmp = shard_name == "tmp";
+        std::string level1 = store_root + "/" + shard_name;
+        DIR* dir1 = opendir(level1.c_str());
+        if (!dir1) {
+            continue;
+        }
+
+        struct dirent* entry1;
+        while ((entry1 = readdir(dir1)) != nullptr) {
+            std::string name1 = entry1->d_name;
+            if (name1 == "." || name1 == "..") {
+                continue;
+            }
+
+            std::string path1 = level1 + "/" + name1;
+            if (is_tmp) {
+                unlink(path1.c_str());
+                continue;
+            }
+
+            DIR* dir2 = opendir(path1.c_str());
+            if (!dir2) {
+                continue;
+            }
+
+            struct dirent* entry2;
+            while ((entry2 = readdir(dir2)) != nullptr) {
+                if (entry2->d_name[0] == '.') {
+                    continue;
+                }
+
+                std::string blob = path1 + "/" + entry2->d_name;
+                struct stat st;
+                if (stat(blob.c_str(), &st) != 0) {
+                    continue;
+                }
+                if (st.st_nlink <= 1 && unlink(blob.c_str()) == 0) {
+                    removed++;
+                } else {
+                    blobs++;
+                }
+            }
+            closedir(dir2);
+        }
+        closedir(dir1);
+    }
+    closedir(top);
+
+    std::cout << "CONTENT STORE: " << blobs << " blobs";
+    if (removed > 0) {
+        std::cout << " (" << removed << " unreferenced removed)";
+    }
+    std::cout << std::endl;
+}
+
+std::string ContentStore::blobPath(uint64_t hash, uint64_t size) const {
+    std::string hex = Hash64::toHex(hash);
+    return store_root + "/" + hex.substr(0, 2) + "/" + hex.substr(2, 2) + "/" + hex + "-" +
+           std::to_string(size);
+}
+
+bool ContentStore::makeShardDirs(uint64_t hash) {
+    std::string hex = Hash64::toHex(hash);
+    std::string level1 = store_root + "/" + hex.substr(0, 2);
+    std::string level2 = level1 + "/" + hex.substr(2, 2);
+
+    if (mkdir(level1.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    return mkdir(level2.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+//unique name for a file that gets renamed into place once complete
+std::string ContentStore::tempPath(const std::string& dir) {
+    return dir + "/.tmp-" + std::to_string(getpid()) + "-" + std::to_string(temp_counter++);
+}
+
+bool ContentStore::writeBlob(const std::string& path, const std::string& content) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < content.length()) {
+        ssize_t n = write(fd, content.data() + written, content.length() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += n;
+    }
+
+    close(fd);
+    return written == content.length();
+}
+
+//move a finished temp file to its blob path, unless another thread stored the same blob first
+//(link() fails with EEXIST where rename() would silently replace it, leaving the names that
+//already point at the first copy outside the store)
+bool ContentStore::publishBlob(const std::string& temp, const std::string& blob) {
+    if (link(temp.c_str(), blob.c_str()) != 0) {
+        return false;
+    }
+    unlink(temp.c_str());
+    return true;
+}
+
+//a 64-bit hash match is all but certain, but a byte compare is cheap next to the write it saves
+bool ContentStore::sameContent(const std::string& path, const char* data, size_t length) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[65536];
+    size_t offset = 0;
+    bool same = true;
+
+    while (same) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            same = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        same = offset + n <= length && memcmp(buffer, data + offset, n) == 0;
+        offset += n;
+    }
+
+    close(fd);
+    return same && offset == length;
+}
+
+//point path at the blob: link under a temp name, then rename over the target
+//so a reader never sees the name missing or half-written
+bool ContentStore::linkAs(const std::string& blob, const std::string& path) {
+    std::string temp = tempPath(uploads_root);
+    if (link(blob.c_str(), temp.c_str()) != 0) {
+        return false;
+    }
+
+    bool ok = rename(temp.c_str(), path.c_str()) == 0;
+
+    //rename() between two links to the same inode succeeds without removing the source
+    unlink(temp.c_str());
+    return ok;
+}
+
+bool ContentStore::save(const std::string& path, const std::string& content,
+                        const ContentDigest& digest, bool& deduplicated) {
+    std::string blob = blobPath(digest.hash, digest.size);
+    std::unique_lock<std::mutex> lock(blobLock(digest.hash));
+    deduplicated = false;
+
+    struct stat st;
+    if (stat(blob.c_str(), &st) == 0) {
+        if (sameContent(blob, content.data(), content.length())) {
+            deduplicated = true;
+            return linkAs(blob, path);
+        }
+
+        //genuine hash collision: keep this upload as a plain file outside the store
+        std::cerr << "Warning: hash collision on " << blob << ", storing " << path
+                  << " without deduplication" << std::endl;
+        std::string temp = tempPath(uploads_root);
+        if (!writeBlob(temp, content) || rename(temp.c_str(), path.c_str()) != 0) {
+            unlink(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    //the temp file is ours alone, only publishing and linking it need the lock
+    lock.unlock();
+    std::string temp = tempPath(store_root + "/tmp");
+    bool written = makeShardDirs(digest.hash) && writeBlob(temp, content);
+    lock.lock();
+
+    if (!written || !publishBlob(temp, blob)) {
+        bool raced = written && errno == EEXIST;
+        unlink(temp.c_str());
+        lock.unlock();
+        //the same bytes arrived in another upload at the same time: share its blob
+        return raced && save(path, content, digest, deduplicated);
+    }
+
+    if (!linkAs(blob, path)) {
+        unlinkIfUnreferenced(blob);
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::linkDuplicate(const std::string& path, const char* data, const ContentDigest& digest) {
+    std::string blob = blobPath(digest.hash, digest.size);
+    std::lock_guard<std::mutex> lock(blobLock(digest.hash));
+
+    struct stat st;
+    return stat(blob.c_str(), &st) == 0 && sameContent(blob, data, digest.size) && linkAs(blob, path);
+}
+
+int ContentStore::openIncoming(uint64_t length, std::string& temp) {
+    temp = tempPath(store_root + "/tmp");
+    int fd = ::open(temp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    //reserve the space up front: a full disk fails now rather than halfway through the body,
+    //and the file gets laid out in as few extents as the filesystem can manage
+    if (length > 0 && fallocate(fd, 0, 0, length) != 0 && errno != EOPNOTSUPP) {
+        int saved = errno;
+        close(fd);
+        unlink(temp.c_str());
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+bool ContentStore::adopt(const std::string& temp, const char* data, const ContentDigest& digest,
+                         const std::string& path, bool& deduplicated) {
+    std::string blob = blobPath(digest.hash, digest.size);
+    std::unique_lock<std::mutex> lock(blobLock(digest.hash));
+    deduplicated = false;
+
+    struct stat st;
+    if (stat(blob.c_str(), &st) == 0) {
+        if (sameContent(blob, data, digest.size)) {
+            deduplicated = true;
+            unlink(temp.c_str());
+            return linkAs(blob, path);
+        }
+
+        std::cerr << "Warning: hash collision on " << blob << ", storing " << path
+                  << " without deduplication" << std::endl;
+        return rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    if (!makeShardDirs(digest.hash) || !publishBlob(temp, blob)) {
+        bool raced = errno == EEXIST;
+        lock.unlock();
+        return raced && adopt(temp, data, digest, path, deduplicated);
+    }
+
+    if (!linkAs(blob, path)) {
+        unlinkIfUnreferenced(blob);
+        return false;
+    }
+    return true;
+}
+
+void ContentStore::release(uint64_t hash, uint64_t size) {
+    std::string blob = blobPath(hash, size);
+    std::lock_guard<std::mutex> lock(blobLock(hash));
+    unlinkIfUnreferenced(blob);
+}
+
+//with the blob's lock held, so no save() or adopt() links to it between the check and the unlink
+void ContentStore::unlinkIfUnreferenced(const std::string& blob) {
+    struct stat st;
+    if (stat(blob.c_str(), &st) == 0 && st.st_nlink <= 1) {
+        unlink(blob.c_str());
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include "Hash.h"
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#define CONTENT_STORE_LOCKS 64      //blob locks, striped by hash
+
+//content-addressed blob store under uploads_root/.store, sharded two levels deep by
+//hash prefix: .store/ab/cd/abcd...-<size>. each uploaded name under uploads_root is a hard
+//link to its blob, so identical uploads share one copy on disk, a duplicate upload is a
+//link() instead of a write, and the /uploads/<name> URL space works unchanged.
+//a blob is garbage once nothing but the store links to it (st_nlink == 1).
+//safe to call from several threads at once (the server's BlockingPool workers): a lock per
+//blob (striped) keeps release()'s check and unlink apart from another upload linking to it
+class ContentStore {
+private:
+    std::string uploads_root;
+    std::string store_root;
+    std::atomic<unsigned> temp_counter;
+    std::mutex blob_locks[CONTENT_STORE_LOCKS];
+
+    std::mutex& blobLock(uint64_t hash) { return blob_locks[hash % CONTENT_STORE_LOCKS]; }
+    void unlinkIfUnreferenced(const std::string& blob);
+    bool makeShardDirs(uint64_t hash);
+    bool writeBlob(const std::string& path, const std::string& content);
+    bool publishBlob(const std::string& temp, const std::string& blob);
+    bool sameContent(const std::string& path, const char* data, size_t length);
+    bool linkAs(const std::string& blob, const std::string& path);
+    std::string tempPath(const std::string& dir);
+
+public:
+    ContentStore(const std::string& uploads_root);
+
+    //create the store and drop blobs left unreferenced while we were down
+    void open();
+
+    std::string blobPath(uint64_t hash, uint64_t size) const;
+
+    //store content once and make path (somewhere under uploads_root) point at it, replacing
+    //any old file. deduplicated is set when the bytes were already stored and nothing was written
+    bool save(const std::string& path, const std::string& content, const ContentDigest& digest,
+              bool& deduplicated);
+
+    //path as another name for an already stored copy of these bytes (the duplicate check of
+    //save()); false when there is none and they have to be written
+    bool linkDuplicate(const std::string& path, const char* data, const ContentDigest& digest);
+
+    //a file under the store's tmp dir for a body that arrives in pieces (PUT), with length bytes
+    //preallocated. returns the fd (read/write) or -1 with errno set, e.g. ENOSPC
+    int openIncoming(uint64_t length, std::string& temp);
+
+    //move a completed openIncoming() file into the store and make path point at it, like save().
+    //data is the file's contents (mapped by the caller) for the duplicate check
+    bool adopt(const std::string& temp, const char* data, const ContentDigest& digest,
+               const std::string& path, bool& deduplicated);
+
+    //a name pointing at this blob went away, delete the blob if it was the last one
+    void release(uint64_t hash, uint64_t size);
+};
+
+#endif
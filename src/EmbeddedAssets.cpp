@@ -0,0 +1,32 @@
+#include "EmbeddedAssets.h"
+#include <algorithm>
+
+//defined by the generated assets.cpp: the index sorted by path, and the packed bytes
+extern const EmbeddedAsset embedded_assets[];
+extern const size_t embedded_asset_count;
+extern "C" const char embedded_asset_data[];
+
+const EmbeddedAsset* EmbeddedAssets::find(std::string_view path) {
+    const EmbeddedAsset* end = embedded_assets + embedded_asset_count;
+    const EmbeddedAsset* found = std::lower_bound(embedded_assets, end, path,
+        [](const EmbeddedAsset& asset, std::string_view key) {
+            return std::string_view(asset.path) < key;
+        });
+    return found != end && found->path == path ? found : nullptr;
+}
+
+const char* EmbeddedAssets::data() {
+    return embedded_asset_data;
+}
+
+size_t EmbeddedAssets::count() {
+    return embedded_asset_count;
+}
+
+size_t EmbeddedAssets::totalBytes() {
+    size_t total = 0;
+    for (size_t i = 0; i < embedded_asset_count; i++) {
+        total += embedded_assets[i].length;
+    }
+    return total;
+}
@@ -0,0 +1,31 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <cstddef>
+#include <string_view>
+
+//one file of www/ packed into the binary at build time (tools/pack_assets.cpp). the index
+//and the bytes are constant data in the executable's read-only segment
+struct EmbeddedAsset {
+    const char* path;           //URL path, e.g. "/index.html"
+    const char* mime;           //Content-Type
+    const char* etag;           //quoted, from the XXH64 of the contents
+    const char* gzip_etag;      //the same for the gzip variant
+    size_t offset;              //where the contents are in EmbeddedAssets::data()
+    size_t length;
+    size_t gzip_offset;         //precompressed variant, gzip_length is 0 when it didn't pay off
+    size_t gzip_length;
+};
+
+//the assets the build packed from www/ (the generated obj/<build>/assets/assets.cpp)
+class EmbeddedAssets {
+public:
+    //the asset at URL path, or null
+    static const EmbeddedAsset* find(std::string_view path);
+
+    static const char* data();
+    static size_t count();
+    static size_t totalBytes();     //contents, not counting the gzip variants
+};
+
+#endif
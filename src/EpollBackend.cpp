@@ -0,0 +1,383 @@
+#include "EpollBackend.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+#define MAX_EVENTS 256
+#define PIPE_SIZE (256 * 1024)
+
+EpollBackend::Client::Client(int fd, Server& server, TlsContext* tls)
+    : conn(fd, server, tls), events(0), lingering(false) {
+    pipe_fds[0] = -1;
+    pipe_fds[1] = -1;
+}
+
+EpollBackend::Client::~Client() {
+    if (pipe_fds[0] != -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+}
+
+EpollBackend::EpollBackend(Server& server)
+    : IoBackend(server), epoll_fd(-1), listen_fd(-1), listener(nullptr), recv_buffer(buffer_size) {
+}
+
+EpollBackend::~EpollBackend() {
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+    }
+}
+
+bool EpollBackend::init(Socket& socket) {
+    listener = &socket;
+    listen_fd = socket.getFd();
+
+    //the accept loop drains the queue until EAGAIN, so the listener must not block
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        std::cerr << "ERROR: Failed to make listening socket nonblocking" << std::endl;
+        return false;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        std::cerr << "ERROR: Failed to create epoll instance" << std::endl;
+        return false;
+    }
+
+    //listener is registered with a null pointer, the blocking pool's eventfd with this,
+    //clients with their Client*
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        std::cerr << "ERROR: Failed to register listening socket with epoll" << std::endl;
+        return false;
+    }
+
+    ev.data.ptr = this;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server.getPool().eventFd(), &ev) < 0) {
+        std::cerr << "ERROR: Failed to register the blocking pool with epoll" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void EpollBackend::run() {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!shouldStop()) {
+        checkReload();      //a SIGHUP interrupts the wait, and we're straight back here
+        int count = epoll_pwait(epoll_fd, events, MAX_EVENTS, waitTimeoutMs(), &wait_mask);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR: epoll_wait failed" << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == this) {
+                server.getPool().runCompletions();
+                continue;
+            }
+
+            Client* client = static_cast<Client*>(events[i].data.ptr);
+
+            if (client == nullptr) {
+                acceptConnections();
+                continue;
+            }
+
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                closeClient(client);
+            } else if (client->conn.isHandshaking() && !client->lingering) {
+                handshake(client);
+            } else if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                readFrom(client);
+            } else if (events[i].events & EPOLLOUT) {
+                if (!flush(client) || client->conn.shouldClose()) {
+                    closeClient(client);
+                }
+            }
+        }
+    }
+}
+
+//drain the whole accept queue per wakeup
+void EpollBackend::acceptConnections() {
+    while (true) {
+        int client_fd = listener->accept();
+
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "ERROR: Failed to accept connection" << std::endl;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        Client* client = new Client(client_fd, server, listener->getTls());
+        client->events = EPOLLIN | EPOLLRDHUP;
+        clients.insert(client);
+
+        //a response finished on the blocking pool. closing is left to the EPOLLOUT it then
+        //waits for: other events in this batch may still point at the client
+        client->conn.setOutputReadyHandler([this, client]() {
+            if (!flush(client) || client->conn.shouldClose()) {
+                updateInterest(client, true);
+            }
+        });
+
+        struct epoll_event ev;
+        ev.events = client->events;
+        ev.data.ptr = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            std::cerr << "ERROR: Failed to register client with epoll" << std::endl;
+            closeClient(client);
+        }
+    }
+}
+
+//TLS: the handshake reads and writes the socket itself, we only wait for what it asks for
+void EpollBackend::handshake(Client* client) {
+    TlsStatus status = client->conn.continueHandshake();
+
+    if (status == TLS_FAILED) {
+        closeClient(client);
+    } else if (status == TLS_DONE) {
+        //a request that came in with the handshake may already be answered
+        if (!flush(client) || client->conn.shouldClose()) {
+            closeClient(client);
+        }
+    } else {
+        updateInterest(client, status == TLS_WANT_WRITE);
+    }
+}
+
+void EpollBackend::readFrom(Client* client) {
+    char* buffer = recv_buffer.data();
+
+    if (client->lingering) {
+        ssize_t n;
+        while ((n = recv(client->conn.getFd(), buffer, buffer_size, 0)) > 0) {
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            closeClient(client);
+        }
+        return;
+    }
+
+    while (true) {
+        //an upload body never comes up into buffer, only its headers do
+        bool splicing = client->conn.isReceivingUpload() && !client->conn.isClosing();
+        ssize_t bytes_received = splicing ? spliceUpload(client) :
+                                 recv(client->conn.getFd(), buffer, buffer_size, 0);
+
+        if (bytes_received > 0) {
+            if (!splicing) {
+                client->conn.onReceive(buffer, bytes_received);
+            }
+            continue;
+        }
+
+        if (bytes_received == 0) {
+            client->conn.onPeerClosed();
+            break;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+
+        std::cerr << "ERROR: Failed to receive data" << std::endl;
+        closeClient(client);
+        return;
+    }
+
+    if (!flush(client) || client->conn.shouldClose()) {
+        closeClient(client);
+    }
+}
+
+//move the next piece of an upload body from the socket into its file through a pipe.
+//returns like recv(): bytes moved, 0 when the peer closed, -1 with errno set
+ssize_t EpollBackend::spliceUpload(Client* client) {
+    Connection& conn = client->conn;
+
+    if (client->pipe_fds[0] == -1) {
+        if (pipe2(client->pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+            return -1;
+        }
+        fcntl(client->pipe_fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+    }
+
+    ssize_t n = splice(conn.getFd(), nullptr, client->pipe_fds[1], nullptr,
+                       std::min<uint64_t>(conn.uploadRemaining(), PIPE_SIZE),
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n <= 0) {
+        return n;
+    }
+
+    //the pipe is drained before returning, so it never holds more than this one piece
+    size_t pending = n;
+    while (pending > 0) {
+        loff_t offset = conn.uploadOffset();
+        ssize_t moved = splice(client->pipe_fds[0], nullptr, conn.uploadFd(), &offset, pending,
+                               SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            //the file side failed, not the socket: answer with an error and drop the rest
+            conn.onUploadFailed();
+            //recv_buffer is free: nothing was received into it on this round
+            while (pending > 0 && (moved = read(client->pipe_fds[0], recv_buffer.data(),
+                                                std::min(pending, buffer_size))) > 0) {
+                pending -= moved;
+            }
+            break;
+        }
+        pending -= moved;
+        conn.onUploadWritten(moved);
+    }
+
+    return n;
+}
+
+//write as much queued output as the socket takes without blocking
+bool EpollBackend::flush(Client* client) {
+    Connection& conn = client->conn;
+    int fd = conn.getFd();
+
+    while (conn.hasReadyOutput()) {
+        OutputChunk& chunk = conn.frontOutput();
+
+        //MSG_MORE keeps the headers from going out as their own segment ahead of the file,
+        //otherwise Nagle holds the file back until the client's delayed ACK (~40ms)
+        int send_flags = MSG_NOSIGNAL | (chunk.file_remaining > 0 ? MSG_MORE : 0);
+
+        //the headers and a static body go out together, gathered straight from where they are
+        while (chunk.sent < chunk.data.length() || chunk.static_remaining > 0) {
+            struct iovec iov[2];
+            int count = 0;
+            if (chunk.sent < chunk.data.length()) {
+                iov[count].iov_base = const_cast<char*>(chunk.data.data() + chunk.sent);
+                iov[count++].iov_len = chunk.data.length() - chunk.sent;
+            }
+            if (chunk.static_remaining > 0) {
+                iov[count].iov_base = const_cast<char*>(chunk.static_data);
+                iov[count++].iov_len = chunk.static_remaining;
+            }
+            
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            
+            ssize_t n = sendmsg(fd, &msg, send_flags);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    updateInterest(client, true);
+                    return true;
+                }
+                return false;
+            }
+            chunk.advance(n);
+        }
+
+        //file bodies go kernel to kernel
+        while (chunk.file_remaining > 0) {
+            ssize_t n = sendfile(fd, chunk.file_fd, &chunk.file_offset, chunk.file_remaining);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    updateInterest(client, true);
+                    return true;
+                }
+                return false;
+            }
+            if (n == 0) {
+                return false;   //file shrank underneath us, the Content-Length is now a lie
+            }
+            chunk.file_remaining -= n;
+        }
+
+        conn.popOutput();
+    }
+
+    updateInterest(client, false);
+    return true;
+}
+
+void EpollBackend::updateInterest(Client* client, bool want_output) {
+    //once the connection is closing there is nothing more to read, only output to drain
+    uint32_t events = client->conn.isClosing() ? 0 : (EPOLLIN | EPOLLRDHUP);
+    if (want_output) {
+        events |= EPOLLOUT;
+    }
+
+    if (client->events == events) {
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->conn.getFd(), &ev);
+    client->events = events;
+}
+
+void EpollBackend::closeClient(Client* client) {
+    //draining: send our FIN and wait for the peer's, discarding what it still sends. closing
+    //with input unread would reset the connection, and a reset throws away the end of a
+    //response the client hasn't read yet (HTTP/2 clients keep sending WINDOW_UPDATEs)
+    if (draining && !client->lingering) {
+        client->lingering = true;
+        shutdown(client->conn.getFd(), SHUT_WR);
+        struct epoll_event ev;
+        ev.events = client->events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->conn.getFd(), &ev) == 0) {
+            return;
+        }
+    }
+
+    //closing the fd also removes it from the epoll set
+    clients.erase(client);
+    delete client;
+}
+
+void EpollBackend::beginDrain() {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+    listener->close();
+
+    std::vector<Client*> open(clients.begin(), clients.end());
+    for (Client* client : open) {
+        client->conn.drain();
+        if (!flush(client) || client->conn.shouldClose()) {
+            closeClient(client);
+        }
+    }
+}
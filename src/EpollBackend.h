@@ -0,0 +1,51 @@
+#ifndef EPOLL_BACKEND_H
+#define EPOLL_BACKEND_H
+
+#include "IoBackend.h"
+#include "Connection.h"
+#include <cstdint>
+#include <vector>
+#include <unordered_set>
+
+//level-triggered epoll loop with nonblocking sockets; file bodies go out with sendfile(),
+//PUT bodies come in with splice() socket -> pipe -> file
+class EpollBackend : public IoBackend {
+private:
+    struct Client {
+        Connection conn;
+        uint32_t events;    //currently registered epoll interest
+        int pipe_fds[2];    //created the first time an upload body is spliced
+        bool lingering;     //draining: half-closed, waiting for the peer to close its side
+
+        Client(int fd, Server& server, TlsContext* tls);
+        ~Client();
+    };
+
+    int epoll_fd;
+    int listen_fd;
+    Socket* listener;       //its TLS context is looked up per connection, a reload replaces it
+    std::vector<char> recv_buffer;
+    std::unordered_set<Client*> clients;
+
+    void acceptConnections();
+    void handshake(Client* client);
+    void readFrom(Client* client);
+    ssize_t spliceUpload(Client* client);
+    bool flush(Client* client);     //false if the socket failed
+    void updateInterest(Client* client, bool want_output);
+    void closeClient(Client* client);
+
+protected:
+    void beginDrain();
+    size_t connectionCount() const { return clients.size(); }
+
+public:
+    EpollBackend(Server& server);
+    ~EpollBackend();
+
+    const char* getName() const { return "epoll"; }
+    bool init(Socket& listener);
+    void run();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "FileCache.h"
+#include <sys/mman.h>
+
+FileMapping::~FileMapping() {
+    munmap(const_cast<char*>(bytes), size);
+}
+
+FileCache::FileCache(size_t budget_bytes) : budget(budget_bytes), mapped(0), hits(0), misses(0) {
+}
+
+std::shared_ptr<const FileMapping> FileCache::get(int fd, const struct stat& st) {
+    Key key{st.st_dev, st.st_ino};
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        Entry& entry = found->second;
+        if (entry.size == st.st_size && entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+            entry.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            lru.splice(lru.begin(), lru, entry.lru);
+            hits++;
+            return entry.mapping;
+        }
+        erase(found);   //changed in place since it was mapped
+    }
+
+    size_t size = st.st_size;
+    if (size == 0 || size > FILE_CACHE_MAX_FILE || size > budget) {
+        return nullptr;
+    }
+
+    void* bytes = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (bytes == MAP_FAILED) {
+        return nullptr;
+    }
+    //read ahead now so the first send doesn't fault page by page
+    madvise(bytes, size, MADV_WILLNEED);
+    misses++;
+
+    while (mapped + size > budget && !lru.empty()) {
+        erase(entries.find(lru.back()));
+    }
+
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.mapping = std::make_shared<const FileMapping>(static_cast<const char*>(bytes), size);
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtim;
+    entry.lru = lru.begin();
+    mapped += size;
+    return entry.mapping;
+}
+
+//responses still sending from the mapping keep it; it goes when the last of them is done
+void FileCache::erase(std::unordered_map<Key, Entry, KeyHash>::iterator entry) {
+    mapped -= entry->second.mapping->length();
+    lru.erase(entry->second.lru);
+    entries.erase(entry);
+}
+
+void FileCache::forget(dev_t dev, ino_t ino) {
+    auto found = entries.find(Key{dev, ino});
+    if (found != entries.end()) {
+        erase(found);
+    }
+}
+
+void FileCache::clear() {
+    entries.clear();
+    lru.clear();
+    mapped = 0;
+}
+
+void FileCache::setBudget(size_t budget_bytes) {
+    budget = budget_bytes;
+    while (mapped > budget && !lru.empty()) {
+        erase(entries.find(lru.back()));
+    }
+}
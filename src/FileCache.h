@@ -0,0 +1,85 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <memory>
+#include <unordered_map>
+#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define FILE_CACHE_MAX_FILE (1024 * 1024)      //bigger files go out with sendfile/splice
+#define FILE_CACHE_BUDGET_MB 256               //default address space the cache may keep mapped
+
+//a read-only mapping of a whole file, unmapped once the cache and every response still
+//sending from it have let go (the cache hands out shared_ptrs)
+class FileMapping {
+private:
+    const char* bytes;
+    size_t size;
+
+public:
+    FileMapping(const char* bytes, size_t size) : bytes(bytes), size(size) {}
+    ~FileMapping();
+
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t length() const { return size; }
+};
+
+//small and medium files (/uploads/ and --www) kept mapped between requests, so a hit is a
+//send straight from the page cache: no per-request mmap or splice through a pipe. entries
+//are found by inode and dropped when the file's size or mtime changed; least recently used
+//ones are evicted to stay within the budget of mapped bytes. loop thread only
+class FileCache {
+private:
+    struct Key {
+        dev_t dev;
+        ino_t ino;
+
+        bool operator==(const Key& other) const { return dev == other.dev && ino == other.ino; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return std::hash<uint64_t>()(key.ino ^ ((uint64_t)key.dev << 40)); }
+    };
+    struct Entry {
+        std::shared_ptr<const FileMapping> mapping;
+        off_t size;
+        struct timespec mtime;
+        std::list<Key>::iterator lru;
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::list<Key> lru;             //most recently used first
+    size_t budget;                  //bytes
+    size_t mapped;                  //bytes the cache itself holds mapped
+    uint64_t hits;
+    uint64_t misses;
+
+    void erase(std::unordered_map<Key, Entry, KeyHash>::iterator entry);
+
+public:
+    FileCache(size_t budget_bytes);
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    //the mapping of open file fd (st from its fstat), mapping and caching it on a miss. null
+    //when it isn't cached: empty, over FILE_CACHE_MAX_FILE or the budget, or mmap failed
+    std::shared_ptr<const FileMapping> get(int fd, const struct stat& st);
+
+    //a file that was deleted: don't keep its blocks alive until it ages out
+    void forget(dev_t dev, ino_t ino);
+    void clear();
+    //a new budget (config reload), evicting down to it
+    void setBudget(size_t budget_bytes);
+
+    size_t mappedBytes() const { return mapped; }
+    uint64_t hitCount() const { return hits; }
+    uint64_t missCount() const { return misses; }
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "Handoff.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+Handoff::Handoff(const std::string& path)
+    : path(path), control_fd(-1), predecessor_fd(-1), listener_fd(-1), wake_fd(-1), handed_over(false) {
+}
+
+Handoff::~Handoff() {
+    stop();
+    if (predecessor_fd != -1) {
+        close(predecessor_fd);
+    }
+}
+
+static bool makeAddress(const std::string& path, struct sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.length() >= sizeof(addr.sun_path)) {
+        std::cerr << "ERROR: Invalid upgrade socket path " << path << std::endl;
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.length());
+    return true;
+}
+
+//a listening socket only ever goes to (or comes from) a process of the same user
+static bool sameUser(int fd) {
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0 && cred.uid == getuid();
+}
+
+int Handoff::takeOver() {
+    struct sockaddr_un addr;
+    if (!makeAddress(path, addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);      //nothing running there (or a stale path): start from scratch
+        return -1;
+    }
+
+    struct timeval timeout = {HANDOFF_TIMEOUT_MS / 1000, (HANDOFF_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    pid_t pid = 0;
+    struct iovec iov = {&pid, sizeof(pid)};
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* cmsg = n == sizeof(pid) ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        !sameUser(fd)) {
+        std::cerr << "Warning: the server at " << path << " didn't hand over its listener, starting anew"
+                  << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    int listener;
+    memcpy(&listener, CMSG_DATA(cmsg), sizeof(listener));
+    predecessor_fd = fd;
+    std::cout << "Took over the listening socket of pid " << pid << std::endl;
+    return listener;
+}
+
+bool Handoff::serve(int listener) {
+    struct sockaddr_un addr;
+    if (!makeAddress(path, addr)) {
+        return false;
+    }
+    listener_fd = listener;
+
+    control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (control_fd < 0) {
+        return false;
+    }
+
+    //a stale path, or our predecessor's: it keeps its (now nameless) socket until it's done
+    unlink(path.c_str());
+    mode_t mask = umask(077);
+    int bound = bind(control_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(control_fd, 1) < 0) {
+        std::cerr << "ERROR: Failed to listen on upgrade socket " << path << ": " << strerror(errno) << std::endl;
+        close(control_fd);
+        control_fd = -1;
+        return false;
+    }
+
+    if (predecessor_fd != -1) {
+        char ready = 1;
+        ssize_t ignored = write(predecessor_fd, &ready, 1);
+        (void)ignored;
+        close(predecessor_fd);
+        predecessor_fd = -1;
+    }
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    waiter = std::thread(&Handoff::waitForSuccessor, this);
+    std::cout << "Upgrade socket: " << path << std::endl;
+    return true;
+}
+
+//waiter thread: hand the listener to whoever connects, until one of them is up
+void Handoff::waitForSuccessor() {
+    while (true) {
+        struct pollfd fds[2] = {{control_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+
+        int conn = accept4(control_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            continue;
+        }
+        bool done = handOver(conn);
+        close(conn);
+
+        if (done) {
+            handed_over = true;
+            std::cout << "\nListener handed over to the new server" << std::endl;
+            //drain like on SIGTERM; the loop thread gets it (every other thread blocks it)
+            kill(getpid(), SIGTERM);
+            return;
+        }
+    }
+}
+
+bool Handoff::handOver(int conn) {
+    if (!sameUser(conn)) {
+        std::cerr << "Warning: refused an upgrade from another user" << std::endl;
+        return false;
+    }
+
+    pid_t pid = getpid();
+    struct iovec iov = {&pid, sizeof(pid)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listener_fd, sizeof(int));
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(pid)) {
+        return false;
+    }
+
+    //the new server is loading (catalog, templates) and accepting alongside us already;
+    //it writes a byte once it's serving, or hangs up if it failed
+    struct pollfd fds[2] = {{conn, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    while (poll(fds, 2, -1) < 0 && errno == EINTR) {
+    }
+    if (fds[1].revents) {
+        return false;
+    }
+
+    char ready;
+    if (read(conn, &ready, 1) != 1) {
+        std::cerr << "Warning: the new server exited before it was ready, still serving" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Handoff::stop() {
+    if (waiter.joinable()) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+        waiter.join();
+    }
+    if (wake_fd != -1) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    if (control_fd != -1) {
+        close(control_fd);
+        control_fd = -1;
+        if (!handed_over) {
+            unlink(path.c_str());
+        }
+    }
+}
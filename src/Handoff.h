@@ -0,0 +1,52 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#define HANDOFF_TIMEOUT_MS 5000     //how long a new server waits for the running one to answer
+
+//zero-downtime upgrades. a server with an upgrade socket listens on it (a Unix socket, this
+//user only) for its successor: a new server started with the same path connects at startup
+//and is sent the listening socket with SCM_RIGHTS, so both accept from the same queue and
+//no connection is refused while it starts. once the successor is serving it says so, and
+//the old server drains as on SIGTERM while the new one takes every new connection.
+//
+//protocol: old -> new  pid_t, with the listener fd attached
+//          new -> old  one byte, "ready" (the new server owns the socket path by then)
+//closing the connection instead means the new server gave up; the old one carries on
+class Handoff {
+private:
+    std::string path;
+    int control_fd;         //our Unix listener, waiting for a successor (-1 until serve())
+    int predecessor_fd;     //takeOver()'s connection, told "ready" by serve()
+    int listener_fd;        //what gets handed over
+    int wake_fd;            //eventfd that stops the waiter thread
+    std::thread waiter;
+    std::atomic<bool> handed_over;
+
+    void waitForSuccessor();
+    bool handOver(int conn);
+
+public:
+    Handoff(const std::string& path);
+    ~Handoff();
+
+    Handoff(const Handoff&) = delete;
+    Handoff& operator=(const Handoff&) = delete;
+
+    //startup: the listening socket of a server running at path, or -1 when there is none
+    //(or it didn't answer) and this one should create its own
+    int takeOver();
+
+    //once listener is being served: take over the socket path, tell the server we took
+    //over from (if any) to drain, and wait for a successor of our own on a thread
+    bool serve(int listener);
+
+    //stop offering the listener (draining), joins the thread. the socket path is removed
+    //unless a successor owns it now
+    void stop();
+};
+
+#endif
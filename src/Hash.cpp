@@ -0,0 +1,303 @@
+#include "Hash.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+
+static const uint64_t PRIME1 = 11400714785074694791ULL;
+static const uint64_t PRIME2 = 14029467366897019727ULL;
+static const uint64_t PRIME3 = 1609587929392839161ULL;
+static const uint64_t PRIME4 = 9650029242287828579ULL;
+static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+//unaligned little-endian loads (memcpy compiles to a plain mov)
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= round64(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+Hash64::Hash64(uint64_t seed) : seed(seed) {
+    reset();
+}
+
+void Hash64::reset() {
+    state[0] = seed + PRIME1 + PRIME2;
+    state[1] = seed + PRIME2;
+    state[2] = seed;
+    state[3] = seed - PRIME1;
+    total_len = 0;
+    pending_len = 0;
+}
+
+void Hash64::update(const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + len;
+    total_len += len;
+
+    //top up a partial stripe first
+    if (pending_len > 0) {
+        size_t fill = 32 - pending_len;
+        if (len < fill) {
+            memcpy(pending + pending_len, p, len);
+            pending_len += len;
+            return;
+        }
+        memcpy(pending + pending_len, p, fill);
+        p += fill;
+        for (int i = 0; i < 4; i++) {
+            state[i] = round64(state[i], read64(pending + i * 8));
+        }
+        pending_len = 0;
+    }
+
+    //whole stripes straight from the input
+    uint64_t v1 = state[0], v2 = state[1], v3 = state[2], v4 = state[3];
+    while (end - p >= 32) {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+        p += 32;
+    }
+    state[0] = v1; state[1] = v2; state[2] = v3; state[3] = v4;
+
+    if (p < end) {
+        pending_len = end - p;
+        memcpy(pending, p, pending_len);
+    }
+}
+
+uint64_t Hash64::digest() const {
+    uint64_t h;
+
+    if (total_len >= 32) {
+        h = rotl(state[0], 1) + rotl(state[1], 7) + rotl(state[2], 12) + rotl(state[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = mergeRound(h, state[i]);
+        }
+    } else {
+        h = seed + PRIME5;
+    }
+    h += total_len;
+
+    const unsigned char* p = pending;
+    const unsigned char* end = pending + pending_len;
+    while (end - p >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        p++;
+    }
+
+    //avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t Hash64::of(const void* data, size_t len) {
+    Hash64 hasher;
+    hasher.update(data, len);
+    return hasher.digest();
+}
+
+std::string Hash64::toHex(uint64_t hash) {
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = "0123456789abcdef"[hash & 0xF];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+Sha256::Sha256() : total_len(0), block_len(0) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, initial, sizeof(state));
+}
+
+void Sha256::compress(const unsigned char* data) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+               (uint32_t)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+        uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void Sha256::update(const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_len += len;
+
+    if (block_len > 0) {
+        size_t fill = std::min(len, 64 - block_len);
+        memcpy(block + block_len, p, fill);
+        block_len += fill;
+        p += fill;
+        len -= fill;
+        if (block_len < 64) {
+            return;
+        }
+        compress(block);
+        block_len = 0;
+    }
+
+    while (len >= 64) {
+        compress(p);
+        p += 64;
+        len -= 64;
+    }
+
+    memcpy(block, p, len);
+    block_len = len;
+}
+
+std::string Sha256::hexDigest() {
+    uint64_t bit_len = total_len * 8;
+
+    //pad: 0x80, zeros to 56 mod 64, then the big-endian bit length
+    block[block_len++] = 0x80;
+    if (block_len > 56) {
+        memset(block + block_len, 0, 64 - block_len);
+        compress(block);
+        block_len = 0;
+    }
+    memset(block + block_len, 0, 56 - block_len);
+    for (int i = 0; i < 8; i++) {
+        block[63 - i] = (unsigned char)(bit_len >> (i * 8));
+    }
+    compress(block);
+
+    std::string hex(64, '0');
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            hex[i * 8 + j] = "0123456789abcdef"[(state[i] >> (28 - j * 4)) & 0xF];
+        }
+    }
+    return hex;
+}
+
+ContentDigest ContentDigest::of(const void* data, size_t len, bool with_sha256) {
+    ContentDigest digest;
+    digest.size = len;
+
+    if (!with_sha256) {
+        digest.hash = Hash64::of(data, len);
+        return digest;
+    }
+
+    //feed both hashes block by block so the data is only pulled through the cache once
+    const char* p = static_cast<const char*>(data);
+    Hash64 hasher;
+    Sha256 sha;
+    for (size_t offset = 0; offset < len; offset += 65536) {
+        size_t n = std::min<size_t>(65536, len - offset);
+        hasher.update(p + offset, n);
+        sha.update(p + offset, n);
+    }
+    digest.hash = hasher.digest();
+    digest.sha256 = sha.hexDigest();
+    return digest;
+}
+
+bool ContentDigest::ofFile(int fd, bool with_sha256, ContentDigest& digest) {
+    Hash64 hasher;
+    Sha256 sha;
+    char buffer[65536];
+    uint64_t size = 0;
+
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        hasher.update(buffer, n);
+        if (with_sha256) {
+            sha.update(buffer, n);
+        }
+        size += n;
+    }
+
+    digest.hash = hasher.digest();
+    digest.size = size;
+    digest.sha256 = with_sha256 ? sha.hexDigest() : "";
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//streaming XXH64: fast non-cryptographic 64-bit content hash (several GB/s),
+//for spotting changed or identical uploads. not for anything security related
+class Hash64 {
+private:
+    uint64_t state[4];
+    uint64_t total_len;
+    unsigned char pending[32];  //tail that didn't fill a whole 32-byte stripe yet
+    size_t pending_len;
+    uint64_t seed;
+
+public:
+    Hash64(uint64_t seed = 0);
+
+    void reset();
+    void update(const void* data, size_t len);
+    uint64_t digest() const;
+
+    static uint64_t of(const void* data, size_t len);
+    static std::string toHex(uint64_t hash);
+};
+
+//streaming SHA-256, for when clients want a digest they can verify independently
+class Sha256 {
+private:
+    uint32_t state[8];
+    uint64_t total_len;
+    unsigned char block[64];
+    size_t block_len;
+
+    void compress(const unsigned char* data);
+
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+    std::string hexDigest();    //finishes the hash, call once
+};
+
+//everything we key uploads by, computed in a single pass over the bytes
+struct ContentDigest {
+    uint64_t hash;          //Hash64, the dedup key
+    uint64_t size;
+    std::string sha256;     //hex, empty unless asked for
+
+    ContentDigest() : hash(0), size(0) {}
+
+    static ContentDigest of(const void* data, size_t len, bool with_sha256);
+
+    //digest a whole file from fd's current offset to EOF, false on read error
+    static bool ofFile(int fd, bool with_sha256, ContentDigest& digest);
+};
+
+#endif
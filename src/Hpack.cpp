@@ -0,0 +1,407 @@
+#include "Hpack.h"
+#include <algorithm>
+
+struct StaticEntry {
+    std::string_view name;      //views, so a lookup compares lengths before bytes
+    std::string_view value;
+};
+
+//RFC 7541 appendix A
+static const StaticEntry static_table[] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+    {"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""},
+    {"authorization", ""}, {"cache-control", ""}, {"content-disposition", ""},
+    {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""},
+    {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""},
+    {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""},
+    {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+    {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+#define STATIC_TABLE_LENGTH (sizeof(static_table) / sizeof(static_table[0]))
+
+//RFC 7541 appendix B, with EOS as symbol 256
+static const uint32_t huffman_codes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+static const uint8_t huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+//the code tree as a state machine that eats 4 bits at a time: each of the 256 internal
+//nodes of the tree is a state, and a nibble moves to the next one, emitting the symbol of
+//the leaf passed on the way (codes are 5 bits or more, so there is at most one)
+struct HuffmanDecoder {
+    enum { EMIT = 1, FAIL = 2 };
+    struct Transition {
+        uint8_t next;
+        uint8_t flags;
+        uint8_t symbol;
+    };
+
+    Transition transitions[256][16];
+    bool accepting[256];    //a block may end here: only up to 7 bits of EOS prefix (all ones) read
+
+    HuffmanDecoder() {
+        //children are internal nodes (>= 0) or leaves (-1 - symbol)
+        int child[256][2];
+        int ones[256];      //depth of a node reached by 1 bits alone, -1 otherwise
+        int nodes = 1;
+        for (auto& pair : child) {
+            pair[0] = pair[1] = 0;
+        }
+        ones[0] = 0;
+
+        for (int symbol = 0; symbol < 257; symbol++) {
+            int node = 0;
+            for (int bit = huffman_lengths[symbol] - 1; bit > 0; bit--) {
+                int b = (huffman_codes[symbol] >> bit) & 1;
+                if (child[node][b] == 0) {
+                    child[node][b] = nodes;
+                    ones[nodes] = b && ones[node] >= 0 ? ones[node] + 1 : -1;
+                    nodes++;
+                }
+                node = child[node][b];
+            }
+            child[node][huffman_codes[symbol] & 1] = -1 - symbol;
+        }
+
+        for (int state = 0; state < 256; state++) {
+            accepting[state] = ones[state] >= 0 && ones[state] <= 7;
+            for (int nibble = 0; nibble < 16; nibble++) {
+                Transition& t = transitions[state][nibble];
+                t.flags = 0;
+                t.symbol = 0;
+                int node = state;
+                for (int bit = 3; bit >= 0; bit--) {
+                    int next = child[node][(nibble >> bit) & 1];
+                    if (next >= 0) {
+                        node = next;
+                        continue;
+                    }
+                    if (next == -1 - 256) {
+                        t.flags |= FAIL;    //EOS in the data is an error
+                    }
+                    t.flags |= EMIT;
+                    t.symbol = (uint8_t)(-1 - next);
+                    node = 0;
+                }
+                t.next = (uint8_t)node;
+            }
+        }
+    }
+};
+
+static const HuffmanDecoder& huffmanDecoder() {
+    static const HuffmanDecoder decoder;
+    return decoder;
+}
+
+bool HpackDecoder::decodeHuffman(const uint8_t* data, size_t length, std::string& out) {
+    const HuffmanDecoder& decoder = huffmanDecoder();
+    out.reserve(out.length() + length * 8 / 5);
+
+    uint8_t state = 0;
+    for (size_t i = 0; i < length; i++) {
+        for (int nibble : {data[i] >> 4, data[i] & 0xF}) {
+            const HuffmanDecoder::Transition& t = decoder.transitions[state][nibble];
+            if (t.flags & HuffmanDecoder::FAIL) {
+                return false;
+            }
+            if (t.flags & HuffmanDecoder::EMIT) {
+                out += (char)t.symbol;
+            }
+            state = t.next;
+        }
+    }
+    return decoder.accepting[state];
+}
+
+void HpackTable::evict(size_t room) {
+    while (!entries.empty() && size + room > max_size) {
+        const HpackHeader& oldest = entries.back();
+        size -= oldest.name.length() + oldest.value.length() + HPACK_ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+void HpackTable::add(std::string_view name, std::string_view value) {
+    size_t entry_size = name.length() + value.length() + HPACK_ENTRY_OVERHEAD;
+    evict(entry_size);
+    //an entry bigger than the whole table empties it and isn't kept
+    if (entry_size > max_size) {
+        return;
+    }
+    entries.push_front(HpackHeader{std::string(name), std::string(value)});
+    size += entry_size;
+}
+
+void HpackTable::setMaxSize(size_t bytes) {
+    max_size = bytes;
+    evict(0);
+}
+
+bool HpackTable::get(uint64_t index, std::string_view& name, std::string_view& value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_TABLE_LENGTH) {
+        name = static_table[index - 1].name;
+        value = static_table[index - 1].value;
+        return true;
+    }
+    index -= STATIC_TABLE_LENGTH + 1;
+    if (index >= entries.size()) {
+        return false;
+    }
+    name = entries[index].name;
+    value = entries[index].value;
+    return true;
+}
+
+uint64_t HpackTable::find(std::string_view name, std::string_view value, bool& name_only) const {
+    uint64_t name_index = 0;
+    for (size_t i = 0; i < STATIC_TABLE_LENGTH; i++) {
+        if (name == static_table[i].name) {
+            if (value == static_table[i].value) {
+                name_only = false;
+                return i + 1;
+            }
+            if (name_index == 0) {
+                name_index = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].name == name) {
+            if (entries[i].value == value) {
+                name_only = false;
+                return STATIC_TABLE_LENGTH + 1 + i;
+            }
+            if (name_index == 0) {
+                name_index = STATIC_TABLE_LENGTH + 1 + i;
+            }
+        }
+    }
+    name_only = true;
+    return name_index;
+}
+
+//an integer with a prefix_bits prefix in the first byte (whose other bits the caller has read)
+static bool decodeInteger(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint64_t& value) {
+    uint64_t prefix_max = (1u << prefix_bits) - 1;
+    value = *p++ & prefix_max;
+    if (value < prefix_max) {
+        return true;
+    }
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        uint8_t b = *p++;
+        value += (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;   //cut off, or more than 32 bits: nothing legitimate is that long
+}
+
+static bool decodeString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if (p == end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t length;
+    if (!decodeInteger(p, end, 7, length) || length > (uint64_t)(end - p)) {
+        return false;
+    }
+    const uint8_t* data = p;
+    p += length;
+
+    out.clear();
+    if (huffman) {
+        return HpackDecoder::decodeHuffman(data, length, out);
+    }
+    out.assign(reinterpret_cast<const char*>(data), length);
+    return true;
+}
+
+bool HpackDecoder::decode(const uint8_t* data, size_t length, size_t max_list,
+                          std::vector<HpackHeader>& headers) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    size_t list_size = 0;
+    bool fields_seen = false;
+    headers.clear();
+
+    while (p < end) {
+        uint8_t first = *p;
+        uint64_t index;
+        HpackHeader header;
+
+        if (first & 0x80) {
+            //indexed field
+            std::string_view name, value;
+            if (!decodeInteger(p, end, 7, index) || !table.get(index, name, value)) {
+                return false;
+            }
+            header.name.assign(name);
+            header.value.assign(value);
+        } else if ((first & 0xE0) == 0x20) {
+            //table size update: only ahead of the fields, and within our setting
+            uint64_t size;
+            if (fields_seen || !decodeInteger(p, end, 5, size) || size > limit) {
+                return false;
+            }
+            table.setMaxSize(size);
+            continue;
+        } else {
+            //literal: with incremental indexing (01), without (0000) or never indexed (0001)
+            bool indexing = first & 0x40;
+            if (!decodeInteger(p, end, indexing ? 6 : 4, index)) {
+                return false;
+            }
+            if (index == 0) {
+                if (!decodeString(p, end, header.name)) {
+                    return false;
+                }
+            } else {
+                std::string_view name, value;
+                if (!table.get(index, name, value)) {
+                    return false;
+                }
+                header.name.assign(name);
+            }
+            if (!decodeString(p, end, header.value)) {
+                return false;
+            }
+            if (indexing) {
+                table.add(header.name, header.value);
+            }
+        }
+
+        fields_seen = true;
+        list_size += header.name.length() + header.value.length() + HPACK_ENTRY_OVERHEAD;
+        if (list_size > max_list) {
+            return false;
+        }
+        headers.push_back(std::move(header));
+    }
+    return true;
+}
+
+static void encodeInteger(std::string& out, uint8_t flags, int prefix_bits, uint64_t value) {
+    uint64_t prefix_max = (1u << prefix_bits) - 1;
+    if (value < prefix_max) {
+        out += (char)(flags | value);
+        return;
+    }
+    out += (char)(flags | prefix_max);
+    value -= prefix_max;
+    while (value >= 0x80) {
+        out += (char)(0x80 | (value & 0x7F));
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static void encodeString(std::string& out, std::string_view str) {
+    encodeInteger(out, 0x00, 7, str.length());
+    out.append(str);
+}
+
+//values that differ from one response to the next only crowd the table
+static bool isPerResponse(std::string_view name) {
+    return name == "content-length" || name == "etag" || name == "last-modified" ||
+           name == "location" || name == "date" || name == "content-range";
+}
+
+void HpackEncoder::setPeerTableSize(size_t bytes) {
+    size_t size = std::min<size_t>(bytes, HPACK_TABLE_SIZE);
+    if (size != table.getMaxSize()) {
+        table.setMaxSize(size);
+        resized = true;
+    }
+}
+
+void HpackEncoder::begin(std::string& out) {
+    if (resized) {
+        encodeInteger(out, 0x20, 5, table.getMaxSize());
+        resized = false;
+    }
+}
+
+void HpackEncoder::encode(std::string_view name, std::string_view value, std::string& out) {
+    bool name_only;
+    uint64_t index = table.find(name, value, name_only);
+    if (index != 0 && !name_only) {
+        encodeInteger(out, 0x80, 7, index);
+        return;
+    }
+
+    if (name == "set-cookie") {
+        encodeInteger(out, 0x10, 4, index);             //never indexed, not even by proxies
+    } else if (isPerResponse(name)) {
+        encodeInteger(out, 0x00, 4, index);             //without indexing
+    } else {
+        encodeInteger(out, 0x40, 6, index);             //with incremental indexing
+        table.add(name, value);
+    }
+    if (index == 0) {
+        encodeString(out, name);
+    }
+    encodeString(out, value);
+}
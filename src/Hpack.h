@@ -0,0 +1,76 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#define HPACK_TABLE_SIZE 4096       //SETTINGS_HEADER_TABLE_SIZE default, the most either side uses
+#define HPACK_ENTRY_OVERHEAD 32     //what an entry costs in the table beyond its name and value
+
+struct HpackHeader {
+    std::string name;
+    std::string value;
+};
+
+//the static table (indices 1-61) followed by the dynamic one (62 on, newest first), which
+//evicts its oldest entries to stay within max_size
+class HpackTable {
+private:
+    std::deque<HpackHeader> entries;
+    size_t size;
+    size_t max_size;
+
+    void evict(size_t room);
+
+public:
+    HpackTable() : size(0), max_size(HPACK_TABLE_SIZE) {}
+
+    void add(std::string_view name, std::string_view value);
+    void setMaxSize(size_t bytes);
+    size_t getMaxSize() const { return max_size; }
+
+    //the entry at index, false when there's none
+    bool get(uint64_t index, std::string_view& name, std::string_view& value) const;
+    //the index of name with value, or failing that of name alone (name_only set), 0 for neither
+    uint64_t find(std::string_view name, std::string_view value, bool& name_only) const;
+};
+
+//header blocks from the peer (RFC 7541). decode() is false on anything malformed, which is
+//a COMPRESSION_ERROR for the whole connection: the table can't be trusted after it
+class HpackDecoder {
+private:
+    HpackTable table;
+    size_t limit;       //what SETTINGS_HEADER_TABLE_SIZE allows the peer to resize to
+
+public:
+    HpackDecoder() : limit(HPACK_TABLE_SIZE) {}
+
+    //a complete block (HEADERS plus its CONTINUATIONs); header list size capped at max_list
+    bool decode(const uint8_t* data, size_t length, size_t max_list, std::vector<HpackHeader>& headers);
+
+    static bool decodeHuffman(const uint8_t* data, size_t length, std::string& out);
+};
+
+//header blocks to the peer. values worth keeping go into the dynamic table, the rest
+//(per-response values such as content-length and etag, and set-cookie, which must not
+//be indexed) are literals; strings are sent without Huffman coding
+class HpackEncoder {
+private:
+    HpackTable table;
+    bool resized;       //the table shrank since the last block, which has to say so first
+
+public:
+    HpackEncoder() : resized(false) {}
+
+    //the peer's SETTINGS_HEADER_TABLE_SIZE; we never use more than HPACK_TABLE_SIZE
+    void setPeerTableSize(size_t bytes);
+
+    //start a block, then add the header fields to out one by one
+    void begin(std::string& out);
+    void encode(std::string_view name, std::string_view value, std::string& out);
+};
+
+#endif
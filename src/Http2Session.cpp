@@ -0,0 +1,1047 @@
+#include "Http2Session.h"
+#include "Connection.h"
+#include "HttpRequest.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+//frame types (RFC 9113 section 6)
+#define FRAME_DATA 0x0
+#define FRAME_HEADERS 0x1
+#define FRAME_PRIORITY 0x2
+#define FRAME_RST_STREAM 0x3
+#define FRAME_SETTINGS 0x4
+#define FRAME_PUSH_PROMISE 0x5
+#define FRAME_PING 0x6
+#define FRAME_GOAWAY 0x7
+#define FRAME_WINDOW_UPDATE 0x8
+#define FRAME_CONTINUATION 0x9
+
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+#define ERROR_NO_ERROR 0x0
+#define ERROR_PROTOCOL 0x1
+#define ERROR_INTERNAL 0x2
+#define ERROR_FLOW_CONTROL 0x3
+#define ERROR_STREAM_CLOSED 0x5
+#define ERROR_FRAME_SIZE 0x6
+#define ERROR_REFUSED_STREAM 0x7
+#define ERROR_COMPRESSION 0x9
+
+#define SETTINGS_HEADER_TABLE_SIZE 0x1
+#define SETTINGS_ENABLE_PUSH 0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define SETTINGS_MAX_FRAME_SIZE 0x5
+#define SETTINGS_MAX_HEADER_LIST_SIZE 0x6
+
+#define FRAME_HEADER_LENGTH 9
+#define DEFAULT_WINDOW 65535
+#define MAX_WINDOW 0x7FFFFFFF
+#define MAX_DATA_FRAME (4 * H2_MAX_FRAME)   //however large a frame the peer takes
+
+static uint32_t read24(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return (b[0] << 16) | (b[1] << 8) | b[2];
+}
+
+static uint32_t read32(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+static void append32(std::string& out, uint32_t value) {
+    out += (char)(value >> 24);
+    out += (char)(value >> 16);
+    out += (char)(value >> 8);
+    out += (char)value;
+}
+
+static void appendFrameHeader(std::string& out, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+    out += (char)(length >> 16);
+    out += (char)(length >> 8);
+    out += (char)length;
+    out += (char)type;
+    out += (char)flags;
+    append32(out, stream_id);
+}
+
+//headers that only mean something to one HTTP/1.1 connection, which HTTP/2 forbids
+static bool isConnectionSpecific(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+//a field that can go into HTTP/1.1 text as it is: a lowercase name (RFC 9113 section 8.2.1)
+//without separators, and a value without CR, LF or NUL
+static bool isValidField(const std::string& name, const std::string& value) {
+    for (char c : name) {
+        if ((c >= 'A' && c <= 'Z') || c == ':' || c == ' ' || c == '\r' || c == '\n' || c == '\0') {
+            return false;
+        }
+    }
+    return !name.empty() && value.find_first_of("\r\n\0", 0, 3) == std::string::npos;
+}
+
+Http2Session::Http2Session(Server& server, std::deque<OutputChunk>& output, bool& close_after_output,
+                           std::function<void()>& output_ready)
+    : server(server), output(output), close_after_output(close_after_output),
+      output_ready(output_ready), preface_pending(true), last_stream_id(0), last_served(0),
+      continuation_stream(0), continuation_end_stream(false), peer_max_frame(H2_MAX_FRAME),
+      peer_initial_window(DEFAULT_WINDOW), send_window(DEFAULT_WINDOW), window_consumed(0),
+      goaway_sent(false), peer_gone(false), self(std::make_shared<Http2Session*>(this)) {
+    std::string settings;
+    const uint32_t ours[][2] = {
+        {SETTINGS_MAX_CONCURRENT_STREAMS, H2_MAX_STREAMS},
+        {SETTINGS_INITIAL_WINDOW_SIZE, H2_STREAM_WINDOW},
+        {SETTINGS_MAX_HEADER_LIST_SIZE, H2_MAX_HEADER_LIST},
+    };
+    for (const auto& setting : ours) {
+        settings += (char)(setting[0] >> 8);
+        settings += (char)setting[0];
+        append32(settings, setting[1]);
+    }
+    queueFrame(FRAME_SETTINGS, 0, 0, settings.data(), settings.length());
+    queueWindowUpdate(0, H2_CONNECTION_WINDOW - DEFAULT_WINDOW);
+}
+
+Http2Session::~Http2Session() {
+    *self = nullptr;
+    for (auto& pair : streams) {
+        if (pair.second.file_fd != -1) {
+            ::close(pair.second.file_fd);
+        }
+        server.abortPut(pair.second.upload);
+    }
+}
+
+bool Http2Session::decodeSettingsHeader(const std::string& value, std::string& payload) {
+    //base64url, padding optional
+    payload.clear();
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : value) {
+        int digit;
+        if (c >= 'A' && c <= 'Z') {
+            digit = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            digit = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            digit = c - '0' + 52;
+        } else if (c == '-' || c == '+') {
+            digit = 62;
+        } else if (c == '_' || c == '/') {
+            digit = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        bits = (bits << 6) | digit;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            payload += (char)(bits >> count);
+        }
+    }
+    return payload.length() % 6 == 0;
+}
+
+void Http2Session::startUpgraded(const std::string& settings, const std::string& raw_request) {
+    for (size_t i = 0; i + 6 <= settings.length(); i += 6) {
+        uint16_t id = ((uint8_t)settings[i] << 8) | (uint8_t)settings[i + 1];
+        if (!applySetting(id, read32(settings.data() + i + 2))) {
+            return;
+        }
+    }
+
+    Stream& stream = streams[1];
+    stream.id = 1;
+    stream.request = raw_request;
+    stream.head = raw_request.compare(0, 5, "HEAD ") == 0;
+    stream.remote_closed = true;
+    stream.send_window = peer_initial_window;
+    last_stream_id = 1;
+    finishRequest(stream);
+}
+
+//where small frames go: the last chunk queued, unless it's the one a backend may be sending
+//from right now (the front) or has a static part, then a new one
+std::string& Http2Session::frameBuffer() {
+    if (output.size() < 2 || output.back().static_remaining > 0 || output.back().file_fd != -1 ||
+        output.back().data.length() >= MAX_DATA_FRAME) {
+        output.push_back(OutputChunk());
+    }
+    return output.back().data;
+}
+
+void Http2Session::queueFrame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload, size_t length) {
+    std::string& out = frameBuffer();
+    appendFrameHeader(out, length, type, flags, stream_id);
+    out.append(payload, length);
+}
+
+void Http2Session::queueHeaders(uint32_t stream_id, const std::string& block, bool end_stream) {
+    std::string& out = frameBuffer();
+    uint8_t type = FRAME_HEADERS;
+    uint8_t flags = end_stream ? FLAG_END_STREAM : 0;
+    size_t pos = 0;
+    do {
+        size_t length = std::min<size_t>(block.length() - pos, peer_max_frame);
+        bool last = pos + length == block.length();
+        appendFrameHeader(out, length, type, flags | (last ? FLAG_END_HEADERS : 0), stream_id);
+        out.append(block, pos, length);
+        pos += length;
+        type = FRAME_CONTINUATION;
+        flags = 0;
+    } while (pos < block.length());
+}
+
+void Http2Session::queueWindowUpdate(uint32_t stream_id, uint32_t increment) {
+    std::string payload;
+    append32(payload, increment);
+    queueFrame(FRAME_WINDOW_UPDATE, 0, stream_id, payload.data(), payload.length());
+}
+
+void Http2Session::resetStream(uint32_t stream_id, uint32_t error) {
+    std::string payload;
+    append32(payload, error);
+    queueFrame(FRAME_RST_STREAM, 0, stream_id, payload.data(), payload.length());
+    closeStream(stream_id);
+}
+
+//a connection error: GOAWAY, and close once it's out
+void Http2Session::fail(uint32_t error, const char* reason) {
+    if (goaway_sent) {
+        return;
+    }
+    std::cerr << "HTTP/2 ERROR: " << reason << ", closing the connection" << std::endl;
+
+    std::string payload;
+    append32(payload, last_stream_id);
+    append32(payload, error);
+    queueFrame(FRAME_GOAWAY, 0, 0, payload.data(), payload.length());
+    goaway_sent = true;
+    close_after_output = true;
+}
+
+void Http2Session::shutdown() {
+    if (!goaway_sent && !peer_gone) {
+        std::string payload;
+        append32(payload, last_stream_id);
+        append32(payload, ERROR_NO_ERROR);
+        queueFrame(FRAME_GOAWAY, 0, 0, payload.data(), payload.length());
+    }
+    peer_gone = true;
+    checkFinished();
+}
+
+size_t Http2Session::queuedBytes() const {
+    size_t bytes = 0;
+    for (const OutputChunk& chunk : output) {
+        bytes += chunk.data.length() - chunk.sent + chunk.static_remaining;
+    }
+    return bytes;
+}
+
+void Http2Session::onReceive(const char* data, size_t len) {
+    if (goaway_sent) {
+        return;
+    }
+    input.append(data, len);
+
+    size_t pos = 0;
+    if (preface_pending) {
+        size_t length = std::min<size_t>(input.length(), H2_PREFACE_LENGTH);
+        if (input.compare(0, length, H2_PREFACE, length) != 0) {
+            fail(ERROR_PROTOCOL, "bad client preface");
+            return;
+        }
+        if (length < H2_PREFACE_LENGTH) {
+            return;
+        }
+        pos = H2_PREFACE_LENGTH;
+        preface_pending = false;
+    }
+
+    while (input.length() - pos >= FRAME_HEADER_LENGTH) {
+        const char* header = input.data() + pos;
+        uint32_t length = read24(header);
+        if (length > H2_MAX_FRAME) {
+            fail(ERROR_FRAME_SIZE, "frame over SETTINGS_MAX_FRAME_SIZE");
+            return;
+        }
+        if (input.length() - pos < FRAME_HEADER_LENGTH + length) {
+            break;
+        }
+        if (!processFrame(header[3], header[4], read32(header + 5) & 0x7FFFFFFF,
+                          header + FRAME_HEADER_LENGTH, length)) {
+            return;
+        }
+        pos += FRAME_HEADER_LENGTH + length;
+    }
+    input.erase(0, pos);
+
+    fill();
+    checkFinished();
+}
+
+//false after a connection error (fail() has been called)
+bool Http2Session::processFrame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload,
+                                size_t length) {
+    //a header block is one unit: nothing may come between its frames
+    if (continuation_stream != 0 && (type != FRAME_CONTINUATION || stream_id != continuation_stream)) {
+        fail(ERROR_PROTOCOL, "frame inside a header block");
+        return false;
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            return onData(flags, stream_id, payload, length);
+
+        case FRAME_HEADERS:
+            return onHeaders(flags, stream_id, payload, length);
+
+        case FRAME_PRIORITY:
+            //priorities are advisory; fill() serves streams round-robin
+            if (stream_id == 0) {
+                fail(ERROR_PROTOCOL, "PRIORITY on stream 0");
+                return false;
+            }
+            if (length != 5) {
+                resetStream(stream_id, ERROR_FRAME_SIZE);
+            }
+            return true;
+
+        case FRAME_RST_STREAM:
+            if (stream_id == 0 || stream_id > last_stream_id || length != 4) {
+                fail(length != 4 ? ERROR_FRAME_SIZE : ERROR_PROTOCOL, "bad RST_STREAM");
+                return false;
+            }
+            closeStream(stream_id);
+            return true;
+
+        case FRAME_SETTINGS:
+            if (stream_id != 0) {
+                fail(ERROR_PROTOCOL, "SETTINGS on a stream");
+                return false;
+            }
+            return onSettings(flags, payload, length);
+
+        case FRAME_PING:
+            if (stream_id != 0 || length != 8) {
+                fail(length != 8 ? ERROR_FRAME_SIZE : ERROR_PROTOCOL, "bad PING");
+                return false;
+            }
+            if (!(flags & FLAG_ACK)) {
+                queueFrame(FRAME_PING, FLAG_ACK, 0, payload, length);
+            }
+            return true;
+
+        case FRAME_GOAWAY:
+            if (stream_id != 0) {
+                fail(ERROR_PROTOCOL, "GOAWAY on a stream");
+                return false;
+            }
+            peer_gone = true;
+            return true;
+
+        case FRAME_WINDOW_UPDATE:
+            return onWindowUpdate(stream_id, payload, length);
+
+        case FRAME_CONTINUATION:
+            if (continuation_stream == 0) {
+                fail(ERROR_PROTOCOL, "CONTINUATION without HEADERS");
+                return false;
+            }
+            header_block.append(payload, length);
+            if (header_block.length() > H2_MAX_HEADER_LIST) {
+                fail(ERROR_PROTOCOL, "header block too large");
+                return false;
+            }
+            if (flags & FLAG_END_HEADERS) {
+                stream_id = continuation_stream;
+                continuation_stream = 0;
+                return onHeaderBlock(stream_id, continuation_end_stream);
+            }
+            return true;
+
+        case FRAME_PUSH_PROMISE:
+            fail(ERROR_PROTOCOL, "PUSH_PROMISE from a client");
+            return false;
+
+        default:
+            return true;    //unknown frame types are ignored
+    }
+}
+
+bool Http2Session::onData(uint8_t flags, uint32_t stream_id, const char* payload, size_t length) {
+    if (stream_id == 0 || stream_id > last_stream_id) {
+        fail(ERROR_PROTOCOL, "DATA on an idle stream");
+        return false;
+    }
+
+    const char* data = payload;
+    size_t data_length = length;
+    if (flags & FLAG_PADDED) {
+        size_t padding = length > 0 ? (uint8_t)payload[0] : 0;
+        if (length == 0 || padding >= length) {
+            fail(ERROR_PROTOCOL, "DATA padding longer than the frame");
+            return false;
+        }
+        data++;
+        data_length = length - 1 - padding;
+    }
+
+    //the whole frame counts against flow control, padding too, whatever became of the stream
+    window_consumed += length;
+    if (window_consumed >= H2_CONNECTION_WINDOW / 2) {
+        queueWindowUpdate(0, window_consumed);
+        window_consumed = 0;
+    }
+
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return true;    //reset or answered early; what was already on its way is dropped
+    }
+    Stream& stream = it->second;
+    if (stream.remote_closed) {
+        resetStream(stream_id, ERROR_STREAM_CLOSED);
+        return true;
+    }
+
+    stream.window_consumed += length;
+    stream.body_received += data_length;
+    if (stream.declared_length >= 0 && stream.body_received > (uint64_t)stream.declared_length) {
+        resetStream(stream_id, ERROR_PROTOCOL);
+        return true;
+    }
+    if (!stream.refused) {
+        takeBody(stream, data, data_length);
+        if (streams.find(stream_id) == streams.end()) {
+            return true;    //refused, and the refusal has gone out whole
+        }
+    }
+
+    if (flags & FLAG_END_STREAM) {
+        stream.remote_closed = true;
+        finishRequest(stream);
+    } else if (stream.window_consumed >= H2_STREAM_WINDOW / 2) {
+        queueWindowUpdate(stream_id, stream.window_consumed);
+        stream.window_consumed = 0;
+    }
+    return true;
+}
+
+//request body bytes: to the PUT's file, or onto the request text
+void Http2Session::takeBody(Stream& stream, const char* data, size_t length) {
+    if (stream.upload.fd == -1) {
+        //admitRequest() had only a content-length to go on; without one, form-sized bodies
+        if (stream.declared_length < 0 && stream.body_received > server.getConfig().max_form_body) {
+            HttpResponse response;
+            response.setHeader("Server", "MyHTTPServer/1.0");
+            response.setStatus(413);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body><h1>413 Content Too Large</h1></body></html>");
+            stream.refused = true;
+            stream.request.clear();
+            respond(stream, response);
+            return;
+        }
+        stream.request.append(data, length);
+        return;
+    }
+
+    off_t offset = stream.body_received - length;
+    while (length > 0) {
+        ssize_t n = pwrite(stream.upload.fd, data, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cerr << "ERROR: Failed to write upload body: " << strerror(errno) << std::endl;
+            server.abortPut(stream.upload);
+            HttpResponse response;
+            response.setHeader("Server", "MyHTTPServer/1.0");
+            response.setStatus(500);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body><h1>500 Internal Server Error</h1>"
+                             "<p>Failed to store the upload.</p></body></html>");
+            stream.refused = true;
+            respond(stream, response);
+            return;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+}
+
+bool Http2Session::onHeaders(uint8_t flags, uint32_t stream_id, const char* payload, size_t length) {
+    if (stream_id == 0 || (stream_id & 1) == 0) {
+        fail(ERROR_PROTOCOL, "HEADERS on a server stream");
+        return false;
+    }
+
+    size_t start = 0;
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        padding = length > 0 ? (uint8_t)payload[0] : 0;
+        start = 1;
+    }
+    if (flags & FLAG_PRIORITY) {
+        start += 5;
+    }
+    if (start + padding > length) {
+        fail(ERROR_PROTOCOL, "HEADERS padding longer than the frame");
+        return false;
+    }
+
+    header_block.assign(payload + start, length - start - padding);
+    if (flags & FLAG_END_HEADERS) {
+        return onHeaderBlock(stream_id, flags & FLAG_END_STREAM);
+    }
+    continuation_stream = stream_id;
+    continuation_end_stream = flags & FLAG_END_STREAM;
+    return true;
+}
+
+bool Http2Session::onHeaderBlock(uint32_t stream_id, bool end_stream) {
+    std::vector<HpackHeader> headers;
+    bool decoded = decoder.decode(reinterpret_cast<const uint8_t*>(header_block.data()),
+                                  header_block.length(), H2_MAX_HEADER_LIST, headers);
+    header_block.clear();
+    if (!decoded) {
+        fail(ERROR_COMPRESSION, "undecodable header block");
+        return false;
+    }
+
+    //trailers: they may only end the request, and nothing here reads them
+    auto it = streams.find(stream_id);
+    if (it != streams.end()) {
+        Stream& stream = it->second;
+        if (stream.remote_closed || !end_stream) {
+            resetStream(stream_id, ERROR_PROTOCOL);
+            return true;
+        }
+        stream.remote_closed = true;
+        finishRequest(stream);
+        return true;
+    }
+    if (stream_id <= last_stream_id) {
+        fail(ERROR_STREAM_CLOSED, "HEADERS on a closed stream");
+        return false;
+    }
+    last_stream_id = stream_id;
+
+    if (peer_gone) {
+        return true;
+    }
+    if (streams.size() >= H2_MAX_STREAMS) {
+        resetStream(stream_id, ERROR_REFUSED_STREAM);
+        return true;
+    }
+
+    //the request as HTTP/1.1 text, for HttpRequest::parse()
+    std::string method, path, scheme, authority, lines, cookie;
+    int64_t declared_length = -1;
+    bool has_host = false;
+    bool regular_seen = false;
+    bool malformed = false;
+
+    for (const HpackHeader& header : headers) {
+        const std::string& name = header.name;
+        const std::string& value = header.value;
+
+        if (!name.empty() && name[0] == ':') {
+            std::string* pseudo = name == ":method" ? &method : name == ":path" ? &path :
+                                  name == ":scheme" ? &scheme : name == ":authority" ? &authority : nullptr;
+            //these go into the request line and host header: no CR, LF or NUL either
+            if (regular_seen || pseudo == nullptr || !pseudo->empty() ||
+                !isValidField(name.substr(1), value)) {
+                malformed = true;
+                break;
+            }
+            *pseudo = value;
+            continue;
+        }
+
+        regular_seen = true;
+        if (!isValidField(name, value) || isConnectionSpecific(name) || (name == "te" && value != "trailers")) {
+            malformed = true;
+            break;
+        }
+
+        //split cookies are one header again (RFC 9113 section 8.2.3)
+        if (name == "cookie") {
+            cookie += cookie.empty() ? "" : "; ";
+            cookie += value;
+            continue;
+        }
+        if (name == "content-length") {
+            char* end;
+            declared_length = std::strtoll(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || declared_length < 0) {
+                malformed = true;
+                break;
+            }
+        }
+        has_host = has_host || name == "host";
+        lines += name;
+        lines += ": ";
+        lines += value;
+        lines += "\r\n";
+    }
+
+    //an origin-form :path, or * for OPTIONS (RFC 9113 section 8.3.1)
+    bool path_ok = (!path.empty() && path[0] == '/') || (path == "*" && method == "OPTIONS");
+    if (malformed || method.empty() || path.empty() || scheme.empty() || method == "CONNECT" ||
+        !path_ok || path.find(' ') != std::string::npos || method.find(' ') != std::string::npos) {
+        resetStream(stream_id, ERROR_PROTOCOL);
+        return true;
+    }
+
+    Stream& stream = streams[stream_id];
+    stream.id = stream_id;
+    stream.head = method == "HEAD";
+    stream.remote_closed = end_stream;
+    stream.declared_length = declared_length;
+    stream.send_window = peer_initial_window;
+
+    stream.request.reserve(method.length() + path.length() + authority.length() + lines.length() +
+                           cookie.length() + 48);
+    stream.request = method + " " + path + " HTTP/2.0\r\n";
+    if (!has_host && !authority.empty()) {
+        stream.request += "host: " + authority + "\r\n";
+    }
+    stream.request += lines;
+    if (!cookie.empty()) {
+        stream.request += "cookie: " + cookie + "\r\n";
+    }
+    stream.request += "\r\n";
+
+    //a body is vetted before any of it is taken, as over HTTP/1.1
+    if ((!end_stream || method == "PUT") && !admitBody(stream)) {
+        return true;
+    }
+    if (end_stream) {
+        finishRequest(stream);
+    }
+    return true;
+}
+
+//admitRequest() (and for a PUT, beginPut()) on the headers alone; false when the request
+//was answered instead and its body is to be dropped
+bool Http2Session::admitBody(Stream& stream) {
+    HttpRequest request;
+    HttpResponse response;
+    response.setHeader("Server", "MyHTTPServer/1.0");
+
+    uint64_t length = stream.declared_length >= 0 ? stream.declared_length : 0;
+    bool admitted = false;
+    if (!request.parse(stream.request)) {
+        response.setStatus(400);
+        response.setHeader("Content-Type", "text/html");
+        response.setBody("<html><body><h1>400 Bad Request</h1></body></html>");
+    } else if (server.admitRequest(request, length, response)) {
+        admitted = request.getMethod() != "PUT" || server.beginPut(request, length, stream.upload, response);
+    }
+
+    if (!admitted) {
+        std::cout << "REFUSED BEFORE BODY: " << request.getMethod() << " " << request.getPath()
+                  << " (HTTP/2 stream " << stream.id << ")" << std::endl;
+        stream.refused = true;
+        stream.request.clear();
+        respond(stream, response);
+        return false;
+    }
+
+    //HTTP/2 has no Expect handshake of its own, but a client may still wait for the 100
+    if (!stream.remote_closed && request.getHeader("expect") == "100-continue") {
+        std::string block;
+        encoder.begin(block);
+        encoder.encode(":status", "100", block);
+        queueHeaders(stream.id, block, false);
+    }
+    return true;
+}
+
+void Http2Session::finishRequest(Stream& stream) {
+    if (stream.refused) {
+        return;     //answered already
+    }
+    if (stream.declared_length >= 0 && stream.body_received != (uint64_t)stream.declared_length) {
+        resetStream(stream.id, ERROR_PROTOCOL);
+        return;
+    }
+
+    HttpResponse response;
+    response.setHeader("Server", "MyHTTPServer/1.0");
+
+    if (stream.upload.fd != -1) {
+        server.finishPut(stream.upload, response);
+        respond(stream, response);
+        return;
+    }
+
+    std::cout << "\n " << stream.request.substr(0, stream.request.find('\r'));
+    std::cout << "   Stream " << stream.id << ", " << stream.request.length() << " bytes" << std::endl;
+
+    HttpRequest request;
+    if (!request.parse(stream.request)) {
+        std::cerr << "Failed to parse HTTP request" << std::endl;
+        response.setStatus(400);
+        response.setHeader("Content-Type", "text/html");
+        response.setBody("<html><body><h1>400 Bad Request</h1></body></html>");
+        respond(stream, response);
+        return;
+    }
+    stream.request.clear();
+    stream.request.shrink_to_fit();
+
+    std::cout << "[" << request.getMethod() << " " << request.getPath() << "]" << std::endl;
+    server.handleRequest(request, response);
+    respond(stream, response);
+}
+
+//queue the response's HEADERS and take over its body for fill(). the stream may be gone
+//when this returns (a response without a body ends it)
+void Http2Session::respond(Stream& stream, HttpResponse& response) {
+    if (response.isDeferred()) {
+        deferResponse(stream, response);
+        return;
+    }
+
+    std::string block;
+    encoder.begin(block);
+    encoder.encode(":status", std::to_string(response.getStatus()), block);
+    for (const auto& header : response.getHeaders()) {
+        std::string name = header.first;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (!isConnectionSpecific(name)) {
+            encoder.encode(name, header.second, block);
+        }
+    }
+    for (const std::string& cookie : response.getCookies()) {
+        encoder.encode("set-cookie", cookie, block);
+    }
+
+    if (!stream.head) {
+        if (response.hasFileBody()) {
+            stream.file_remaining = response.getFileLength();
+            stream.file_fd = response.releaseFileBody();
+        } else if (response.hasStaticBody()) {
+            stream.static_data = response.getStaticBody();
+            stream.static_remaining = response.getStaticLength();
+            stream.static_owner = response.releaseStaticOwner();
+        } else if (response.hasStreamBody()) {
+            stream.stream = response.releaseStreamBody();
+        } else {
+            stream.body = response.releaseBody();
+        }
+    }
+
+    bool empty = stream.body.empty() && stream.static_remaining == 0 && stream.file_remaining == 0 &&
+                 !stream.stream;
+    queueHeaders(stream.id, block, empty);
+    stream.responded = true;
+
+    std::cout << "SENDING: stream " << stream.id << ", "
+              << (stream.stream ? "streamed" : std::to_string(stream.body.length() +
+                  stream.static_remaining + stream.file_remaining) + " bytes") << std::endl;
+
+    if (empty) {
+        stream.end_sent = true;
+        closeStream(stream.id);
+    }
+}
+
+//like Connection::deferResponse(), but only this stream waits: the others go on being served
+void Http2Session::deferResponse(Stream& stream, HttpResponse& response) {
+    stream.deferred = true;
+    uint32_t id = stream.id;
+    HttpResponse::DeferredWork work = response.releaseDeferredWork();
+    HttpResponse::DeferredStart start = response.releaseDeferredStart();
+    HttpResponse::DeferredCompletion done = response.releaseDeferredCompletion();
+
+    std::shared_ptr<Http2Session*> owner = self;
+    auto complete = [owner, id, done](bool notify) {
+        HttpResponse response;
+        response.setHeader("Server", "MyHTTPServer/1.0");
+        done(response);
+
+        Http2Session* session = *owner;
+        if (session == nullptr) {
+            return;
+        }
+        auto it = session->streams.find(id);
+        if (it == session->streams.end()) {
+            return;     //reset while the work ran
+        }
+        it->second.deferred = false;
+        session->respond(it->second, response);
+
+        if (notify) {
+            session->fill();
+            if (session->output_ready) {
+                auto ready = session->output_ready;     //may close (and free) the connection
+                ready();
+            }
+        }
+    };
+
+    if (start) {
+        std::cout << "DEFERRED: stream " << id << std::endl;
+        start([complete]() { complete(true); });
+        return;
+    }
+
+    std::cout << "DEFERRED: stream " << id << " to the blocking pool" << std::endl;
+    if (!server.getPool().submit(work, [complete]() { complete(true); })) {
+        work();
+        complete(false);
+    }
+}
+
+bool Http2Session::onSettings(uint8_t flags, const char* payload, size_t length) {
+    if (flags & FLAG_ACK) {
+        if (length != 0) {
+            fail(ERROR_FRAME_SIZE, "SETTINGS ack with a payload");
+            return false;
+        }
+        return true;
+    }
+    if (length % 6 != 0) {
+        fail(ERROR_FRAME_SIZE, "SETTINGS length not a multiple of 6");
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i += 6) {
+        uint16_t id = ((uint8_t)payload[i] << 8) | (uint8_t)payload[i + 1];
+        if (!applySetting(id, read32(payload + i + 2))) {
+            return false;
+        }
+    }
+    queueFrame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    return true;
+}
+
+bool Http2Session::applySetting(uint16_t id, uint32_t value) {
+    switch (id) {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.setPeerTableSize(value);
+            return true;
+
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                fail(ERROR_PROTOCOL, "SETTINGS_ENABLE_PUSH not 0 or 1");
+                return false;
+            }
+            return true;
+
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > MAX_WINDOW) {
+                fail(ERROR_FLOW_CONTROL, "SETTINGS_INITIAL_WINDOW_SIZE too large");
+                return false;
+            }
+            //applies to the open streams too, by the difference
+            int64_t delta = (int64_t)value - peer_initial_window;
+            peer_initial_window = value;
+            for (auto& pair : streams) {
+                pair.second.send_window += delta;
+                if (pair.second.send_window > MAX_WINDOW) {
+                    fail(ERROR_FLOW_CONTROL, "stream window overflow");
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < H2_MAX_FRAME || value > 0xFFFFFF) {
+                fail(ERROR_PROTOCOL, "SETTINGS_MAX_FRAME_SIZE out of range");
+                return false;
+            }
+            peer_max_frame = std::min<uint32_t>(value, MAX_DATA_FRAME);
+            return true;
+
+        default:
+            return true;    //MAX_CONCURRENT_STREAMS is about pushes, which we don't make
+    }
+}
+
+bool Http2Session::onWindowUpdate(uint32_t stream_id, const char* payload, size_t length) {
+    if (length != 4) {
+        fail(ERROR_FRAME_SIZE, "WINDOW_UPDATE length not 4");
+        return false;
+    }
+    uint32_t increment = read32(payload) & 0x7FFFFFFF;
+
+    if (stream_id == 0) {
+        send_window += increment;
+        if (increment == 0 || send_window > MAX_WINDOW) {
+            fail(increment == 0 ? ERROR_PROTOCOL : ERROR_FLOW_CONTROL, "bad connection WINDOW_UPDATE");
+            return false;
+        }
+        return true;
+    }
+
+    if (stream_id > last_stream_id) {
+        fail(ERROR_PROTOCOL, "WINDOW_UPDATE on an idle stream");
+        return false;
+    }
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return true;
+    }
+    it->second.send_window += increment;
+    if (increment == 0 || it->second.send_window > MAX_WINDOW) {
+        resetStream(stream_id, increment == 0 ? ERROR_PROTOCOL : ERROR_FLOW_CONTROL);
+    }
+    return true;
+}
+
+//refill a generated body's buffer once what it held has been framed; false once it's done
+bool Http2Session::nextBodyPiece(Stream& stream) {
+    while (stream.body_sent == stream.body.length() && stream.stream) {
+        stream.body.clear();
+        stream.body_sent = 0;
+        if (!stream.stream(stream.body)) {
+            stream.stream = nullptr;
+        }
+    }
+    return stream.body_sent < stream.body.length();
+}
+
+//one DATA frame of the stream's body, as much as the windows allow. false when it can't send
+//anything now (a window is shut); the stream is gone once its last frame is queued
+bool Http2Session::queueData(Stream& stream) {
+    size_t available;
+    if (stream.static_remaining > 0) {
+        available = stream.static_remaining;
+    } else if (stream.file_remaining > 0) {
+        available = stream.file_remaining;
+    } else {
+        nextBodyPiece(stream);
+        available = stream.body.length() - stream.body_sent;
+    }
+
+    int64_t window = std::min(stream.send_window, send_window);
+    size_t length = std::min<size_t>(available, std::min<int64_t>(peer_max_frame, std::max<int64_t>(window, 0)));
+    bool last = length == available && !stream.stream;
+    if (length == 0 && !last) {
+        return false;
+    }
+    uint8_t flags = last ? FLAG_END_STREAM : 0;
+
+    if (stream.static_remaining > 0) {
+        //the frame header in the chunk's data, the payload straight from where it lives
+        output.push_back(OutputChunk());
+        OutputChunk& chunk = output.back();
+        appendFrameHeader(chunk.data, length, FRAME_DATA, flags, stream.id);
+        chunk.static_data = stream.static_data;
+        chunk.static_remaining = length;
+        chunk.static_owner = stream.static_owner;
+        stream.static_data += length;
+        stream.static_remaining -= length;
+    } else if (stream.file_remaining > 0) {
+        std::string& out = frameBuffer();
+        size_t start = out.length();
+        appendFrameHeader(out, length, FRAME_DATA, flags, stream.id);
+        size_t payload = out.length();
+        out.resize(payload + length);
+        size_t got = 0;
+        while (got < length) {
+            ssize_t n = pread(stream.file_fd, &out[payload + got], length - got, stream.file_offset + got);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                //the file shrank or failed underneath us: the content-length is now a lie
+                out.resize(start);
+                resetStream(stream.id, ERROR_INTERNAL);
+                return true;
+            }
+            got += n;
+        }
+        stream.file_offset += length;
+        stream.file_remaining -= length;
+    } else {
+        std::string& out = frameBuffer();
+        appendFrameHeader(out, length, FRAME_DATA, flags, stream.id);
+        out.append(stream.body, stream.body_sent, length);
+        stream.body_sent += length;
+    }
+
+    stream.send_window -= length;
+    send_window -= length;
+
+    if (last) {
+        stream.end_sent = true;
+        closeStream(stream.id);
+    }
+    return true;
+}
+
+void Http2Session::fill() {
+    if (goaway_sent) {
+        return;
+    }
+
+    //one frame per stream per turn, so a big download can't starve the small ones beside it
+    while (queuedBytes() < H2_OUTPUT_HIGH_WATER && !streams.empty()) {
+        auto it = streams.upper_bound(last_served);
+        bool queued = false;
+        for (size_t tried = 0; tried < streams.size(); tried++, ++it) {
+            if (it == streams.end()) {
+                it = streams.begin();
+            }
+            Stream& stream = it->second;
+            if (stream.responded && !stream.deferred && !stream.end_sent) {
+                last_served = it->first;
+                if (queueData(stream)) {
+                    queued = true;
+                    break;      //it may have been erased
+                }
+            }
+        }
+        if (!queued) {
+            break;
+        }
+    }
+}
+
+//a stream we're done with. one the client is still sending on gets RST_STREAM(NO_ERROR),
+//which asks it to stop without treating the response as failed
+void Http2Session::closeStream(uint32_t stream_id) {
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    Stream& stream = it->second;
+    if (stream.file_fd != -1) {
+        ::close(stream.file_fd);
+    }
+    server.abortPut(stream.upload);
+    bool still_sending = stream.end_sent && !stream.remote_closed;
+    streams.erase(it);
+
+    if (still_sending) {
+        std::string payload;
+        append32(payload, ERROR_NO_ERROR);
+        queueFrame(FRAME_RST_STREAM, 0, stream_id, payload.data(), payload.length());
+    }
+    checkFinished();
+}
+
+void Http2Session::checkFinished() {
+    if (peer_gone && streams.empty()) {
+        close_after_output = true;
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include "Server.h"
+#include "HttpResponse.h"
+#include "Hpack.h"
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LENGTH 24
+#define H2_MAX_STREAMS 100                      //SETTINGS_MAX_CONCURRENT_STREAMS we announce
+#define H2_STREAM_WINDOW (1024 * 1024)          //receive window per stream (request bodies)
+#define H2_CONNECTION_WINDOW (16 * 1024 * 1024) //and for the connection as a whole
+#define H2_MAX_FRAME 16384                      //SETTINGS_MAX_FRAME_SIZE, left at the default
+#define H2_MAX_HEADER_LIST 65536                //SETTINGS_MAX_HEADER_LIST_SIZE
+#define H2_OUTPUT_HIGH_WATER (256 * 1024)       //framed bytes queued before fill() waits for a send
+
+struct OutputChunk;
+
+//HTTP/2 over cleartext (h2c) for one connection, once Connection has seen the client preface
+//or answered an Upgrade: h2c with 101. frames come in through onReceive(); each request is
+//rebuilt as HTTP/1.1 text for HttpRequest::parse() and handed to Server::handleRequest() as
+//soon as its headers (and body) are in, so a slow or deferred response holds up only its own
+//stream. responses are framed into the connection's output queue: HEADERS right away, DATA
+//by fill(), round-robin across streams within the peer's flow control windows and no more
+//than H2_OUTPUT_HIGH_WATER ahead of the socket. static bodies go out from where they are
+//(a frame header in the chunk's data, the payload as its static part)
+class Http2Session {
+private:
+    struct Stream {
+        uint32_t id;
+        std::string request;        //the request as HTTP/1.1 text, headers then body
+        bool head;                  //HEAD: the response goes without its body
+        bool remote_closed;         //END_STREAM received
+        int64_t declared_length;    //content-length, -1 without one
+        uint64_t body_received;
+        uint32_t window_consumed;   //DATA taken in since our last WINDOW_UPDATE for it
+        PutUpload upload;           //a PUT body written to its file as it arrives
+        bool refused;               //answered before the body was in; the rest is discarded
+
+        //the response
+        bool responded;             //HEADERS queued
+        bool deferred;
+        bool end_sent;              //END_STREAM queued
+        int64_t send_window;
+        std::string body;
+        size_t body_sent;
+        const char* static_data;
+        size_t static_remaining;
+        std::shared_ptr<const void> static_owner;
+        int file_fd;
+        off_t file_offset;
+        size_t file_remaining;
+        HttpResponse::BodyStream stream;
+
+        Stream() : id(0), head(false), remote_closed(false), declared_length(-1), body_received(0),
+                   window_consumed(0), refused(false), responded(false), deferred(false),
+                   end_sent(false), send_window(0), body_sent(0), static_data(nullptr),
+                   static_remaining(0), file_fd(-1), file_offset(0), file_remaining(0) {}
+    };
+
+    Server& server;
+    std::deque<OutputChunk>& output;        //the connection's, which the backend drains
+    bool& close_after_output;
+    std::function<void()>& output_ready;
+
+    std::string input;                      //received bytes not yet making a whole frame
+    bool preface_pending;
+    std::map<uint32_t, Stream> streams;
+    uint32_t last_stream_id;                //highest stream the client opened
+    uint32_t last_served;                   //where fill()'s round-robin picks up
+
+    //a header block arriving in CONTINUATION frames
+    uint32_t continuation_stream;
+    bool continuation_end_stream;
+    std::string header_block;
+
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+
+    //what the peer's SETTINGS and WINDOW_UPDATEs allow us
+    uint32_t peer_max_frame;
+    int64_t peer_initial_window;
+    int64_t send_window;
+    uint32_t window_consumed;               //connection-level DATA since our last WINDOW_UPDATE
+
+    bool goaway_sent;
+    bool peer_gone;                         //GOAWAY received or sent by shutdown(): finish what's open, then close
+
+    //deferred responses finish after this session may be gone (see Connection::self)
+    std::shared_ptr<Http2Session*> self;
+
+    std::string& frameBuffer();
+    void queueFrame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload, size_t length);
+    void queueHeaders(uint32_t stream_id, const std::string& block, bool end_stream);
+    void queueWindowUpdate(uint32_t stream_id, uint32_t increment);
+    void resetStream(uint32_t stream_id, uint32_t error);
+    void fail(uint32_t error, const char* reason);
+    size_t queuedBytes() const;
+
+    bool processFrame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload, size_t length);
+    bool onData(uint8_t flags, uint32_t stream_id, const char* payload, size_t length);
+    bool onHeaders(uint8_t flags, uint32_t stream_id, const char* payload, size_t length);
+    bool onHeaderBlock(uint32_t stream_id, bool end_stream);
+    bool onSettings(uint8_t flags, const char* payload, size_t length);
+    bool applySetting(uint16_t id, uint32_t value);
+    bool onWindowUpdate(uint32_t stream_id, const char* payload, size_t length);
+
+    bool admitBody(Stream& stream);
+    void takeBody(Stream& stream, const char* data, size_t length);
+    void finishRequest(Stream& stream);
+    void respond(Stream& stream, HttpResponse& response);
+    void deferResponse(Stream& stream, HttpResponse& response);
+    bool nextBodyPiece(Stream& stream);
+    bool queueData(Stream& stream);
+    void closeStream(uint32_t stream_id);
+    void checkFinished();
+
+public:
+    Http2Session(Server& server, std::deque<OutputChunk>& output, bool& close_after_output,
+                 std::function<void()>& output_ready);
+    ~Http2Session();
+
+    Http2Session(const Http2Session&) = delete;
+    Http2Session& operator=(const Http2Session&) = delete;
+
+    //the payload of an HTTP2-Settings header (base64url SETTINGS), false if it isn't one
+    static bool decodeSettingsHeader(const std::string& value, std::string& payload);
+
+    //after a 101 for an Upgrade: h2c request: its HTTP2-Settings payload stands in for the
+    //client's first SETTINGS, and the request itself becomes stream 1
+    void startUpgraded(const std::string& settings, const std::string& raw_request);
+
+    //bytes from the socket, starting with the client preface
+    void onReceive(const char* data, size_t len);
+
+    //frame more response data into the output queue, as windows and the queue allow
+    void fill();
+
+    //the server is shutting down: GOAWAY past the streams already open, close after them
+    void shutdown();
+};
+
+#endif
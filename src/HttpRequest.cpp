@@ -2,10 +2,61 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 HttpRequest::HttpRequest() {
 }
 
+void FieldList::set(std::string_view name, std::string_view value) {
+    for (auto& item : items) {
+        if (item.first == name) {
+            item.second = value;
+            return;
+        }
+    }
+    items.emplace_back(name, value);
+}
+
+std::string_view FieldList::get(std::string_view name) const {
+    for (const auto& item : items) {
+        if (item.first == name) {
+            return item.second;
+        }
+    }
+    return std::string_view();
+}
+
+bool FieldList::has(std::string_view name) const {
+    for (const auto& item : items) {
+        if (item.first == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpRequest::Parsed::clear() {
+    cookies_done = form_done = multipart_done = false;
+    cookies.clear();
+    form.clear();
+    form_buffer.clear();
+    multipart_fields.clear();
+    files.clear();
+}
+
+static std::string_view trimView(std::string_view str) {
+    size_t first = str.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+    size_t last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last - first + 1);
+}
+
 //helper method to trim the string
 //remove leading and trailing whitespace
 //returns the trimmed string
@@ -26,6 +77,11 @@ void HttpRequest::parseRequestLine(const std::string& line) {
     if (method.empty() || path.empty() || version.empty()) {
         std::cerr << "Error: Invalid request line" << std::endl;
     }
+    
+    //every handler routes and opens files on this, so it's decoded here and nowhere else
+    if (!canonicalPath(path, clean_path)) {
+        clean_path.clear();
+    }
 }
 
 void HttpRequest::parseHeader(const std::string& line) {
@@ -49,6 +105,7 @@ void HttpRequest::parseHeader(const std::string& line) {
 //parse the raw request into a HttpRequest object
 //returns true if successful, false otherwise
 bool HttpRequest::parse(const std::string& raw_request) {
+    parsed.clear();
     if (raw_request.empty()) {
         return false;
     }
@@ -133,123 +190,330 @@ void HttpRequest::print() const {
     }
 }
 
-std::string HttpRequest::urlDecode(const std::string& str) {
-    std::string result;
-    for (size_t i = 0; i < str.length(); i++) {
-        if (str[i] == '%' && i + 2 < str.length()) {
-            //hex to char
-            std::string hex = str.substr(i + 1, 2);
-            try {
-                char ch = static_cast<char>(std::stoi(hex, nullptr, 16));
-                result += ch;
-                i += 2;
-            } catch (...) {
-                //invalid hex, keep the %
-                result += str[i];
-            }
-        } else if (str[i] == '+') {
-            result += ' ';
+//hex digit -> value, -1 for anything else
+struct HexTable {
+    int8_t value[256];
+    
+    HexTable() {
+        memset(value, -1, sizeof(value));
+        for (int i = 0; i < 10; i++) {
+            value['0' + i] = i;
+        }
+        for (int i = 0; i < 6; i++) {
+            value['a' + i] = value['A' + i] = 10 + i;
+        }
+    }
+};
+static const HexTable hex_table;
+
+static int hexValue(char c) {
+    return hex_table.value[(unsigned char)c];
+}
+
+//how many bytes from p on (up to end) need no decoding: no '%' and no '+'.
+//16 (or 32) at a time, the runs between escapes are then copied in one go
+static size_t plainRun(const char* p, const char* end) {
+    const char* start = p;
+#if defined(__AVX2__)
+    const __m256i percent32 = _mm256_set1_epi8('%');
+    const __m256i plus32 = _mm256_set1_epi8('+');
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, percent32),
+                                                             _mm256_cmpeq_epi8(block, plus32)));
+        if (mask != 0) {
+            return p - start + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, percent),
+                                                       _mm_cmpeq_epi8(block, plus)));
+        if (mask != 0) {
+            return p - start + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && *p != '%' && *p != '+') {
+        p++;
+    }
+    return p - start;
+}
+
+//decoding only ever shrinks, so it's done in place: the write position never passes the read one
+void HttpRequest::urlDecodeInPlace(std::string& str) {
+    str.resize(urlDecodeInPlace(&str[0], str.length()));
+}
+
+size_t HttpRequest::urlDecodeInPlace(char* data, size_t length) {
+    const char* in = data;
+    const char* end = data + length;
+    char* out = data;
+    
+    while (in < end) {
+        size_t run = plainRun(in, end);
+        if (out != in) {
+            memmove(out, in, run);
+        }
+        in += run;
+        out += run;
+        if (in == end) {
+            break;
+        }
+        
+        int high, low;
+        if (*in == '+') {
+            *out++ = ' ';
+            in++;
+        } else if (end - in > 2 && (high = hexValue(in[1])) >= 0 && (low = hexValue(in[2])) >= 0) {
+            *out++ = static_cast<char>(high << 4 | low);
+            in += 3;
         } else {
-            result += str[i];
+            *out++ = *in++;     //invalid hex, keep the %
         }
     }
+    
+    return out - data;
+}
+
+std::string HttpRequest::urlDecode(const std::string& str) {
+    std::string result = str;
+    urlDecodeInPlace(result);
     return result;
 }
 
+//the segment that starts at out[segment] is complete: drop it if it's ".", refuse ".."
+static bool closeSegment(std::string& out, size_t segment) {
+    size_t length = out.length() - segment;
+    if (length == 1 && out[segment] == '.') {
+        out.resize(segment);
+    } else if (length == 2 && out[segment] == '.' && out[segment + 1] == '.') {
+        return false;
+    }
+    return true;
+}
+
+bool HttpRequest::canonicalPath(const std::string& target, std::string& out) {
+    size_t end = std::min(target.find('?'), target.length());
+    out.clear();
+    if (end == 0 || target[0] != '/') {
+        return false;
+    }
+    out.reserve(end);
+    
+    size_t segment = 0;     //where the segment being decoded starts in out
+    for (size_t i = 0; i < end; i++) {
+        char c = target[i];
+        int high, low;
+        if (c == '%' && i + 2 < end && (high = hexValue(target[i + 1])) >= 0 &&
+            (low = hexValue(target[i + 2])) >= 0) {
+            c = static_cast<char>(high << 4 | low);
+            i += 2;
+        } else if (c == '+') {
+            c = ' ';    //as urlDecode() has it
+        }
+        
+        if (c == '\0') {
+            return false;
+        }
+        if (c != '/') {
+            out += c;
+            continue;
+        }
+        
+        //an encoded '/' separates segments like a plain one: nothing below gets a second look
+        if (!closeSegment(out, segment)) {
+            return false;
+        }
+        if (out.empty() || out.back() != '/') {
+            out += '/';
+        }
+        segment = out.length();
+    }
+    return closeSegment(out, segment);
+}
+
+//characters that don't need encoding: alphanumeric, '-', '_', '.', '~'
+static bool isUnreserved(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '_' || c == '.' || c == '~';
+}
+
+#if defined(__SSE2__)
+//bit i set when byte i of block is unreserved (bytes >= 0x80 are negative here, so never in range)
+static unsigned unreservedMask(__m128i block) {
+    auto in = [block](char low, char high) {
+        return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(low - 1)),
+                             _mm_cmplt_epi8(block, _mm_set1_epi8(high + 1)));
+    };
+    __m128i ok = _mm_or_si128(_mm_or_si128(in('a', 'z'), in('A', 'Z')), in('0', '9'));
+    ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('-')),
+                                       _mm_cmpeq_epi8(block, _mm_set1_epi8('_'))));
+    ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('.')),
+                                       _mm_cmpeq_epi8(block, _mm_set1_epi8('~'))));
+    return _mm_movemask_epi8(ok);
+}
+#endif
+
+//how many bytes from p on (up to end) are copied through as they are
+static size_t unreservedRun(const char* p, const char* end) {
+    const char* start = p;
+#if defined(__SSE2__)
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = unreservedMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        if (mask != 0xFFFF) {
+            return p - start + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    while (p < end && isUnreserved(*p)) {
+        p++;
+    }
+    return p - start;
+}
+
 std::string HttpRequest::urlEncode(const std::string& str) {
-    std::string result;
-    for (size_t i = 0; i < str.length(); i++) {
-        unsigned char c = str[i];
-        //characters that don't need encoding: alphanumeric, '-', '_', '.', '~'
-        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || 
-            (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~') {
-            result += c;
-        } else {
-            //encode as %XX
-            result += '%';
-            result += "0123456789ABCDEF"[c >> 4];
-            result += "0123456789ABCDEF"[c & 0x0F];
+    //worst case every byte becomes %XX; written through a pointer, trimmed at the end
+    std::string result(str.length() * 3, '\0');
+    const char* in = str.data();
+    const char* end = in + str.length();
+    char* out = &result[0];
+    
+    while (in < end) {
+        size_t run = unreservedRun(in, end);
+        memcpy(out, in, run);
+        in += run;
+        out += run;
+        if (in == end) {
+            break;
         }
+        
+        unsigned char c = *in++;
+        out[0] = '%';
+        out[1] = "0123456789ABCDEF"[c >> 4];
+        out[2] = "0123456789ABCDEF"[c & 0x0F];
+        out += 3;
     }
+    
+    result.resize(out - &result[0]);
     return result;
 }
 
-std::map<std::string, std::string> HttpRequest::parseFormData() {
-    std::map<std::string, std::string> form_data;
-    
-    //if body is empty, return the form data
-    if (body.empty()) {
-        return form_data;
+const FieldList& HttpRequest::getFormData() const {
+    if (parsed.form_done) {
+        return parsed.form;
     }
+    parsed.form_done = true;
     
     //parse application/x-www-form-urlencoded format
     // Format: key1=value1&key2=value2&key3=value3
+    //one copy of the body, then every key and value is decoded where it sits in it
+    parsed.form_buffer = body;
+    char* data = &parsed.form_buffer[0];
+    size_t length = parsed.form_buffer.length();
+    
+    size_t start = 0;
+    while (start < length) {
+        size_t end = parsed.form_buffer.find('&', start);
+        if (end == std::string::npos) {
+            end = length;
+        }
+        
+        size_t equals_pos = parsed.form_buffer.find('=', start);
+        if (equals_pos < end) {
+            size_t key_length = urlDecodeInPlace(data + start, equals_pos - start);
+            size_t value_length = urlDecodeInPlace(data + equals_pos + 1, end - equals_pos - 1);
+            parsed.form.set(std::string_view(data + start, key_length),
+                            std::string_view(data + equals_pos + 1, value_length));
+        }
+        start = end + 1;
+    }
     
-    std::istringstream stream(body);
-    std::string pair;
+    return parsed.form;
+}
+
+std::map<std::string, std::string> HttpRequest::getQueryParams() const {
+    std::map<std::string, std::string> params;
     
-    while (std::getline(stream, pair, '&')) {
-        size_t equals_pos = pair.find('=');
+    //decode each key/value separately: an encoded & or = belongs to the value
+    size_t query_pos = path.find('?');
+    if (query_pos == std::string::npos) {
+        return params;
+    }
+    
+    size_t start = query_pos + 1;
+    while (start <= path.length()) {
+        size_t end = path.find('&', start);
+        if (end == std::string::npos) {
+            end = path.length();
+        }
         
-        if (equals_pos != std::string::npos) {
+        std::string pair = path.substr(start, end - start);
+        if (!pair.empty()) {
+            size_t equals_pos = pair.find('=');
             std::string key = pair.substr(0, equals_pos);
-            std::string value = pair.substr(equals_pos + 1);
-            
-            key = urlDecode(key);
-            value = urlDecode(value);
-            
-            form_data[key] = value;
+            std::string value = equals_pos != std::string::npos ? pair.substr(equals_pos + 1) : "";
+            urlDecodeInPlace(key);
+            urlDecodeInPlace(value);
+            params[key] = std::move(value);
         }
+        start = end + 1;
     }
     
-    return form_data;
+    return params;
 }
 
-std::map<std::string, std::string> HttpRequest::parseCookies() const {
-    std::map<std::string, std::string> cookies;
-    
-    std::string cookie_header = getHeader("cookie");
+const FieldList& HttpRequest::getCookies() const {
+    if (parsed.cookies_done) {
+        return parsed.cookies;
+    }
+    parsed.cookies_done = true;
     
-    if (cookie_header.empty()) {
-        return cookies;
+    auto header = headers.find("cookie");
+    if (header == headers.end()) {
+        return parsed.cookies;
     }
     
     //cookie1=value1; cookie2=value2; cookie3=value3
-    std::istringstream stream(cookie_header);
-    std::string pair;
-    
-    while (std::getline(stream, pair, ';')) {
-        // Trim whitespace
-        pair = trim(pair);
+    std::string_view rest = header->second;
+    while (!rest.empty()) {
+        size_t semicolon = rest.find(';');
+        std::string_view pair = rest.substr(0, semicolon);
+        rest = semicolon == std::string_view::npos ? std::string_view() : rest.substr(semicolon + 1);
         
         size_t equals_pos = pair.find('=');
-        if (equals_pos != std::string::npos) {
-            std::string name = pair.substr(0, equals_pos);
-            std::string value = pair.substr(equals_pos + 1);
-            
-            cookies[trim(name)] = trim(value);
+        if (equals_pos != std::string_view::npos) {
+            parsed.cookies.set(trimView(pair.substr(0, equals_pos)), trimView(pair.substr(equals_pos + 1)));
         }
     }
     
-    return cookies;
+    return parsed.cookies;
 }
 
-std::string HttpRequest::getCookie(const std::string& name) const {
-    std::map<std::string, std::string> cookies = parseCookies();
-    
-    auto it = cookies.find(name);
-    if (it != cookies.end()) {
-        return it->second;
-    }
-    
-    return "";
+const FieldList& HttpRequest::getMultipartFields() const {
+    parseMultipart();
+    return parsed.multipart_fields;
 }
 
-std::map<std::string, std::string> HttpRequest::parseMultipartFormData(std::vector<UploadedFile>& files) {
-    std::map<std::string, std::string> form_fields;
+const std::vector<UploadedFile>& HttpRequest::getUploadedFiles() const {
+    parseMultipart();
+    return parsed.files;
+}
 
-    std::cout << "🔍 Body length: " << body.length() << " bytes" << std::endl;
-    std::cout << "🔍 First 200 chars: [" << body.substr(0, 200) << "]" << std::endl;
+//one pass over the body: parts, their headers and their contents are all views into it
+void HttpRequest::parseMultipart() const {
+    if (parsed.multipart_done) {
+        return;
+    }
+    parsed.multipart_done = true;
+    
+    std::string_view data = body;
+    std::cout << "🔍 Body length: " << data.length() << " bytes" << std::endl;
+    std::cout << "🔍 First 200 chars: [" << data.substr(0, 200) << "]" << std::endl;
     
     //get content-type header to extract boundary
     std::string content_type = getHeader("content-type");
@@ -257,7 +521,7 @@ std::map<std::string, std::string> HttpRequest::parseMultipartFormData(std::vect
     if (content_type.empty() || content_type.find("multipart/form-data") == std::string::npos) {
         std::cerr << "Not multipart/form-data" << std::endl;
         std::cerr << "  Content-Type: " << content_type << std::endl;
-        return form_fields;
+        return;
     }
     
     //extract boundary from content-type
@@ -265,13 +529,12 @@ std::map<std::string, std::string> HttpRequest::parseMultipartFormData(std::vect
     size_t boundary_pos = content_type.find("boundary=");
     if (boundary_pos == std::string::npos) {
         std::cerr << "No boundary found in Content-Type" << std::endl;
-        return form_fields;
+        return;
     }
     
-    std::string boundary = content_type.substr(boundary_pos + 9); 
-    boundary = trim(boundary);
+    std::string boundary = trim(content_type.substr(boundary_pos + 9));
     
-    if (boundary.front() == '"' && boundary.back() == '"') { //removing quotes
+    if (boundary.length() >= 2 && boundary.front() == '"' && boundary.back() == '"') { //removing quotes
         boundary = boundary.substr(1, boundary.length() - 2);
     }
     
@@ -281,10 +544,10 @@ std::map<std::string, std::string> HttpRequest::parseMultipartFormData(std::vect
     std::string delimiter = "--" + boundary;
     size_t pos = 0;
     
-    while (pos < body.length()) {
+    while (pos < data.length()) {
         //find next boundary
-        size_t boundary_start = body.find(delimiter, pos);
-        if (boundary_start == std::string::npos) {
+        size_t boundary_start = data.find(delimiter, pos);
+        if (boundary_start == std::string_view::npos) {
             break;
         }
         
@@ -292,108 +555,97 @@ std::map<std::string, std::string> HttpRequest::parseMultipartFormData(std::vect
         pos = boundary_start + delimiter.length();
         
         //check if this is the final boundary (ends with --)
-        if (pos + 2 <= body.length() && body.substr(pos, 2) == "--") {
+        if (data.compare(pos, 2, "--") == 0) {
             break;
         }
         
         //skip CRLF after boundary
-        if (pos + 2 <= body.length() && body.substr(pos, 2) == "\r\n") {
+        if (data.compare(pos, 2, "\r\n") == 0) {
             pos += 2;
-        } else if (pos + 1 <= body.length() && body[pos] == '\n') {
+        } else if (pos < data.length() && data[pos] == '\n') {
             pos += 1;
         }
         
         //find the next boundary to get the part content
-        size_t next_boundary = body.find(delimiter, pos);
-        if (next_boundary == std::string::npos) {
+        size_t next_boundary = data.find(delimiter, pos);
+        if (next_boundary == std::string_view::npos) {
             break;
         }
         
-        //extract this part
-        std::string part = body.substr(pos, next_boundary - pos);
-        
-        //split part into headers and content
+        //this part, split into headers and content
+        std::string_view part = data.substr(pos, next_boundary - pos);
         size_t headers_end = part.find("\r\n\r\n");
         bool has_crlf = true;
         
-        if (headers_end == std::string::npos) {
+        if (headers_end == std::string_view::npos) {
             headers_end = part.find("\n\n");
             has_crlf = false;
         }
         
-        if (headers_end == std::string::npos) {
+        if (headers_end == std::string_view::npos) {
             pos = next_boundary;
             continue;
         }
         
-        std::string part_headers = part.substr(0, headers_end);
-        std::string part_content = part.substr(headers_end + (has_crlf ? 4 : 2));
+        std::string_view part_headers = part.substr(0, headers_end);
+        std::string_view part_content = part.substr(headers_end + (has_crlf ? 4 : 2));
         
         //remove trailing CRLF from content
         while (!part_content.empty() && 
                (part_content.back() == '\n' || part_content.back() == '\r')) {
-            part_content.pop_back();
+            part_content.remove_suffix(1);
         }
         
         //parse part headers
-        std::string field_name;
-        std::string filename;
-        std::string content_type_part;
-        
-        std::istringstream header_stream(part_headers);
-        std::string header_line;
+        std::string_view field_name;
+        std::string_view filename;
+        std::string_view content_type_part;
         
-        while (std::getline(header_stream, header_line)) {
+        while (!part_headers.empty()) {
+            size_t line_end = part_headers.find('\n');
+            std::string_view header_line = part_headers.substr(0, line_end);
+            part_headers = line_end == std::string_view::npos ? std::string_view() : part_headers.substr(line_end + 1);
+            
             //remove \r if present
             if (!header_line.empty() && header_line.back() == '\r') {
-                header_line.pop_back();
+                header_line.remove_suffix(1);
             }
             
-            if (header_line.find("Content-Disposition:") == 0) {
+            if (header_line.compare(0, 20, "Content-Disposition:") == 0) {
                 //parse: Content-Disposition: form-data; name="field"; filename="file.jpg"
-
-                //extraction:
                 
                 size_t name_pos = header_line.find("name=\"");
-                if (name_pos != std::string::npos) {
+                if (name_pos != std::string_view::npos) {
                     size_t name_start = name_pos + 6;
-                    size_t name_end = header_line.find("\"", name_start);
+                    size_t name_end = header_line.find('"', name_start);
                     field_name = header_line.substr(name_start, name_end - name_start);
                 }
                 
                 size_t filename_pos = header_line.find("filename=\"");
-                if (filename_pos != std::string::npos) {
+                if (filename_pos != std::string_view::npos) {
                     size_t filename_start = filename_pos + 10;
-                    size_t filename_end = header_line.find("\"", filename_start);
+                    size_t filename_end = header_line.find('"', filename_start);
                     filename = header_line.substr(filename_start, filename_end - filename_start);
                 }
-            } else if (header_line.find("Content-Type:") == 0) {
-                content_type_part = trim(header_line.substr(13));
+            } else if (header_line.compare(0, 13, "Content-Type:") == 0) {
+                content_type_part = trimView(header_line.substr(13));
             }
         }
         
         //store based on whether it's a file or regular field
         if (!filename.empty()) {
             //it's a file upload
-            UploadedFile file;
-            file.field_name = field_name;
-            file.filename = filename;
-            file.content_type = content_type_part;
-            file.content = part_content;
-            
-            files.push_back(file);
+            parsed.files.push_back(UploadedFile{field_name, filename, content_type_part, part_content});
             
             std::cout << "FILE UPLOAD: " << filename 
                       << " (" << part_content.length() << " bytes, " 
                       << content_type_part << ")" << std::endl;
         } else {
             //if it's a regular form field
-            form_fields[field_name] = part_content;
+            parsed.multipart_fields.set(field_name, part_content);
             std::cout << "FORM FIELD: " << field_name << " = " << part_content << std::endl;
         }
         
         pos = next_boundary;
     }
-    
-    return form_fields;
 }
\ No newline at end of file
@@ -2,14 +2,39 @@
 #define HTTP_REQUEST_H
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
+#include <utility>
 
+//views into the request body, valid as long as the request
 struct UploadedFile {
-    std::string field_name;      
-    std::string filename;        
-    std::string content_type;    //MIME type
-    std::string content;         //binary
+    std::string_view field_name;
+    std::string_view filename;
+    std::string_view content_type;    //MIME type
+    std::string_view content;         //binary
+};
+
+//name -> value pairs in the order they came, for the handful of cookies or form fields a request
+//carries: a linear scan over one vector instead of a node allocation per entry. a repeated
+//name keeps its first position and its last value, as with a map
+class FieldList {
+    private:
+        std::vector<std::pair<std::string_view, std::string_view>> items;
+        
+    public:
+        typedef std::vector<std::pair<std::string_view, std::string_view>>::const_iterator const_iterator;
+        
+        void set(std::string_view name, std::string_view value);
+        //"" when missing
+        std::string_view get(std::string_view name) const;
+        bool has(std::string_view name) const;
+        void clear() { items.clear(); }
+        
+        size_t size() const { return items.size(); }
+        bool empty() const { return items.empty(); }
+        const_iterator begin() const { return items.begin(); }
+        const_iterator end() const { return items.end(); }
 };
 
 class HttpRequest {
@@ -17,13 +42,34 @@ class HttpRequest {
         std::string method;
         std::string path;
         std::string version;
+        std::string clean_path;     //see getCleanPath()
         std::map<std::string, std::string> headers;
         std::string body;
         
+        //what the accessors below parse on first use. copying or moving a request starts these
+        //over, the views would still point into the original
+        struct Parsed {
+            bool cookies_done = false;
+            FieldList cookies;          //into the Cookie header
+            bool form_done = false;
+            FieldList form;             //into form_buffer
+            std::string form_buffer;    //the body, each key and value decoded in place
+            bool multipart_done = false;
+            FieldList multipart_fields; //into body
+            std::vector<UploadedFile> files;
+            
+            Parsed() {}
+            Parsed(const Parsed&) {}
+            Parsed& operator=(const Parsed&) { clear(); return *this; }
+            void clear();
+        };
+        mutable Parsed parsed;
+        
         // Helper methods
         std::string trim(const std::string& str) const;
         void parseRequestLine(const std::string& line);
         void parseHeader(const std::string& line);
+        void parseMultipart() const;
         
     public:
         HttpRequest();
@@ -31,18 +77,34 @@ class HttpRequest {
         //main parsing method
         bool parse(const std::string& raw_request);
         
-        std::map<std::string, std::string> parseFormData();
+        //application/x-www-form-urlencoded body fields, decoded
+        const FieldList& getFormData() const;
         static std::string urlDecode(const std::string& str);
+        static void urlDecodeInPlace(std::string& str);
+        static size_t urlDecodeInPlace(char* data, size_t length);  //the decoded length
         static std::string urlEncode(const std::string& str);
         
-        //multipart form data parsing 
-        std::map<std::string, std::string> parseMultipartFormData(std::vector<UploadedFile>& files);
+        //the path of a request target in one pass: the query string cut off, decoded once,
+        //repeated '/' and '.' segments dropped. false (out unusable) when it can't name
+        //anything under a root: not starting with '/', a '..' segment, or a NUL byte
+        static bool canonicalPath(const std::string& target, std::string& out);
+        
+        //multipart/form-data body: the plain fields, and the parts that carried a filename
+        const FieldList& getMultipartFields() const;
+        const std::vector<UploadedFile>& getUploadedFiles() const;
+        
+        //?key=value&... from the raw request target, decoded
+        std::map<std::string, std::string> getQueryParams() const;
         
-        std::map<std::string, std::string> parseCookies() const;
-        std::string getCookie(const std::string& name) const;
+        //the accessors that return views parse once, on first use, and the views last as long
+        //as the request (or until the next parse())
+        const FieldList& getCookies() const;
+        std::string_view getCookie(std::string_view name) const { return getCookies().get(name); }
         
         std::string getMethod() const { return method; }
         std::string getPath() const { return path; }
+        //canonicalPath() of the target, worked out by parse(); empty when that refused it
+        const std::string& getCleanPath() const { return clean_path; }
         std::string getVersion() const { return version; }
         std::string getHeader(const std::string& name) const;
         std::string getBody() const { return body; }
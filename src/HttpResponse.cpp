@@ -1,23 +1,38 @@
 #include "HttpResponse.h"
 #include <sstream>
 #include <iostream>
+#include <unistd.h>
 
 HttpResponse::HttpResponse() 
-    : version("HTTP/1.1"), status_code(200), status_message("OK") {
+    : version("HTTP/1.1"), status_code(200), status_message("OK"),
+      file_fd(-1), file_length(0), static_body(nullptr), static_length(0) {
+}
+
+HttpResponse::~HttpResponse() {
+    if (file_fd != -1) {
+        close(file_fd);
+    }
 }
 
 std::string HttpResponse::getStatusMessage(int code) {
     switch (code) {
+        case 100: return "Continue";
         case 200: return "OK";
         case 201: return "Created";
         case 204: return "No Content";
         case 301: return "Moved Permanently";
         case 302: return "Found";
+        case 304: return "Not Modified";
         case 400: return "Bad Request";
+        case 401: return "Unauthorized";
         case 403: return "Forbidden";
         case 404: return "Not Found";
+        case 411: return "Length Required";
+        case 413: return "Content Too Large";
+        case 417: return "Expectation Failed";
         case 500: return "Internal Server Error";
         case 501: return "Not Implemented";
+        case 507: return "Insufficient Storage";
         default: return "Unknown";
     }
 }
@@ -31,6 +46,15 @@ void HttpResponse::setHeader(const std::string& name, const std::string& value)
     headers[name] = value;
 }
 
+void HttpResponse::removeHeader(const std::string& name) {
+    headers.erase(name);
+}
+
+std::string HttpResponse::getHeader(const std::string& name) const {
+    auto it = headers.find(name);
+    return it != headers.end() ? it->second : "";
+}
+
 void HttpResponse::setCookie(const std::string& name, const std::string& value,
                             int max_age, const std::string& path) {
     std::ostringstream cookie;
@@ -50,27 +74,134 @@ void HttpResponse::setCookie(const std::string& name, const std::string& value,
 }
 
 void HttpResponse::setBody(const std::string& content) {
-    body = content;
+    setBody(std::string(content));
+}
+
+void HttpResponse::setBody(std::string&& content) {
+    if (file_fd != -1) {
+        close(file_fd);
+        file_fd = -1;
+        file_length = 0;
+    }
+    static_body = nullptr;
+    static_length = 0;
+    static_owner = nullptr;
+    stream = nullptr;
+    removeHeader("Transfer-Encoding");
+    
+    body = std::move(content);
     setHeader("Content-Length", std::to_string(body.length()));
 }
 
+void HttpResponse::setFileBody(int fd, size_t length) {
+    if (file_fd != -1) {
+        close(file_fd);
+    }
+    static_body = nullptr;
+    static_length = 0;
+    static_owner = nullptr;
+    stream = nullptr;
+    removeHeader("Transfer-Encoding");
+    
+    body.clear();
+    file_fd = fd;
+    file_length = length;
+    setHeader("Content-Length", std::to_string(length));
+}
+
+void HttpResponse::setStaticBody(const char* data, size_t length, std::shared_ptr<const void> owner) {
+    if (file_fd != -1) {
+        close(file_fd);
+        file_fd = -1;
+        file_length = 0;
+    }
+    stream = nullptr;
+    removeHeader("Transfer-Encoding");
+    
+    body.clear();
+    static_body = data;
+    static_length = length;
+    static_owner = std::move(owner);
+    setHeader("Content-Length", std::to_string(length));
+}
+
+void HttpResponse::defer(DeferredWork work, DeferredCompletion done) {
+    deferred_work = std::move(work);
+    deferred_start = nullptr;
+    deferred_done = std::move(done);
+}
+
+void HttpResponse::deferUntil(DeferredStart start, DeferredCompletion done) {
+    deferred_work = nullptr;
+    deferred_start = std::move(start);
+    deferred_done = std::move(done);
+}
+
+int HttpResponse::releaseFileBody() {
+    int fd = file_fd;
+    file_fd = -1;
+    return fd;
+}
+
+void HttpResponse::setStreamBody(BodyStream producer) {
+    if (file_fd != -1) {
+        close(file_fd);
+        file_fd = -1;
+        file_length = 0;
+    }
+    static_body = nullptr;
+    static_length = 0;
+    static_owner = nullptr;
+    
+    body.clear();
+    stream = std::move(producer);
+    removeHeader("Content-Length");
+    setHeader("Transfer-Encoding", "chunked");
+}
+
+HttpResponse::BodyStream HttpResponse::releaseStreamBody() {
+    BodyStream producer = std::move(stream);
+    stream = nullptr;
+    return producer;
+}
+
 std::string HttpResponse::build() const {
-    std::ostringstream response;
+    //sized up front so the whole response is one allocation
+    size_t size = version.length() + status_message.length() + 8 + body.length();
+    for (const auto& header : headers) {
+        size += header.first.length() + header.second.length() + 4;
+    }
+    for (const auto& cookie : cookies) {
+        size += cookie.length() + 14;
+    }
     
-    response << version << " " << status_code << " " << status_message << "\r\n";
+    std::string response;
+    response.reserve(size);
+    
+    response += version;
+    response += ' ';
+    response += std::to_string(status_code);
+    response += ' ';
+    response += status_message;
+    response += "\r\n";
     
     for (const auto& header : headers) {
-        response << header.first << ": " << header.second << "\r\n";
+        response += header.first;
+        response += ": ";
+        response += header.second;
+        response += "\r\n";
     }
     
     //cookies - each set cookie is a sep headre 
     for (const auto& cookie : cookies) {
-        response << "Set-Cookie: " << cookie << "\r\n";
+        response += "Set-Cookie: ";
+        response += cookie;
+        response += "\r\n";
     }
     
-    response << "\r\n";
+    response += "\r\n";
     
-    response << body;
+    response += body;
     
-    return response.str();
-}
\ No newline at end of file
+    return response;
+}
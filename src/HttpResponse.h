@@ -4,8 +4,20 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <functional>
+#include <memory>
 
 class HttpResponse {
+public:
+    //produces a body piece by piece as the client drains it: appends the next piece to out
+    //and returns false once that was the last one
+    typedef std::function<bool(std::string& out)> BodyStream;
+    
+    //a response finished off the event loop (see defer())
+    typedef std::function<void()> DeferredWork;
+    typedef std::function<void(HttpResponse& response)> DeferredCompletion;
+    typedef std::function<void(std::function<void()> finish)> DeferredStart;
+
 private:
     std::string version;
     int status_code;
@@ -13,19 +25,75 @@ private:
     std::map<std::string, std::string> headers;
     std::vector<std::string> cookies;  //multiple set cookie headers
     std::string body;
-    
-    std::string getStatusMessage(int code);
+    int file_fd;         //file streamed after the headers instead of body (-1 if none)
+    size_t file_length;
+    const char* static_body;    //bytes sent from where they are instead of body (null if none)
+    size_t static_length;
+    std::shared_ptr<const void> static_owner;   //keeps static_body alive, if anything has to
+    BodyStream stream;   //generated body, sent chunked (empty if none)
+    DeferredWork deferred_work;
+    DeferredStart deferred_start;
+    DeferredCompletion deferred_done;
     
 public:
     HttpResponse();
+    ~HttpResponse();
+    
+    //owns file_fd, so copying would double close it
+    HttpResponse(const HttpResponse&) = delete;
+    HttpResponse& operator=(const HttpResponse&) = delete;
+    
+    static std::string getStatusMessage(int code);
 
     void setStatus(int code);
     void setHeader(const std::string& name, const std::string& value);
+    void removeHeader(const std::string& name);
+    std::string getHeader(const std::string& name) const;
+    int getStatus() const { return status_code; }
+    const std::map<std::string, std::string>& getHeaders() const { return headers; }
+    const std::vector<std::string>& getCookies() const { return cookies; }
     void setCookie(const std::string& name, const std::string& value,
                    int max_age = -1, const std::string& path = "/");  // NEW
     void setBody(const std::string& content);
+    void setBody(std::string&& content);
+    std::string releaseBody() { return std::move(body); }
+    
+    //stream an open file as the body (takes ownership of fd) so the I/O backend can
+    //sendfile/splice it instead of copying the bytes through userspace
+    void setFileBody(int fd, size_t length);
+    bool hasFileBody() const { return file_fd != -1; }
+    size_t getFileLength() const { return file_length; }
+    int releaseFileBody();  //hand the fd to the caller, who is now responsible for closing it
+    
+    //send length bytes at data as the body without copying them. they must outlive the
+    //response and the connection sending it: constant data (the embedded assets), or memory
+    //that owner keeps alive until the body is out (a FileCache mapping)
+    void setStaticBody(const char* data, size_t length, std::shared_ptr<const void> owner = nullptr);
+    bool hasStaticBody() const { return static_body != nullptr; }
+    const char* getStaticBody() const { return static_body; }
+    size_t getStaticLength() const { return static_length; }
+    std::shared_ptr<const void> releaseStaticOwner() { return std::move(static_owner); }
+    
+    //generate the body while it is being sent (Transfer-Encoding: chunked), for responses
+    //too big to build in memory up front. the connection pulls a piece each time the last one is out
+    void setStreamBody(BodyStream producer);
+    bool hasStreamBody() const { return static_cast<bool>(stream); }
+    BodyStream releaseStreamBody();
+    
+    //finish the response later, without blocking the event loop on the disk: work runs on the
+    //server's BlockingPool and may only touch the filesystem and what it captured, then done
+    //runs back on the loop thread and fills in a fresh response (status, headers, body) in
+    //place of this one. the connection keeps later pipelined responses queued behind it
+    void defer(DeferredWork work, DeferredCompletion done);
+    //the same, for work that has its own thread: start runs on the loop and hands the work
+    //off, which then gets finish run on the loop once it's done (BlockingPool::post())
+    void deferUntil(DeferredStart start, DeferredCompletion done);
+    bool isDeferred() const { return static_cast<bool>(deferred_done); }
+    DeferredWork releaseDeferredWork() { return std::move(deferred_work); }
+    DeferredStart releaseDeferredStart() { return std::move(deferred_start); }
+    DeferredCompletion releaseDeferredCompletion() { return std::move(deferred_done); }
     
-    //build the raw HTTP response
+    //build the raw HTTP response (headers only when a file, static or stream body is set)
     std::string build() const;
 };
 
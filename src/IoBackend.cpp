@@ -0,0 +1,105 @@
+#include "IoBackend.h"
+#include "EpollBackend.h"
+#include "UringBackend.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+volatile sig_atomic_t IoBackend::stop_requested = 0;
+volatile sig_atomic_t IoBackend::drain_requested = 0;
+volatile sig_atomic_t IoBackend::reload_requested = 0;
+
+static void onStopSignal(int) {
+    IoBackend::requestStop();
+}
+
+//a second SIGTERM while draining stops at once
+static void onDrainSignal(int) {
+    IoBackend::requestDrain();
+}
+
+static void onReloadSignal(int) {
+    IoBackend::requestReload();
+}
+
+IoBackend::IoBackend(Server& server)
+    : server(server), buffer_size(server.getConfig().buffer_size), draining(false) {
+    sigprocmask(SIG_SETMASK, nullptr, &wait_mask);
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    sigdelset(&wait_mask, SIGHUP);
+}
+
+void IoBackend::checkReload() {
+    if (reload_requested) {
+        reload_requested = 0;
+        if (reload_handler) {
+            reload_handler();
+        }
+    }
+}
+
+bool IoBackend::shouldStop() {
+    if (stop_requested) {
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (drain_requested && !draining) {
+        draining = true;
+        drain_deadline = now + std::chrono::seconds(server.getConfig().drain_timeout);
+        if (drain_handler) {
+            drain_handler();
+        }
+        beginDrain();
+        std::cout << "\nDraining: no new connections, " << connectionCount()
+                  << " still open" << std::endl;
+    }
+
+    if (draining && connectionCount() == 0) {
+        return true;
+    }
+    if (draining && now >= drain_deadline) {
+        std::cout << "Drain timeout, dropping " << connectionCount() << " connections" << std::endl;
+        return true;
+    }
+    return false;
+}
+
+int IoBackend::waitTimeoutMs() const {
+    if (!draining) {
+        return -1;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        drain_deadline - std::chrono::steady_clock::now()).count();
+    return std::max<long long>(left, 0) + 1;
+}
+
+void IoBackend::installStopHandler() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sa.sa_handler = onDrainSignal;
+    sigaction(SIGTERM, &sa, nullptr);
+    sa.sa_handler = onReloadSignal;
+    sigaction(SIGHUP, &sa, nullptr);
+
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGHUP);
+    sigprocmask(SIG_BLOCK, &stop_signals, nullptr);
+}
+
+IoBackend* IoBackend::create(const std::string& name, Server& server) {
+    if (name == "epoll") {
+        return new EpollBackend(server);
+    } else if (name == "uring" || name == "io_uring") {
+        return new UringBackend(server);
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,76 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include "Server.h"
+#include "Socket.h"
+#include <string>
+#include <functional>
+#include <chrono>
+#include <csignal>
+
+//common interface for the event loops that drive Connections,
+//so epoll and io_uring can be swapped (and benchmarked) at startup
+class IoBackend {
+protected:
+    Server& server;
+    size_t buffer_size;     //bytes per recv, from the config at startup
+    sigset_t wait_mask;     //signal mask while blocked waiting for events, stop signals let through
+    std::function<void()> reload_handler;
+    std::function<void()> drain_handler;
+    bool draining;
+    std::chrono::steady_clock::time_point drain_deadline;
+
+    static volatile sig_atomic_t stop_requested;
+    static volatile sig_atomic_t drain_requested;
+    static volatile sig_atomic_t reload_requested;
+
+    //loop thread, once per wakeup: run the reload handler if a SIGHUP came in
+    void checkReload();
+
+    //loop thread, once per wakeup: false to keep running. the first SIGTERM starts draining
+    //(beginDrain()); it's over once the last connection is gone or drain_timeout is up
+    bool shouldStop();
+    //how long the wait for events may block, -1 for as long as it takes
+    int waitTimeoutMs() const;
+
+    //stop accepting and close the listener, and have every connection finish what it's
+    //doing (Connection::drain()), closing the idle ones now
+    virtual void beginDrain() = 0;
+    virtual size_t connectionCount() const = 0;
+
+public:
+    IoBackend(Server& server);
+    virtual ~IoBackend() {}
+
+    virtual const char* getName() const = 0;
+
+    //attach to an already listening socket, false if the backend is unavailable here
+    virtual bool init(Socket& listener) = 0;
+
+    //serve connections until SIGINT, or SIGTERM and the connections open at the time are done
+    virtual void run() = 0;
+    
+    //what SIGHUP does, called from run() between events (so it may touch the server)
+    void setReloadHandler(std::function<void()> handler) { reload_handler = std::move(handler); }
+    //called from run() as draining begins, before the listener is closed
+    void setDrainHandler(std::function<void()> handler) { drain_handler = std::move(handler); }
+    
+    //block SIGINT/SIGTERM/SIGHUP except while a backend waits for events, so a stop or reload
+    //request always lands between requests and run() can act on it cleanly (e.g. return to
+    //flush PGO profiles)
+    static void installStopHandler();
+    static void requestStop() { stop_requested = 1; }
+    static void requestDrain() {
+        if (drain_requested) {
+            stop_requested = 1;     //a second SIGTERM doesn't wait
+        } else {
+            drain_requested = 1;
+        }
+    }
+    static void requestReload() { reload_requested = 1; }
+
+    //"epoll" or "uring", nullptr for an unknown name
+    static IoBackend* create(const std::string& name, Server& server);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "JsonWriter.h"
+#include <charconv>
+#include <cstring>
+
+JsonWriter::JsonWriter(std::string& out) : out(out), after_key(false) {
+}
+
+//comma between items, nothing after a key or at the start of a container
+void JsonWriter::separate() {
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (!has_items.empty()) {
+        if (has_items.back()) {
+            out += ',';
+        }
+        has_items.back() = true;
+    }
+}
+
+void JsonWriter::writeString(const char* str, size_t len) {
+    out += '"';
+
+    //copy runs of plain characters in one go, escape the rest
+    size_t run_start = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        out.append(str + run_start, i - run_start);
+        run_start = i + 1;
+
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += "0123456789abcdef"[c >> 4];
+                out += "0123456789abcdef"[c & 0xF];
+        }
+    }
+    out.append(str + run_start, len - run_start);
+
+    out += '"';
+}
+
+JsonWriter& JsonWriter::beginObject() {
+    separate();
+    out += '{';
+    has_items.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    out += '}';
+    has_items.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+    separate();
+    out += '[';
+    has_items.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    out += ']';
+    has_items.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name) {
+    separate();
+    writeString(name.data(), name.length());
+    out += ':';
+    after_key = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& str) {
+    separate();
+    writeString(str.data(), str.length());
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str) {
+    separate();
+    writeString(str, strlen(str));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t number) {
+    separate();
+    char buffer[24];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+    out.append(buffer, end - buffer);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t number) {
+    separate();
+    char buffer[24];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+    out.append(buffer, end - buffer);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    separate();
+    out += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+    separate();
+    out += "null";
+    return *this;
+}
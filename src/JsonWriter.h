@@ -0,0 +1,36 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//minimal JSON serializer that appends straight into a caller's buffer (no DOM, no streams).
+//calls chain: json.beginObject().key("total").value(n).endObject()
+class JsonWriter {
+private:
+    std::string& out;
+    std::vector<bool> has_items;    //one per open object/array: a comma is due before the next item
+    bool after_key;
+
+    void separate();
+    void writeString(const char* str, size_t len);
+
+public:
+    JsonWriter(std::string& out);
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    JsonWriter& key(const std::string& name);
+    JsonWriter& value(const std::string& str);
+    JsonWriter& value(const char* str);
+    JsonWriter& value(int64_t number);
+    JsonWriter& value(uint64_t number);
+    JsonWriter& value(bool flag);
+    JsonWriter& null();
+};
+
+#endif
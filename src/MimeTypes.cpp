@@ -0,0 +1,37 @@
+#include "MimeTypes.h"
+
+const char* MimeTypes::of(const std::string& path) {
+    //find file extension
+    size_t dot_pos = path.find_last_of('.');
+    if (dot_pos == std::string::npos) {
+        return "application/octet-stream";  // Default binary type
+    }
+    
+    std::string extension = path.substr(dot_pos);
+    
+    if (extension == ".html" || extension == ".htm") {
+        return "text/html";
+    } else if (extension == ".css") {
+        return "text/css";
+    } else if (extension == ".js") {
+        return "application/javascript";
+    } else if (extension == ".json") {
+        return "application/json";
+    } else if (extension == ".txt") {
+        return "text/plain";
+    } else if (extension == ".png") {
+        return "image/png";
+    } else if (extension == ".jpg" || extension == ".jpeg") {
+        return "image/jpeg";
+    } else if (extension == ".gif") {
+        return "image/gif";
+    } else if (extension == ".svg") {
+        return "image/svg+xml";
+    } else if (extension == ".pdf") {
+        return "application/pdf";
+    } else if (extension == ".zip") {
+        return "application/zip";
+    }
+    
+    return "application/octet-stream";
+}
@@ -0,0 +1,13 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+#include <string>
+
+//Content-Type by file extension. on its own so the asset packer (tools/pack_assets.cpp)
+//can bake the same answers into the embedded asset index at build time
+class MimeTypes {
+public:
+    static const char* of(const std::string& path);
+};
+
+#endif
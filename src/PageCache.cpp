@@ -0,0 +1,49 @@
+#include "PageCache.h"
+
+std::shared_ptr<const std::string> PageCache::find(const std::string& key, uint64_t version) {
+    auto found = entries.find(key);
+    if (found == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+
+    if (found->second.version != version || found->second.expires <= Clock::now()) {
+        entries.erase(found);
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    return found->second.page;
+}
+
+std::shared_ptr<const std::string> PageCache::store(const std::string& key, uint64_t version,
+                                                    std::string page) {
+    Clock::time_point now = Clock::now();
+    if (entries.size() >= max_entries && entries.find(key) == entries.end()) {
+        makeRoom(now);
+    }
+
+    Entry& entry = entries[key];
+    entry.page = std::make_shared<const std::string>(std::move(page));
+    entry.version = version;
+    entry.expires = now + std::chrono::milliseconds(ttl_ms);
+    return entry.page;
+}
+
+//drop what has expired, and if that wasn't enough, whatever comes first
+void PageCache::makeRoom(Clock::time_point now) {
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        it = it->second.expires <= now ? entries.erase(it) : std::next(it);
+    }
+    while (!entries.empty() && entries.size() >= max_entries) {
+        entries.erase(entries.begin());
+    }
+}
+
+void PageCache::setLimits(int ttl, size_t max) {
+    ttl_ms = ttl;
+    max_entries = max;
+    if (entries.size() > max_entries) {
+        makeRoom(Clock::now());
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+#define PAGE_CACHE_TTL_MS 1000          //default for how long a rendered page may be served again
+#define PAGE_CACHE_MAX_ENTRIES 1024
+#define PAGE_CACHE_MAX_FILES 1000       //bigger /files listings are streamed, not cached
+
+//rendered dynamic pages (/files, /dashboard), kept for a short while under their route and
+//inputs. each is stored with the version of the state it was rendered from (the catalog's,
+//the sessions') and is only served while that version is current, so a change invalidates
+//exactly the pages built from it the moment it happens; the TTL bounds the rest.
+//loop thread only: a miss renders synchronously, so concurrent misses for a key can't happen
+class PageCache {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::shared_ptr<const std::string> page;
+        uint64_t version;
+        Clock::time_point expires;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    int ttl_ms;
+    size_t max_entries;
+    uint64_t hits;
+    uint64_t misses;
+
+    void makeRoom(Clock::time_point now);
+
+public:
+    PageCache(int ttl_ms = PAGE_CACHE_TTL_MS, size_t max_entries = PAGE_CACHE_MAX_ENTRIES)
+        : ttl_ms(ttl_ms), max_entries(max_entries), hits(0), misses(0) {}
+
+    //the page under key if it's fresh and was rendered from version, else null
+    std::shared_ptr<const std::string> find(const std::string& key, uint64_t version);
+    //keep page under key; returns it for the response to send from
+    std::shared_ptr<const std::string> store(const std::string& key, uint64_t version, std::string page);
+    void clear() { entries.clear(); }
+    //config reload: pages already stored keep their expiry, the count is cut down now
+    void setLimits(int ttl_ms, size_t max_entries);
+
+    uint64_t hitCount() const { return hits; }
+    uint64_t missCount() const { return misses; }
+};
+
+#endif
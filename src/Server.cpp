@@ -1,104 +1,233 @@
 #include "Server.h"
 #include "HttpRequest.h"
+#include "JsonWriter.h"
+#include "Hash.h"
+#include "MimeTypes.h"
+#include "EmbeddedAssets.h"
 #include <fstream>
 #include <sstream>
+#include <memory>
 #include <iostream>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
 #include <cstdio>
 #include <algorithm>
+#include <set>
 #include <ctime>
+#include <chrono>
 #include <cstdlib>
-#include <dirent.h>  
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 
-Server::Server(const std::string& root, const std::string& uploads) 
-    : www_root(root), uploads_root(uploads) {
-    std::cout << "Server root directory: " << www_root << std::endl;
+Server::Server(const ServerConfig& config)
+    : config(config), www_root(config.www), uploads_root(config.uploads), www_fd(-1), uploads_fd(-1),
+      sessions_version(0), catalog(config.uploads, config.sha256), store(config.uploads),
+      upload_sha256(config.sha256), trash_counter(0), file_cache(config.file_cache_mb * 1024 * 1024),
+      page_cache(config.page_cache_ttl_ms, config.page_cache_entries),
+      pool(config.workers, config.pool_queue),
+      submissions(config.uploads + "/.submissions", pool, config.submissions_sync),
+      templates_root(config.templates) {
+    std::cout << "Embedded assets: " << EmbeddedAssets::count() << " files, "
+              << EmbeddedAssets::totalBytes() << " bytes" << std::endl;
+    if (!www_root.empty()) {
+        std::cout << "Server root directory: " << www_root << " (overrides embedded assets)" << std::endl;
+    }
     std::cout << "Uploads directory: " << uploads_root << std::endl;
+    std::cout << "Templates directory: " << templates_root << std::endl;
+    std::cout << "File cache: " << config.file_cache_mb << " MB of mappings" << std::endl;
     
     //create uploads directory if it doesn't exist
     mkdir(uploads_root.c_str(), 0755);
+    
+    if (!www_root.empty()) {
+        www_fd = open(www_root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (www_fd < 0) {
+            std::cerr << "Warning: could not open " << www_root << ": " << strerror(errno)
+                      << ", serving the embedded assets only" << std::endl;
+        }
+    }
+    uploads_fd = open(uploads_root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (uploads_fd < 0) {
+        std::cerr << "Warning: could not open " << uploads_root << ": "
+                  << strerror(errno) << ", its files won't be served" << std::endl;
+    }
+    
+    catalog.open();
+    store.open();
+    submissions.open();
+    
+    //a page whose template is missing or broken answers 500; the rest of the server still runs
+    dashboard_page.load(templates_root + "/dashboard.html");
+    upload_page.load(templates_root + "/upload-success.html");
+    submit_page.load(templates_root + "/submit-success.html");
+    files_page.load(templates_root + "/files.html");
+    
+    //trees a /delete-all moved aside but didn't get to remove before we stopped. their blobs
+    //aren't known any more; the store's startup sweep gets them the next time round
+    mkdir((uploads_root + "/.trash").c_str(), 0755);
+    DIR* trash = opendir((uploads_root + "/.trash").c_str());
+    struct dirent* ent;
+    while (trash && (ent = readdir(trash)) != nullptr) {
+        if (ent->d_name[0] != '.') {
+            reclaimTrash(uploads_root + "/.trash/" + ent->d_name, nullptr);
+        }
+    }
+    if (trash) {
+        closedir(trash);
+    }
+}
+
+Server::~Server() {
+    if (www_fd >= 0) {
+        close(www_fd);
+    }
+    if (uploads_fd >= 0) {
+        close(uploads_fd);
+    }
+}
+
+void Server::reconfigure(const ServerConfig& next) {
+    config.socket = next.socket;
+    config.tls_cert = next.tls_cert;
+    config.tls_key = next.tls_key;
+    config.tls_session_timeout = next.tls_session_timeout;
+    config.pool_queue = next.pool_queue;
+    config.file_cache_mb = next.file_cache_mb;
+    config.page_cache_ttl_ms = next.page_cache_ttl_ms;
+    config.page_cache_entries = next.page_cache_entries;
+    config.submissions_sync = next.submissions_sync;
+    config.max_header_size = next.max_header_size;
+    config.max_form_body = next.max_form_body;
+    config.max_upload_body = next.max_upload_body;
+    config.max_put_body = next.max_put_body;
+    config.drain_timeout = next.drain_timeout;
+    
+    file_cache.setBudget(config.file_cache_mb * 1024 * 1024);
+    page_cache.setLimits(config.page_cache_ttl_ms, config.page_cache_entries);
+    pool.setMaxQueued(config.pool_queue);
+    submissions.setSyncMs(config.submissions_sync);
 }
 
 std::string Server::getContentType(const std::string& path) {
-    //find file extension
-    size_t dot_pos = path.find_last_of('.');
-    if (dot_pos == std::string::npos) {
-        return "application/octet-stream";  // Default binary type
-    }
-    
-    std::string extension = path.substr(dot_pos);
-    
-    if (extension == ".html" || extension == ".htm") {
-        return "text/html";
-    } else if (extension == ".css") {
-        return "text/css";
-    } else if (extension == ".js") {
-        return "application/javascript";
-    } else if (extension == ".json") {
-        return "application/json";
-    } else if (extension == ".txt") {
-        return "text/plain";
-    } else if (extension == ".png") {
-        return "image/png";
-    } else if (extension == ".jpg" || extension == ".jpeg") {
-        return "image/jpeg";
-    } else if (extension == ".gif") {
-        return "image/gif";
-    } else if (extension == ".svg") {
-        return "image/svg+xml";
-    } else if (extension == ".pdf") {
-        return "application/pdf";
-    } else if (extension == ".zip") {
-        return "application/zip";
-    }
-    
-    return "application/octet-stream";
-}
-
-bool Server::isPathSafe(const std::string& path) {
-    
-    //block ".."
-    if (path.find("..") != std::string::npos) {
-        return false;
+    return MimeTypes::of(path);
+}
+
+//open a regular file beneath dir_fd (a path relative to it) for a response body (setFileResponse()).
+//openat2(RESOLVE_BENEATH) makes the kernel refuse anything resolving outside the root, symlinks
+//and all, whatever the string looked like. returns the fd (caller owns it) and fills in st,
+//or -1, with not_found set when it's a 404 rather than a 500
+int Server::openFile(int dir_fd, const std::string& path, struct stat& st, bool& not_found) {
+    static bool have_openat2 = true;    //until the kernel says otherwise (before 5.6)
+    not_found = false;
+    
+    int fd = -1;
+    if (have_openat2) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = O_RDONLY | O_CLOEXEC;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        fd = syscall(SYS_openat2, dir_fd, path.c_str(), &how, sizeof(how));
+        have_openat2 = fd >= 0 || errno != ENOSYS;
+    }
+    if (!have_openat2) {
+        //canonical paths have no '..' segments; past that, only a final symlink is refused
+        fd = openat(dir_fd, path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
     }
     
-    //block encoded dots (%2e%2e or %2E%2E)
-    std::string lower_path = path;
-    std::transform(lower_path.begin(), lower_path.end(), lower_path.begin(), ::tolower);
-    if (lower_path.find("%2e%2e") != std::string::npos) {
-        return false;
+    if (fd < 0) {
+        //EXDEV: it would have left the root
+        not_found = (errno == ENOENT || errno == ENOTDIR || errno == EXDEV || errno == ELOOP);
+        return -1;
     }
     
-    //path should start with /
-    if (path.empty() || path[0] != '/') {
-        return false;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        not_found = true;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//the body of a response is the file open on fd (takes it): small files are sent from a cached
+//mapping, the rest kernel to kernel (sendfile or splice)
+void Server::setFileResponse(int fd, const struct stat& st, HttpResponse& response) {
+    std::shared_ptr<const FileMapping> mapping = file_cache.get(fd, st);
+    if (mapping == nullptr) {
+        response.setFileBody(fd, st.st_size);
+        return;
     }
     
-    return true;
+    close(fd);
+    response.setStaticBody(mapping->data(), mapping->length(), mapping);
 }
 
-bool Server::fileExists(const std::string& path) {
-    struct stat buffer;
-    return (stat(path.c_str(), &buffer) == 0 && S_ISREG(buffer.st_mode));
+//whether an Accept-Encoding value takes gzip (listed, or "*", with a q above 0)
+static bool acceptsGzip(const std::string& accept_encoding) {
+    size_t pos = 0;
+    while (pos < accept_encoding.length()) {
+        size_t end = accept_encoding.find(',', pos);
+        if (end == std::string::npos) {
+            end = accept_encoding.length();
+        }
+        std::string coding = accept_encoding.substr(pos, end - pos);
+        pos = end + 1;
+        
+        double quality = 1.0;
+        size_t params = coding.find(';');
+        if (params != std::string::npos) {
+            size_t q = coding.find("q=", params);
+            if (q != std::string::npos) {
+                quality = std::strtod(coding.c_str() + q + 2, nullptr);
+            }
+            coding.resize(params);
+        }
+        coding.erase(0, coding.find_first_not_of(" \t"));
+        coding.erase(coding.find_last_not_of(" \t") + 1);
+        std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+        
+        if (coding == "gzip" || coding == "x-gzip" || coding == "*") {
+            return quality > 0;
+        }
+    }
+    return false;
 }
 
-std::string Server::readFile(const std::string& path, bool& success) {
-    std::ifstream file(path, std::ios::binary);
-    
-    if (!file.is_open()) {
-        success = false;
-        return "";
+//an asset built into the binary: sent from read-only memory, gzipped when the client takes it
+//and the build found it worth it, 304 when the client's copy is current
+static void serveAsset(const HttpRequest& request, const EmbeddedAsset& asset, HttpResponse& response) {
+    bool gzip = asset.gzip_length > 0 && acceptsGzip(request.getHeader("Accept-Encoding"));
+    const char* etag = gzip ? asset.gzip_etag : asset.etag;
+    
+    response.setHeader("ETag", etag);
+    if (asset.gzip_length > 0) {
+        response.setHeader("Vary", "Accept-Encoding");
     }
     
-    std::ostringstream ss;
-    ss << file.rdbuf();
+    std::string if_none_match = request.getHeader("If-None-Match");
+    if (if_none_match == "*" || if_none_match.find(etag) != std::string::npos) {
+        response.setStatus(304);
+        return;
+    }
     
-    success = true;
-    return ss.str();
+    response.setStatus(200);
+    response.setHeader("Content-Type", asset.mime);
+    if (gzip) {
+        response.setHeader("Content-Encoding", "gzip");
+        response.setStaticBody(EmbeddedAssets::data() + asset.gzip_offset, asset.gzip_length);
+    } else {
+        response.setStaticBody(EmbeddedAssets::data() + asset.offset, asset.length);
+    }
 }
 
 void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
-    std::string path = HttpRequest::urlDecode(request.getPath());
+    //route on the path alone, handlers read the query string themselves
+    std::string path = request.getCleanPath();
     
     if (path == "/dashboard") {
         handleDashboard(request, response);
@@ -109,6 +238,12 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
     } else if (path == "/files") {
         handleFilesList(request, response);
         return;
+    } else if (path == "/api/files") {
+        handleFilesApi(request, response);
+        return;
+    } else if (path == "/api/submissions") {
+        handleSubmissionsApi(request, response);
+        return;
     } else if (path == "/delete-all") {
         handleDeleteAll(request, response);
         return;
@@ -116,26 +251,21 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
     
     //handle /uploads/ routes - serve from uploads directory
     if (path.find("/uploads/") == 0) {
-        std::string clean_path = path;
-        size_t query_pos = clean_path.find('?');
-        bool force_download = false;
-        
-        if (query_pos != std::string::npos) {
-            std::string query = clean_path.substr(query_pos + 1);
-            clean_path = clean_path.substr(0, query_pos);
-            
-            //check if download=1 is in query
-            if (query.find("download=1") != std::string::npos) {
-                force_download = true;
-            }
-        }
+        bool force_download = request.getQueryParams()["download"] == "1";
         
-        std::string file_path = "." + clean_path;  // ./uploads/filename.ext
+        //the URL space is flat, on disk the name lives in its hash shard. shards only hold
+        //files, so a name with a '/' in it can't resolve to anything
+        std::string name = path.substr(9);  //strip "/uploads/"
+        std::string file_path = UploadCatalog::shardOf(name) + "/" + name;
         
         std::cout << "SERVING UPLOADED FILE " << file_path 
                   << (force_download ? " (download)" : " (view)") << std::endl;
         
-        if (!fileExists(file_path)) {
+        struct stat st;
+        bool not_found;
+        int fd = openFile(uploads_fd, file_path, st, not_found);
+        
+        if (fd < 0 && not_found) {
             std::cout << "FILE NOT FOUND " << file_path << std::endl;
             response.setStatus(404);
             response.setHeader("Content-Type", "text/html");
@@ -145,10 +275,7 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
             return;
         }
         
-        bool success;
-        std::string content = readFile(file_path, success);
-        
-        if (!success) {
+        if (fd < 0) {
             std::cout << "FAILED TO READ FILE " << file_path << std::endl;
             response.setStatus(500);
             response.setHeader("Content-Type", "text/html");
@@ -158,12 +285,12 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
         }
         
         response.setStatus(200);
-        response.setHeader("Content-Type", getContentType(clean_path));
+        response.setHeader("Content-Type", getContentType(path));
         
         //add Content-Disposition header
-        size_t last_slash = clean_path.find_last_of('/');
+        size_t last_slash = path.find_last_of('/');
         std::string filename = (last_slash != std::string::npos) ? 
-                              clean_path.substr(last_slash + 1) : clean_path;
+                              path.substr(last_slash + 1) : path;
         
         if (force_download) {
             //force download
@@ -173,10 +300,10 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
             response.setHeader("Content-Disposition", "inline; filename=\"" + filename + "\"");
         }
         
-        response.setBody(content);
+        setFileResponse(fd, st, response);
         
         std::cout << "SERVED UPLOADED FILE " << file_path 
-                  << " (" << content.length() << " bytes)" << std::endl;
+                  << " (" << st.st_size << " bytes)" << std::endl;
         return;
     }
     
@@ -185,25 +312,13 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
         path = "/index.html";
     }
     
-    //regular file serving from www/
-    std::string file_path = www_root + path;
-    
-    std::cout << "LOOKING FOR FILE " << file_path << std::endl;
+    //an override from www_root first, if there is one
+    std::string file_path = path.substr(1);
+    struct stat st;
+    bool not_found = true;
+    int fd = www_fd >= 0 ? openFile(www_fd, file_path, st, not_found) : -1;
     
-    if (!fileExists(file_path)) {
-        std::cout << "FILE NOT FOUND " << file_path << std::endl;
-        response.setStatus(404);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<!DOCTYPE html><html><body><h1>404 Not Found</h1>"
-                        "<p>The requested resource " + path + " was not found.</p>"
-                        "</body></html>");
-        return;
-    }
-    
-    bool success;
-    std::string content = readFile(file_path, success);
-    
-    if (!success) {
+    if (fd < 0 && !not_found) {
         std::cout << "FAILED TO READ FILE " << file_path << std::endl;
         response.setStatus(500);
         response.setHeader("Content-Type", "text/html");
@@ -212,16 +327,34 @@ void Server::handleGET(const HttpRequest& request, HttpResponse& response) {
         return;
     }
     
-    response.setStatus(200);
-    response.setHeader("Content-Type", getContentType(path));
-    response.setBody(content);
+    if (fd >= 0) {
+        response.setStatus(200);
+        response.setHeader("Content-Type", getContentType(path));
+        setFileResponse(fd, st, response);
+        
+        std::cout << "SERVED FILE: " << www_root << path << " (" << st.st_size << " bytes)" << std::endl;
+        return;
+    }
     
-    std::cout << "SERVED FILE: " << file_path 
-              << " (" << content.length() << " bytes)" << std::endl;
+    //then the copy of www/ built into the binary
+    const EmbeddedAsset* asset = EmbeddedAssets::find(path);
+    if (asset != nullptr) {
+        serveAsset(request, *asset, response);
+        std::cout << "SERVED EMBEDDED: " << path << " (" << response.getHeader("Content-Length")
+                  << " bytes)" << std::endl;
+        return;
+    }
+    
+    std::cout << "FILE NOT FOUND " << file_path << std::endl;
+    response.setStatus(404);
+    response.setHeader("Content-Type", "text/html");
+    response.setBody("<!DOCTYPE html><html><body><h1>404 Not Found</h1>"
+                    "<p>The requested resource " + path + " was not found.</p>"
+                    "</body></html>");
 }
 
 void Server::handlePOST(const HttpRequest& request, HttpResponse& response) {
-    std::string path = HttpRequest::urlDecode(request.getPath());
+    const std::string& path = request.getCleanPath();
     
     std::cout << "POST request to: " << path << std::endl;
     
@@ -233,78 +366,9 @@ void Server::handlePOST(const HttpRequest& request, HttpResponse& response) {
         handleUpload(request, response);
         return;
     } else if (path == "/submit") {
-        //parse form data
-        std::map<std::string, std::string> form_data = 
-            const_cast<HttpRequest&>(request).parseFormData();
-        
-        std::cout << "Form data received:" << std::endl;
-        for (const auto& pair : form_data) {
-            std::cout << "  " << pair.first << " = " << pair.second << std::endl;
-        }
-        
-        if (form_data.empty()) {
-            std::cout << " Warning: No form data received!" << std::endl;
-            std::cout << "Body content: [" << request.getBody() << "]" << std::endl;
-            
-            response.setStatus(400);
-            response.setHeader("Content-Type", "text/html");
-            response.setBody("<!DOCTYPE html><html><head><title>Error</title></head><body>"
-                            "<h1>400 Bad Request</h1>"
-                            "<p>No form data received.</p>"
-                            "<p><a href='/form.html'>Try Again</a></p>"
-                            "</body></html>");
-            return;
-        }
-        
-        std::string log_path = uploads_root + "/submissions.txt";
-        std::ofstream log_file(log_path, std::ios::app);
-        
-        if (log_file.is_open()) {
-            log_file << "NEW SUBMISSION: " << std::endl;
-            for (const auto& pair : form_data) {
-                log_file << pair.first << ": " << pair.second << std::endl;
-            }
-            log_file << std::endl;
-            log_file.close();
-            
-            response.setStatus(200); //success response
-            response.setHeader("Content-Type", "text/html");
-            
-            std::string html = "<!DOCTYPE html><html><head>"
-                              "<title>Success</title>"
-                              "<style>"
-                              "body { font-family: Arial, sans-serif; max-width: 800px; margin: 50px auto; padding: 20px; }"
-                              "h1 { color: #28a745; }"
-                              "ul { background: #f8f9fa; padding: 20px; border-radius: 5px; list-style: none; }"
-                              "li { margin: 10px 0; padding: 10px; background: white; border-radius: 3px; }"
-                              "strong { color: #007bff; }"
-                              "a { display: inline-block; margin-top: 20px; color: #007bff; text-decoration: none; }"
-                              "</style>"
-                              "</head><body>"
-                              "<h1>Form Submitted Successfully!</h1>"
-                              "<h2>Received Data:</h2>"
-                              "<ul>";
-            
-            for (const auto& pair : form_data) {
-                html += "<li><strong>" + pair.first + ":</strong> " + pair.second + "</li>";
-            }
-            
-            html += "</ul>"
-                   "<p><a href='/form.html'>Submit Another</a> | "
-                   "<a href='/'>Back to Home</a></p>"
-                   "</body></html>";
-            
-            response.setBody(html);
-            
-            std::cout << "Form data saved to " << log_path << std::endl;
-        } else {
-            response.setStatus(500);
-            response.setHeader("Content-Type", "text/html");
-            response.setBody("<!DOCTYPE html><html><head><title>Error</title></head><body>"
-                            "<h1>500 Internal Server Error</h1>"
-                            "<p>Could not save submission.</p>"
-                            "</body></html>");
-        }
+        handleSubmit(request, response);
+    } else if (path == "/api/files/delete") {
+        handleDeleteBatch(request, response);
     } else {
         //unknown POST endpoint
         response.setStatus(404);
@@ -318,7 +382,7 @@ void Server::handlePOST(const HttpRequest& request, HttpResponse& response) {
 }
 
 void Server::handleDELETE(const HttpRequest& request, HttpResponse& response) {
-    std::string path = HttpRequest::urlDecode(request.getPath());
+    const std::string& path = request.getCleanPath();
     
     std::cout << "DELETE request for: " << path << std::endl;
     
@@ -334,50 +398,372 @@ void Server::handleDELETE(const HttpRequest& request, HttpResponse& response) {
         return;
     }
     
-    //build full file path (relative to project root, not www)
-    std::string file_path = "." + path;  // ./uploads/filename.txt
+    //build full file path (the upload's hash shard under uploads_root)
+    std::string name = path.substr(9);  //strip "/uploads/"
+    std::string file_path = catalog.pathOf(name);
     
     std::cout << "Attempting to delete: " << file_path << std::endl;
     
-    if (!fileExists(file_path)) {
-        std::cout << "File not found: " << file_path << std::endl;
-        response.setStatus(404);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<html><body><h1>404 Not Found</h1>"
-                        "<p>File not found: " + path + "</p>"
-                        "</body></html>");
-        return;
+    //the unlink (and dropping the stored contents if no other name shares them) runs on the
+    //blocking pool; the catalog is updated back on the loop
+    catalog.sync();
+    const UploadEntry* entry = catalog.find(name);
+    bool listed = entry != nullptr;
+    uint64_t hash = listed ? entry->hash : 0;
+    uint64_t size = listed ? entry->size : 0;
+    catalog.reserveChange(name);
+    
+    auto error = std::make_shared<int>(0);
+    auto removed = std::make_shared<struct stat>();
+    response.defer([this, file_path, listed, hash, size, error, removed]() {
+        if (lstat(file_path.c_str(), removed.get()) != 0 || unlink(file_path.c_str()) != 0) {
+            *error = errno;
+        } else if (listed) {
+            store.release(hash, size);
+        }
+    }, [this, name, path, file_path, error, removed](HttpResponse& response) {
+        catalog.release(name);
+        if (*error == 0) {
+            file_cache.forget(removed->st_dev, removed->st_ino);
+        }
+        
+        if (*error == ENOENT || *error == ENOTDIR || *error == EISDIR) {
+            std::cout << "File not found: " << file_path << std::endl;
+            response.setStatus(404);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body><h1>404 Not Found</h1>"
+                            "<p>File not found: " + path + "</p>"
+                            "</body></html>");
+        } else if (*error == 0) {
+            catalog.recordRemove(name);
+            std::cout << " File deleted: " << file_path << std::endl;
+            
+            response.setStatus(200);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body>"
+                            "<h1> File Deleted</h1>"
+                            "<p>Successfully deleted: " + path + "</p>"
+                            "<p><a href='/'> Back to Home</a></p>"
+                            "</body></html>");
+        } else {
+            std::cout << " Failed to delete: " << file_path << std::endl;
+            
+            response.setStatus(500);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body><h1>500 Internal Server Error</h1>"
+                            "<p>Failed to delete file: " + path + "</p>"
+                            "</body></html>");
+        }
+    });
+}
+
+//POST /api/files/delete, one upload name per line: removes them all in one request and one
+//blocking-pool job. answers {"deleted":[...],"not_found":[...],"failed":[...]}
+void Server::handleDeleteBatch(const HttpRequest& request, HttpResponse& response) {
+    struct PendingRemove {
+        std::string name;
+        std::string path;
+        bool listed;
+        uint64_t hash;
+        uint64_t size;
+        int error;
+        struct stat removed;
+    };
+    auto pending = std::make_shared<std::vector<PendingRemove>>();
+    std::vector<std::string> not_found;     //names that can't be uploads
+    std::set<std::string> seen;
+    
+    catalog.sync();
+    std::istringstream lines(request.getBody());
+    std::string name;
+    while (std::getline(lines, name)) {
+        if (!name.empty() && name.back() == '\r') {
+            name.pop_back();
+        }
+        if (name.empty() || !seen.insert(name).second) {
+            continue;
+        }
+        if (name.find('/') != std::string::npos || !UploadCatalog::isListed(name)) {
+            not_found.push_back(name);
+            continue;
+        }
+        
+        const UploadEntry* entry = catalog.find(name);
+        pending->push_back(PendingRemove{name, catalog.pathOf(name), entry != nullptr,
+                                         entry ? entry->hash : 0, entry ? entry->size : 0, 0, {}});
+        catalog.reserveChange(name);
     }
     
-    if (std::remove(file_path.c_str()) == 0) {
-        std::cout << " File deleted: " << file_path << std::endl;
+    std::cout << "BATCH DELETE: " << pending->size() + not_found.size() << " names" << std::endl;
+    
+    response.defer([this, pending]() {
+        for (auto& file : *pending) {
+            if (lstat(file.path.c_str(), &file.removed) != 0 || unlink(file.path.c_str()) != 0) {
+                file.error = errno;
+            } else if (file.listed) {
+                store.release(file.hash, file.size);
+            }
+        }
+    }, [this, pending, not_found](HttpResponse& response) {
+        std::vector<const std::string*> deleted;
+        std::vector<const std::string*> missing;
+        std::vector<const std::string*> failed;
+        for (const std::string& name : not_found) {
+            missing.push_back(&name);
+        }
+        
+        for (const auto& file : *pending) {
+            catalog.release(file.name);
+            if (file.error == 0) {
+                catalog.recordRemove(file.name);
+                file_cache.forget(file.removed.st_dev, file.removed.st_ino);
+                deleted.push_back(&file.name);
+            } else if (file.error == ENOENT || file.error == ENOTDIR || file.error == EISDIR) {
+                missing.push_back(&file.name);
+            } else {
+                failed.push_back(&file.name);
+            }
+        }
+        std::cout << "DELETED " << deleted.size() << " files, " << missing.size() << " not found, "
+                  << failed.size() << " failed" << std::endl;
+        
+        std::string body;
+        JsonWriter json(body);
+        json.beginObject();
+        const char* keys[] = {"deleted", "not_found", "failed"};
+        const std::vector<const std::string*>* lists[] = {&deleted, &missing, &failed};
+        for (int i = 0; i < 3; i++) {
+            json.key(keys[i]).beginArray();
+            for (const std::string* name : *lists[i]) {
+                json.value(*name);
+            }
+            json.endArray();
+        }
+        json.endObject();
         
         response.setStatus(200);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<html><body>"
-                        "<h1> File Deleted</h1>"
-                        "<p>Successfully deleted: " + path + "</p>"
-                        "<p><a href='/'> Back to Home</a></p>"
-                        "</body></html>");
-    } else {
-        std::cout << " Failed to delete: " << file_path << std::endl;
+        response.setHeader("Content-Type", "application/json");
+        response.setHeader("Cache-Control", "no-store");
+        response.setBody(std::move(body));
+    });
+}
+
+static void setJsonError(HttpResponse& response, int status, const std::string& message) {
+    std::string body;
+    JsonWriter(body).beginObject().key("error").value(message).endObject();
+    response.setStatus(status);
+    response.setHeader("Content-Type", "application/json");
+    response.setBody(std::move(body));
+}
+
+static void setRefusal(HttpResponse& response, int status, bool json, const std::string& message) {
+    if (json) {
+        setJsonError(response, status, message);
+        return;
+    }
+    response.setStatus(status);
+    response.setHeader("Content-Type", "text/html");
+    response.setBody("<html><body><h1>" + std::to_string(status) + " " +
+                     HttpResponse::getStatusMessage(status) + "</h1><p>" + message + "</p></body></html>");
+}
+
+//called with just the headers of a request that has a body, before any of the body is read:
+//anything that would be turned away anyway is refused now, so a client sending a huge body
+//to the wrong place (or too much of it) isn't made to upload all of it first
+bool Server::admitRequest(const HttpRequest& request, uint64_t length, HttpResponse& response) {
+    std::string method = request.getMethod();
+    const std::string& path = request.getCleanPath();
+    
+    //automation PUTs get JSON errors, browser forms an HTML page
+    bool json = method == "PUT";
+    uint64_t limit = config.max_form_body;
+    bool stored = false;    //ends up on disk under uploads_root
+    
+    if (path.empty()) {
+        setRefusal(response, 403, json, "path traversal attempt detected");
+        return false;
+    }
+    
+    if (method == "PUT") {
+        //the URL space is flat, and dotfiles/submissions.txt belong to the server
+        std::string name = path.compare(0, 9, "/uploads/") == 0 ? path.substr(9) : "";
+        if (name.empty()) {
+            setRefusal(response, 403, json, "can only PUT to /uploads/<name>");
+            return false;
+        }
+        if (name.find('/') != std::string::npos || !UploadCatalog::isListed(name)) {
+            setRefusal(response, 400, json, "invalid upload name");
+            return false;
+        }
+        if (request.getHeader("content-length").empty()) {
+            setRefusal(response, 411, json, "Content-Length required");
+            return false;
+        }
+        limit = config.max_put_body;
+        stored = true;
+    } else if (method == "POST") {
+        if (path == "/upload") {
+            limit = config.max_upload_body;    //multipart bodies are parsed in memory
+            stored = true;
+        } else if (path != "/login" && path != "/submit" && path != "/api/files/delete") {
+            setRefusal(response, 404, json, "POST endpoint " + path + " not found");
+            return false;
+        }
+    } else if (method != "GET" && method != "HEAD" && method != "DELETE") {
+        setRefusal(response, 501, json, "method " + method + " is not supported");
+        return false;
+    }
+    
+    if (length > limit) {
+        std::cout << "REJECTED: " << method << " " << path << ", " << length << " byte body" << std::endl;
+        setRefusal(response, 413, json, "request body over the " + std::to_string(limit) + " byte limit");
+        return false;
+    }
+    
+    //quota: don't take in what can't be stored
+    struct statvfs fs;
+    if (stored && statvfs(uploads_root.c_str(), &fs) == 0 &&
+        length > (uint64_t)fs.f_bavail * fs.f_frsize) {
+        std::cout << "REJECTED: " << method << " " << path << ", " << length
+                  << " bytes won't fit in " << uploads_root << std::endl;
+        setRefusal(response, 507, json, "not enough space for " + std::to_string(length) + " bytes");
+        return false;
+    }
+    
+    return true;
+}
+
+//PUT /uploads/<name>: raw body, no multipart. the connection moves it into upload.fd with
+//splice() where the backend can, so large artifacts never get copied through userspace.
+//admitRequest() has already vetted the name and length
+bool Server::beginPut(const HttpRequest& request, uint64_t length, PutUpload& upload,
+                      HttpResponse& response) {
+    const std::string& path = request.getCleanPath();
+    std::string name = path.substr(9);  //strip "/uploads/"
+    
+    std::cout << "\n Handling: PUT " << path << " (" << length << " bytes)" << std::endl;
+    
+    upload.fd = store.openIncoming(length, upload.temp_path);
+    if (upload.fd < 0) {
+        std::cout << "FAILED TO SAVE: " << name << ": " << strerror(errno) << std::endl;
+        if (errno == ENOSPC || errno == EFBIG || errno == EDQUOT) {
+            setJsonError(response, 507, "not enough space for " + std::to_string(length) + " bytes");
+        } else {
+            setJsonError(response, 500, "could not create the upload file");
+        }
+        return false;
+    }
+    
+    upload.name = name;
+    upload.length = length;
+    std::cout << "RECEIVING: " << name << " -> " << upload.temp_path << std::endl;
+    return true;
+}
+
+//the whole body is in the temp file: hash it (mapped, not read), then rename/link it into place.
+//both happen on the blocking pool; from here on the upload belongs to that job, not the connection
+void Server::finishPut(PutUpload& upload, HttpResponse& response) {
+    catalog.sync();
+    const UploadEntry* existing = catalog.find(upload.name);
+    bool replaced = existing != nullptr;
+    uint64_t old_hash = existing ? existing->hash : 0;
+    uint64_t old_size = existing ? existing->size : 0;
+    catalog.reserveChange(upload.name);
+    
+    struct Result {
+        ContentDigest digest;
+        bool deduplicated = false;
+        const char* error = nullptr;
+    };
+    auto result = std::make_shared<Result>();
+    PutUpload job = upload;
+    std::string path = catalog.pathOf(upload.name);
+    upload.fd = -1;
+    
+    response.defer([this, job, path, replaced, old_hash, old_size, result]() {
+        const char* data = "";
+        void* mapping = MAP_FAILED;
+        if (job.length > 0) {
+            mapping = mmap(nullptr, job.length, PROT_READ, MAP_SHARED, job.fd, 0);
+            if (mapping == MAP_FAILED) {
+                result->error = "could not read back the upload";
+            } else {
+                data = static_cast<const char*>(mapping);
+            }
+        }
         
-        response.setStatus(500);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<html><body><h1>500 Internal Server Error</h1>"
-                        "<p>Failed to delete file: " + path + "</p>"
-                        "</body></html>");
+        if (result->error == nullptr) {
+            result->digest = ContentDigest::of(data, job.length, upload_sha256);
+            
+            //unlike POST, PUT names the target, so a different file under that name is replaced
+            if (!store.adopt(job.temp_path, data, result->digest, path, result->deduplicated)) {
+                result->error = "could not store the upload";
+            } else if (replaced && (old_hash != result->digest.hash || old_size != result->digest.size)) {
+                store.release(old_hash, old_size);
+            }
+        }
+        
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, job.length);
+        }
+        close(job.fd);
+        if (result->error != nullptr) {
+            unlink(job.temp_path.c_str());
+        }
+    }, [this, job, replaced, result](HttpResponse& response) {
+        catalog.release(job.name);
+        
+        if (result->error != nullptr) {
+            std::cout << "FAILED TO SAVE: " << job.name << ": " << result->error << std::endl;
+            setJsonError(response, 500, result->error);
+            return;
+        }
+        
+        const ContentDigest& digest = result->digest;
+        catalog.recordWrite(job.name, digest);
+        
+        std::cout << (result->deduplicated ? "DEDUPLICATED: " : "SAVED: ") << job.name
+                  << " (" << job.length << " bytes)" << std::endl;
+        
+        std::string body;
+        JsonWriter json(body);
+        json.beginObject()
+            .key("name").value(job.name)
+            .key("size").value(digest.size)
+            .key("hash").value(Hash64::toHex(digest.hash));
+        if (!digest.sha256.empty()) {
+            json.key("sha256").value(digest.sha256);
+        }
+        json.key("deduplicated").value(result->deduplicated).endObject();
+        
+        response.setStatus(replaced ? 200 : 201);
+        response.setHeader("Content-Type", "application/json");
+        response.setHeader("Location", "/uploads/" + HttpRequest::urlEncode(job.name));
+        response.setBody(std::move(body));
+    });
+}
+
+//the body never completed (client went away, write failed): drop the partial file
+void Server::abortPut(PutUpload& upload) {
+    if (upload.fd == -1) {
+        return;
     }
+    
+    std::cout << "UPLOAD ABORTED: " << upload.name << std::endl;
+    close(upload.fd);
+    unlink(upload.temp_path.c_str());
+    upload.fd = -1;
 }
 
 void Server::handleRequest(const HttpRequest& request, HttpResponse& response) {
     std::string method = request.getMethod();
-    std::string path = HttpRequest::urlDecode(request.getPath());
+    const std::string& path = request.getCleanPath();
     
-    std::cout << "\n Handling: " << method << " " << path << std::endl;
+    std::cout << "\n Handling: " << method << " " << request.getPath() << std::endl;
     
-    if (!isPathSafe(path)) {
-        std::cout << " BLOCKED: Path traversal attempt in: " << path << std::endl;
+    //only the path names files, the query string (e.g. a listing cursor) may hold anything
+    if (path.empty()) {
+        std::cout << " BLOCKED: Path traversal attempt in: " << request.getPath() << std::endl;
         response.setStatus(403);
         response.setHeader("Content-Type", "text/html");
         response.setBody("<html><body><h1>403 Forbidden</h1>"
@@ -419,12 +805,10 @@ std::string Server::generateSessionId() {
 }
 
 void Server::handleLogin(const HttpRequest& request, HttpResponse& response) {
-    //parse form data
-    std::map<std::string, std::string> form_data = 
-        const_cast<HttpRequest&>(request).parseFormData();
+    const FieldList& form_data = request.getFormData();
     
-    std::string username = form_data["username"];
-    std::string password = form_data["password"];
+    std::string username(form_data.get("username"));
+    std::string password(form_data.get("password"));
     
     std::cout << "Login attempt: username=" << username << std::endl;
     
@@ -442,6 +826,7 @@ void Server::handleLogin(const HttpRequest& request, HttpResponse& response) {
     std::string session_id = generateSessionId();
     
     sessions[session_id] = username;
+    sessions_version++;
     
     std::cout << "Login successful. Session ID: " << session_id << std::endl;
     std::cout << "  Active sessions: " << sessions.size() << std::endl;
@@ -456,9 +841,32 @@ void Server::handleLogin(const HttpRequest& request, HttpResponse& response) {
     response.setBody("<html><body>Redirecting to dashboard...</body></html>");
 }
 
+//a generated page, or a 500 when its template didn't load
+static void renderPage(const Template& page, const TemplateData& data, HttpResponse& response) {
+    response.setHeader("Content-Type", "text/html");
+    if (!page.isLoaded()) {
+        response.setStatus(500);
+        response.setBody("<!DOCTYPE html><html><body><h1>500 Error</h1>"
+                         "<p>This page's template is missing.</p></body></html>");
+        return;
+    }
+    
+    std::string html;
+    page.render(data, html);
+    response.setStatus(200);
+    response.setBody(std::move(html));
+}
+
+//a page out of page_cache, sent straight from the cached string
+static void sendCachedPage(const std::shared_ptr<const std::string>& page, HttpResponse& response) {
+    response.setStatus(200);
+    response.setHeader("Content-Type", "text/html");
+    response.setStaticBody(page->data(), page->size(), page);
+}
+
 void Server::handleDashboard(const HttpRequest& request, HttpResponse& response) {
-    std::string session_id = request.getCookie("session_id");
-    std::string username = request.getCookie("username");
+    std::string session_id(request.getCookie("session_id"));
+    std::string username(request.getCookie("username"));
     
     std::cout << "Dashboard access attempt:" << std::endl;
     std::cout << "  Session ID: " << (session_id.empty() ? "(none)" : session_id) << std::endl;
@@ -476,56 +884,33 @@ void Server::handleDashboard(const HttpRequest& request, HttpResponse& response)
     
     std::cout << "  Valid session found" << std::endl;
     
-    response.setStatus(200); 
-    response.setHeader("Content-Type", "text/html");
-    
-    std::string html = "<!DOCTYPE html><html><head><title>Dashboard</title>"
-                      "<link rel='stylesheet' href='/style.css'>"
-                      "<style>"
-                      ".dashboard { max-width: 800px; margin: 50px auto; padding: 20px; }"
-                      ".welcome { background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); "
-                      "color: white; padding: 30px; border-radius: 8px; margin-bottom: 20px; }"
-                      ".info-box { background: #f8f9fa; padding: 20px; border-radius: 8px; margin-bottom: 20px; }"
-                      ".logout-btn { background-color: #dc3545; color: white; padding: 10px 20px; "
-                      "text-decoration: none; border-radius: 4px; display: inline-block; }"
-                      ".logout-btn:hover { background-color: #c82333; }"
-                      "</style>"
-                      "</head><body>"
-                      "<div class='dashboard'>"
-                      "<div class='welcome'>"
-                      "<h1> Welcome, " + username + "!</h1>"
-                      "<p>You are successfully logged in.</p>"
-                      "</div>"
-                      "<div class='info-box'>"
-                      "<h2>Session Information</h2>"
-                      "<ul>"
-                      "<li><strong>Username:</strong> " + username + "</li>"
-                      "<li><strong>Session ID:</strong> " + session_id + "</li>"
-                      "<li><strong>Active Sessions:</strong> " + std::to_string(sessions.size()) + "</li>"
-                      "</ul>"
-                      "</div>"
-                      "<div class='info-box'>"
-                      "<h2>Your Cookies</h2>"
-                      "<p>Your browser is storing these cookies:</p>"
-                      "<ul>"
-                      "<li><strong>session_id:</strong> " + session_id + "</li>"
-                      "<li><strong>username:</strong> " + username + "</li>"
-                      "</ul>"
-                      "</div>"
-                      "<p><a href='/logout' class='logout-btn'>Logout</a></p>"
-                      "<p><a href='/'> Back to Home</a></p>"
-                      "</div>"
-                      "</body></html>";
-    
-    response.setBody(html);
+    //the page shows the session count, so any login or logout makes every copy stale
+    std::string key = "dashboard\n" + session_id + "\n" + username;
+    std::shared_ptr<const std::string> page = page_cache.find(key, sessions_version);
+    if (!page) {
+        TemplateData data;
+        data.set("username", username)
+            .set("session_id", session_id)
+            .set("active_sessions", std::to_string(sessions.size()));
+        if (!dashboard_page.isLoaded()) {
+            renderPage(dashboard_page, data, response);
+            return;
+        }
+        std::string html;
+        dashboard_page.render(data, html);
+        page = page_cache.store(key, sessions_version, std::move(html));
+    }
+    sendCachedPage(page, response);
 }
 
 void Server::handleLogout(const HttpRequest& request, HttpResponse& response) {
-    std::string session_id = request.getCookie("session_id");
+    std::string_view session_id = request.getCookie("session_id");
     
-    if (!session_id.empty()) {
+    auto session = sessions.find(session_id);
+    if (session != sessions.end()) {
         //remove session
-        sessions.erase(session_id);
+        sessions.erase(session);
+        sessions_version++;
         std::cout << "Logged out session: " << session_id << std::endl;
     }
     
@@ -543,11 +928,8 @@ void Server::handleUpload(const HttpRequest& request, HttpResponse& response) {
     std::cout << "PROCESSING FILE UPLOAD..." << std::endl;
     
     //parse multipart form data
-    std::vector<UploadedFile> files;
-    std::map<std::string, std::string> form_fields = 
-        const_cast<HttpRequest&>(request).parseMultipartFormData(files);
-    
-    std::string description = form_fields["description"];
+    const std::vector<UploadedFile>& files = request.getUploadedFiles();
+    std::string description(request.getMultipartFields().get("description"));
     
     if (files.empty()) {
         std::cout << "NO FILES UPLOADED" << std::endl;
@@ -561,12 +943,15 @@ void Server::handleUpload(const HttpRequest& request, HttpResponse& response) {
         return;
     }
     
-    //FOR EACH uploaded file
-    std::vector<std::string> saved_files;
+    //names are picked here on the loop (they depend on the catalog), the writes happen on the
+    //blocking pool or the backend's ring, and the catalog hears about them back on the loop
+    PendingUploads pending = std::make_shared<std::vector<PendingUpload>>();
+    catalog.sync();  //chooseUploadName goes by what the catalog says each name holds
     
+    //FOR EACH uploaded file
     for (const auto& file : files) {
         //create safe filename (prevent path traversal)
-        std::string safe_filename = file.filename;
+        std::string safe_filename(file.filename);
         
         //remove any path components
         size_t last_slash = safe_filename.find_last_of("/\\");
@@ -574,257 +959,582 @@ void Server::handleUpload(const HttpRequest& request, HttpResponse& response) {
             safe_filename = safe_filename.substr(last_slash + 1);
         }
         
-        //build full path
-        std::string file_path = uploads_root + "/" + safe_filename;
+        if (safe_filename.empty()) {
+            std::cout << "FAILED TO SAVE: upload without a filename" << std::endl;
+            continue;
+        }
+        //same rule as PUT: dotfiles and submissions.txt belong to the server, and the
+        //catalog (which chooseUploadName goes by) doesn't track them
+        if (!UploadCatalog::isListed(safe_filename)) {
+            std::cout << "FAILED TO SAVE: invalid upload name " << safe_filename << std::endl;
+            continue;
+        }
         
-        std::cout << "SAVING TO: " << file_path << std::endl;
+        //hash once up front: it's both the dedup key and how we tell same-name uploads apart
+        PendingUpload upload;
+        upload.digest = ContentDigest::of(file.content.data(), file.content.length(), upload_sha256);
+        upload.name = chooseUploadName(safe_filename, upload.digest);
+        upload.path = catalog.pathOf(upload.name);
+        upload.content.assign(file.content);   //the request is gone by the time the pool gets to it
+        catalog.reserveWrite(upload.name, upload.digest);
         
-        //write file
-        std::ofstream out_file(file_path, std::ios::binary);
-        if (out_file.is_open()) {
-            out_file.write(file.content.c_str(), file.content.length());
-            out_file.close();
+        std::cout << "SAVING TO: " << upload.path << std::endl;
+        pending->push_back(std::move(upload));
+    }
+    
+    auto done = [this, pending, description](HttpResponse& response) {
+        TemplateData data;
+        data.set("description", description);
+        std::vector<TemplateData>& saved_files = data.rows("files");
+        for (const auto& upload : *pending) {
+            catalog.release(upload.name);
+            if (!upload.saved) {
+                std::cout << "FAILED TO SAVE: " << upload.name << std::endl;
+                continue;
+            }
             
-            saved_files.push_back(safe_filename);
-            std::cout << "SAVED: " << safe_filename 
-                      << " (" << file.content.length() << " bytes)" << std::endl;
-        } else {
-            std::cout << "FAILED TO SAVE: " << safe_filename << std::endl;
+            catalog.recordWrite(upload.name, upload.digest);
+            saved_files.emplace_back();
+            saved_files.back().set("name", upload.name).set("url", HttpRequest::urlEncode(upload.name));
+            std::cout << (upload.deduplicated ? "DEDUPLICATED: " : "SAVED: ") << upload.name
+                      << " (" << upload.digest.size << " bytes)" << std::endl;
         }
+        
+        if (saved_files.empty()) {
+            response.setStatus(500);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<!DOCTYPE html><html><body><h1>500 Error</h1>"
+                            "<p>Failed to save file.</p></body></html>");
+            return;
+        }
+        renderPage(upload_page, data, response);
+    };
+    
+    if (file_writer) {
+        response.deferUntil([this, pending](std::function<void()> finish) {
+            saveUploads(pending, 0, finish);
+        }, done);
+        return;
     }
     
-    //success response
-    if (!saved_files.empty()) {
-        response.setStatus(200);
+    response.defer([this, pending]() {
+        //stored once under its content hash, the name is a link to it
+        for (auto& upload : *pending) {
+            upload.saved = store.save(upload.path, upload.content, upload.digest, upload.deduplicated);
+            upload.content = std::string();    //don't hold the body until the response is sent
+        }
+    }, done);
+}
+
+void Server::runOnPool(BlockingPool::Job work, BlockingPool::Job done) {
+    if (!pool.submit(work, done)) {
+        //pool backed up: do it here rather than queue without bound
+        work();
+        done();
+    }
+}
+
+//with a file writer, one upload after another: the pool looks for a stored copy and opens a
+//temp file, the backend writes the body into it, and the pool moves it into the store
+void Server::saveUploads(PendingUploads pending, size_t index, std::function<void()> finish) {
+    if (index == pending->size()) {
+        finish();
+        return;
+    }
+    
+    runOnPool([this, pending, index]() {
+        PendingUpload& upload = (*pending)[index];
+        if (store.linkDuplicate(upload.path, upload.content.data(), upload.digest)) {
+            upload.saved = upload.deduplicated = true;
+            return;
+        }
+        upload.fd = store.openIncoming(upload.content.length(), upload.temp_path);
+    }, [this, pending, index, finish]() {
+        PendingUpload& upload = (*pending)[index];
+        if (upload.fd == -1) {
+            upload.content = std::string();
+            saveUploads(pending, index + 1, finish);
+            return;
+        }
+        writeUpload(pending, index, finish);
+    });
+}
+
+void Server::writeUpload(PendingUploads pending, size_t index, std::function<void()> finish) {
+    PendingUpload& upload = (*pending)[index];
+    if (upload.written < upload.content.length()) {
+        file_writer(upload.fd, upload.content.data() + upload.written, upload.content.length() - upload.written,
+                    upload.written, [this, pending, index, finish](ssize_t result) {
+            PendingUpload& upload = (*pending)[index];
+            if (result > 0) {
+                upload.written += result;
+                writeUpload(pending, index, finish);
+                return;
+            }
+            std::cerr << "ERROR: Failed to write " << upload.temp_path << ": "
+                      << (result < 0 ? strerror(-result) : "no progress") << std::endl;
+            close(upload.fd);
+            upload.fd = -1;
+            runOnPool([pending, index]() {
+                PendingUpload& upload = (*pending)[index];
+                unlink(upload.temp_path.c_str());
+                upload.content = std::string();
+            }, [this, pending, index, finish]() {
+                saveUploads(pending, index + 1, finish);
+            });
+        });
+        return;
+    }
+    
+    close(upload.fd);
+    upload.fd = -1;
+    runOnPool([this, pending, index]() {
+        PendingUpload& upload = (*pending)[index];
+        upload.saved = store.adopt(upload.temp_path, upload.content.data(), upload.digest, upload.path,
+                                   upload.deduplicated);
+        upload.content = std::string();
+    }, [this, pending, index, finish]() {
+        saveUploads(pending, index + 1, finish);
+    });
+}
+
+void Server::handleSubmit(const HttpRequest& request, HttpResponse& response) {
+    const FieldList& form_data = request.getFormData();
+    
+    std::cout << "Form data received:" << std::endl;
+    for (const auto& pair : form_data) {
+        std::cout << "  " << pair.first << " = " << pair.second << std::endl;
+    }
+    
+    if (form_data.empty()) {
+        std::cout << " Warning: No form data received!" << std::endl;
+        std::cout << "Body content: [" << request.getBody() << "]" << std::endl;
+        
+        response.setStatus(400);
         response.setHeader("Content-Type", "text/html");
+        response.setBody("<!DOCTYPE html><html><head><title>Error</title></head><body>"
+                        "<h1>400 Bad Request</h1>"
+                        "<p>No form data received.</p>"
+                        "<p><a href='/form.html'>Try Again</a></p>"
+                        "</body></html>");
+        return;
+    }
+    
+    Submission submission;
+    submission.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (const auto& pair : form_data) {
+        submission.fields.emplace_back(std::string(pair.first), std::string(pair.second));
+    }
+    
+    //the log's writer batches this with everyone else's; the page goes out once it's on disk
+    auto saved = std::make_shared<bool>(false);
+    response.deferUntil([this, submission, saved](std::function<void()> finish) {
+        submissions.append(submission, [saved, finish](bool ok) {
+            *saved = ok;
+            finish();
+        });
+    }, [this, submission, saved](HttpResponse& response) {
+        if (!*saved) {
+            response.setStatus(500);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<!DOCTYPE html><html><head><title>Error</title></head><body>"
+                            "<h1>500 Internal Server Error</h1>"
+                            "<p>Could not save submission.</p>"
+                            "</body></html>");
+            return;
+        }
         
-        std::string html = "<!DOCTYPE html><html><head><title>Upload Success</title>"
-                          "<style>"
-                          "body { font-family: Arial; max-width: 800px; margin: 50px auto; padding: 20px; }"
-                          "h1 { color: #28a745; }"
-                          ".file-list { background: #f8f9fa; padding: 20px; border-radius: 5px; }"
-                          ".file-item { background: white; margin: 10px 0; padding: 15px; border-radius: 3px; }"
-                          "a { color: #007bff; text-decoration: none; }"
-                          "</style>"
-                          "</head><body>"
-                          "<h1>Upload Successful!</h1>";
+        TemplateData data;
+        std::vector<TemplateData>& fields = data.rows("fields");
+        for (const auto& pair : submission.fields) {
+            fields.emplace_back();
+            fields.back().set("name", pair.first).set("value", pair.second);
+        }
+        renderPage(submit_page, data, response);
         
-        if (!description.empty()) {
-            html += "<p><strong>Description:</strong> " + description + "</p>";
+        std::cout << "Form data saved" << std::endl;
+    });
+}
+
+//GET /api/submissions?cursor=&limit=&field=&value= for logged-in users: the submissions log,
+//oldest first, optionally only those whose field equals value
+void Server::handleSubmissionsApi(const HttpRequest& request, HttpResponse& response) {
+    std::string_view session_id = request.getCookie("session_id");
+    if (session_id.empty() || sessions.find(session_id) == sessions.end()) {
+        setJsonError(response, 401, "login required");
+        return;
+    }
+    
+    std::map<std::string, std::string> query = request.getQueryParams();
+    long limit = query.count("limit") ? std::strtol(query["limit"].c_str(), nullptr, 10) : 100;
+    if (limit < 1 || limit > 1000 || query["field"].empty() != query["value"].empty()) {
+        setJsonError(response, 400, "limit 1-1000, field and value go together");
+        return;
+    }
+    
+    uint64_t cursor = std::strtoull(query["cursor"].c_str(), nullptr, 10);
+    std::string field = query["field"];
+    std::string value = query["value"];
+    std::string log_path = uploads_root + "/.submissions";
+    
+    //reading the log is disk work
+    struct Result {
+        std::vector<Submission> found;
+        uint64_t next_cursor = 0;
+        bool ok = false;
+    };
+    auto result = std::make_shared<Result>();
+    response.defer([log_path, cursor, limit, field, value, result]() {
+        result->ok = SubmissionLog::query(log_path, cursor, limit, field, value,
+                                          result->found, result->next_cursor);
+    }, [result](HttpResponse& response) {
+        if (!result->ok) {
+            setJsonError(response, 500, "could not read the submissions log");
+            return;
         }
         
-        html += "<div class='file-list'><h2>Uploaded Files:</h2>";
+        std::string body;
+        JsonWriter json(body);
+        json.beginObject().key("submissions").beginArray();
+        for (const Submission& submission : result->found) {
+            json.beginObject()
+                .key("time").value(submission.time_ms / 1000)
+                .key("fields").beginObject();
+            for (const auto& field : submission.fields) {
+                json.key(field.first).value(field.second);
+            }
+            json.endObject().endObject();
+        }
+        json.endArray().key("next_cursor");
+        if (result->next_cursor == 0) {
+            json.null();
+        } else {
+            json.value(std::to_string(result->next_cursor));
+        }
+        json.endObject();
         
-        for (const auto& filename : saved_files) {
-            std::string encoded_filename = HttpRequest::urlEncode(filename);
-            html += "<div class='file-item'>"
-                   "<strong>" + filename + "</strong><br>"
-                   "<a href='/uploads/" + encoded_filename + "?download=1'>Download</a> | "
-                   "<a href='/uploads/" + encoded_filename + "' target='_blank'>View</a>"
-                   "</div>";
+        response.setStatus(200);
+        response.setHeader("Content-Type", "application/json");
+        response.setHeader("Cache-Control", "no-store");
+        response.setBody(std::move(body));
+    });
+}
+
+//"name", "size" or "mtime", with a leading '-' for descending; empty means by name
+bool Server::parseSort(const std::string& value, UploadCatalog::SortKey& sort, bool& descending) {
+    descending = !value.empty() && value[0] == '-';
+    std::string key = descending ? value.substr(1) : value;
+    
+    if (key.empty() || key == "name") {
+        sort = UploadCatalog::SORT_NAME;
+    } else if (key == "size") {
+        sort = UploadCatalog::SORT_SIZE;
+    } else if (key == "mtime") {
+        sort = UploadCatalog::SORT_MTIME;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//the file cards for one page of the listing, as rows of files.html's {{#files}}
+static void addFileCards(std::vector<TemplateData>& cards, const std::vector<const UploadEntry*>& files) {
+    for (const UploadEntry* file : files) {
+        const std::string& filename = file->name;
+        
+        // Get file extension for icon (using text labels instead of emojis)
+        std::string icon = "[FILE]";
+        std::string ext = filename.substr(filename.find_last_of(".") + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        
+        if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "gif") {
+            icon = "[IMG]";
+        } else if (ext == "pdf") {
+            icon = "[PDF]";
+        } else if (ext == "txt") {
+            icon = "[TXT]";
+        } else if (ext == "zip" || ext == "rar") {
+            icon = "[ZIP]";
         }
         
-        html += "</div>"
-               "<p style='margin-top: 20px;'>"
-               "<a href='/upload.html'>Upload Another</a> | "
-               "<a href='/files'>View All Files</a> | "
-               "<a href='/'>Home</a>"
-               "</p></body></html>";
+        cards.emplace_back();
+        cards.back().set("icon", icon).set("name", filename).set("url", HttpRequest::urlEncode(filename));
+    }
+}
+
+//the name to store an upload under: its own name, unless a different file already has it,
+//then "name (1).ext", "name (2).ext", ... so uploads never silently replace each other.
+//re-uploading the same bytes under the same name just lands on the existing entry.
+//decided from the catalog and its reservations alone, no filesystem calls on the loop:
+//after sync() it knows every listed name in the shards, and name is always a listed one
+std::string Server::chooseUploadName(const std::string& name, const ContentDigest& digest) {
+    size_t dot = name.find_last_of('.');
+    if (dot == 0 || dot == std::string::npos) {
+        dot = name.length();
+    }
+    
+    std::string candidate = name;
+    for (int n = 1; ; n++) {
+        //a name still being written by another upload is only free for the same bytes
+        if (catalog.isReservedFor(candidate, digest)) {
+            return candidate;
+        }
+        if (!catalog.isReserved(candidate)) {
+            const UploadEntry* existing = catalog.find(candidate);
+            if (!existing || (existing->hash == digest.hash && existing->size == digest.size)) {
+                return candidate;
+            }
+        }
         
-        response.setBody(html);
-    } else {
-        response.setStatus(500);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<!DOCTYPE html><html><body><h1>500 Error</h1>"
-                        "<p>Failed to save file.</p></body></html>");
+        candidate = name.substr(0, dot) + " (" + std::to_string(n) + ")" + name.substr(dot);
     }
 }
 
 void Server::handleFilesList(const HttpRequest& request, HttpResponse& response) {
     std::cout << "LISTING UPLOADED FILES..." << std::endl;
     
-    DIR* dir = opendir(uploads_root.c_str());
-    if (!dir) {
-        response.setStatus(500);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<!DOCTYPE html><html><body><h1>Error</h1>"
-                        "<p>Could not open uploads directory.</p></body></html>");
-        return;
+    UploadCatalog::SortKey sort;
+    bool descending;
+    if (!parseSort(request.getQueryParams()["sort"], sort, descending)) {
+        sort = UploadCatalog::SORT_NAME;
+        descending = false;
     }
     
-    // build file list
-    std::vector<std::string> files;
-    struct dirent* entry;
+    catalog.sync();
+    size_t total = catalog.size();
     
-    while ((entry = readdir(dir)) != nullptr) {
-        std::string filename = entry->d_name;
-        
-        // skip . and .. and hidden files
-        if (filename[0] == '.') {
-            continue;
-        }
-        
-        // skip submissions.txt
-        if (filename == "submissions.txt") {
-            continue;
-        }
-        
-        files.push_back(filename);
+    //any upload, delete or change seen by sync() moves the catalog's version on
+    std::string key = std::string("files\n") + (descending ? "-" : "+") + std::to_string(sort);
+    std::shared_ptr<const std::string> page = page_cache.find(key, catalog.getVersion());
+    if (page) {
+        sendCachedPage(page, response);
+        return;
     }
     
-    closedir(dir);
+    TemplateData data;
+    data.set("total", std::to_string(total)).set("has_files", total > 0 ? "1" : "");
+    if (total == 0 || !files_page.isLoaded()) {
+        renderPage(files_page, data, response);
+        return;
+    }
     
-    //sort files alphabetically
-    std::sort(files.begin(), files.end());
+    if (total <= PAGE_CACHE_MAX_FILES) {
+        std::vector<const UploadEntry*> files;
+        std::string next_cursor;
+        catalog.query(sort, descending, "", 0, files, next_cursor);
+        addFileCards(data.rows("files"), files);
+        
+        std::string html;
+        files_page.render(data, html);
+        sendCachedPage(page_cache.store(key, catalog.getVersion(), std::move(html)), response);
+        return;
+    }
     
     response.setStatus(200);
     response.setHeader("Content-Type", "text/html");
     
-    std::string html = "<!DOCTYPE html><html><head><title>Uploaded Files</title>"
-                      "<style>"
-                      "body { font-family: Arial; max-width: 1000px; margin: 50px auto; padding: 20px; }"
-                      "h1 { color: #333; border-bottom: 3px solid #007bff; padding-bottom: 10px; }"
-                      ".header-actions { display: flex; justify-content: space-between; align-items: center; margin-bottom: 20px; }"
-                      ".delete-all-btn { background: #dc3545; color: white; padding: 12px 25px; text-decoration: none; border-radius: 5px; font-weight: bold; }"
-                      ".delete-all-btn:hover { background: #c82333; }"
-                      ".files-grid { display: grid; grid-template-columns: repeat(auto-fill, minmax(250px, 1fr)); gap: 20px; margin: 30px 0; }"
-                      ".file-card { background: white; border: 1px solid #ddd; border-radius: 8px; padding: 20px; text-align: center; transition: transform 0.2s; }"
-                      ".file-card:hover { transform: translateY(-5px); box-shadow: 0 4px 12px rgba(0,0,0,0.1); }"
-                      ".file-icon { font-size: 48px; margin-bottom: 10px; }"
-                      ".file-name { font-weight: bold; margin: 10px 0; word-break: break-word; }"
-                      ".file-actions { margin-top: 15px; }"
-                      ".file-actions a { margin: 0 5px; padding: 8px 15px; background: #007bff; color: white; text-decoration: none; border-radius: 4px; display: inline-block; font-size: 14px; }"
-                      ".file-actions a:hover { background: #0056b3; }"
-                      ".empty-state { text-align: center; padding: 60px 20px; color: #999; }"
-                      ".upload-btn { background: #28a745; color: white; padding: 15px 30px; text-decoration: none; border-radius: 5px; display: inline-block; font-size: 18px; margin: 20px 0; }"
-                      ".upload-btn:hover { background: #218838; }"
-                      "</style>"
-                      "<script>"
-                      "function confirmDeleteAll() {"
-                      "  if (confirm('Are you sure you want to delete ALL uploaded files? This cannot be undone!')) {"
-                      "    window.location.href = '/delete-all';"
-                      "  }"
-                      "}"
-                      "</script>"
-                      "</head><body>"
-                      "<h1>Uploaded Files</h1>"
-                      "<div class='header-actions'>"
-                      "<p>Total files: " + std::to_string(files.size()) + "</p>";
-    
-    if (!files.empty()) {
-        html += "<a href='javascript:void(0)' onclick='confirmDeleteAll()' class='delete-all-btn'>Delete All Files</a>";
-    }
-    
-    html += "</div>";
-    
-    if (files.empty()) {
-        html += "<div class='empty-state'>"
-               "<h2>No files uploaded yet</h2>"
-               "<p>Upload your first file to get started!</p>"
-               "</div>";
-    } else {
-        html += "<div class='files-grid'>";
+    //the cards go out FILES_PAGE_SIZE at a time as the client reads them, so a huge
+    //uploads directory never becomes one multi-MB string. paging by cursor keeps
+    //this correct if files come and go while the page is being sent
+    std::string cursor;
+    bool started = false;
+    response.setStreamBody([this, data, sort, descending, cursor, started](std::string& out) mutable {
+        if (!started) {
+            files_page.renderBefore("files", data, out);
+            started = true;
+        }
         
-        for (const auto& filename : files) {
-            // Get file extension for icon (using text labels instead of emojis)
-            std::string icon = "[FILE]";
-            std::string ext = filename.substr(filename.find_last_of(".") + 1);
-            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-            
-            if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "gif") {
-                icon = "[IMG]";
-            } else if (ext == "pdf") {
-                icon = "[PDF]";
-            } else if (ext == "txt") {
-                icon = "[TXT]";
-            } else if (ext == "zip" || ext == "rar") {
-                icon = "[ZIP]";
-            }
-            
-            std::string encoded_filename = HttpRequest::urlEncode(filename);
-            html += "<div class='file-card'>"
-                   "<div class='file-icon'>" + icon + "</div>"
-                   "<div class='file-name'>" + filename + "</div>"
-                   "<div class='file-actions'>"
-                   "<a href='/uploads/" + encoded_filename + "?download=1' download>Download</a>"
-                   "<a href='/uploads/" + encoded_filename + "' target='_blank'>View</a>"
-                   "</div>"
-                   "</div>";
+        std::vector<const UploadEntry*> files;
+        std::string next_cursor;
+        catalog.query(sort, descending, cursor, FILES_PAGE_SIZE, files, next_cursor);
+        
+        TemplateData piece;
+        addFileCards(piece.rows("files"), files);
+        files_page.renderRows("files", piece, out);
+        
+        if (!next_cursor.empty()) {
+            cursor = next_cursor;
+            return true;
         }
         
-        html += "</div>";
+        files_page.renderAfter("files", data, out);
+        return false;
+    });
+}
+
+//GET /api/files?cursor=&limit=&sort= -> {"total":N,"files":[...],"next_cursor":"..."|null}
+void Server::handleFilesApi(const HttpRequest& request, HttpResponse& response) {
+    std::map<std::string, std::string> query = request.getQueryParams();
+    
+    UploadCatalog::SortKey sort;
+    bool descending;
+    long limit = query.count("limit") ? std::strtol(query["limit"].c_str(), nullptr, 10) : 100;
+    
+    if (!parseSort(query["sort"], sort, descending) || limit < 1 || limit > 1000) {
+        std::string body;
+        JsonWriter(body).beginObject()
+            .key("error").value("sort must be name, size or mtime (prefix - for descending), limit 1-1000")
+            .endObject();
+        response.setStatus(400);
+        response.setHeader("Content-Type", "application/json");
+        response.setBody(std::move(body));
+        return;
     }
     
-    html += "<div style='text-align: center;'>"
-           "<a href='/upload.html' class='upload-btn'>Upload New File</a><br>"
-           "<a href='/'>Back to Home</a>"
-           "</div>"
-           "</body></html>";
+    catalog.sync();
+    
+    std::vector<const UploadEntry*> files;
+    std::string next_cursor;
+    catalog.query(sort, descending, query["cursor"], limit, files, next_cursor);
+    
+    std::string body;
+    body.reserve(64 + files.size() * 160);
+    
+    JsonWriter json(body);
+    json.beginObject()
+        .key("total").value((uint64_t)catalog.size())
+        .key("files").beginArray();
+    
+    for (const UploadEntry* file : files) {
+        json.beginObject()
+            .key("name").value(file->name)
+            .key("size").value(file->size)
+            .key("mtime").value((int64_t)(file->mtime_ns / 1000000000))
+            .key("type").value(file->content_type)
+            .key("hash").value(Hash64::toHex(file->hash));
+        if (!file->sha256.empty()) {
+            json.key("sha256").value(file->sha256);
+        }
+        json.endObject();
+    }
     
-    response.setBody(html);
+    json.endArray().key("next_cursor");
+    if (next_cursor.empty()) {
+        json.null();
+    } else {
+        json.value(next_cursor);
+    }
+    json.endObject();
+    
+    response.setStatus(200);
+    response.setHeader("Content-Type", "application/json");
+    response.setHeader("Cache-Control", "no-store");
+    response.setBody(std::move(body));
 }
 
-void Server::handleDeleteAll(const HttpRequest& request, HttpResponse& response) {
-    std::cout << "DELETING ALL UPLOADED FILES..." << std::endl;
-    
-    DIR* dir = opendir(uploads_root.c_str());
+//remove everything under dir (fd-relative, so no path is rebuilt per file): the number of
+//files unlinked
+static size_t removeTree(int dir_fd) {
+    DIR* dir = fdopendir(dir_fd);
     if (!dir) {
-        response.setStatus(500);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<!DOCTYPE html><html><body><h1>Error</h1>"
-                        "<p>Could not open uploads directory.</p></body></html>");
-        return;
+        close(dir_fd);
+        return 0;
     }
     
-    //delete all files (except submissions.txt and .gitkeep)
-    int deleted_count = 0;
-    struct dirent* entry;
-    
-    while ((entry = readdir(dir)) != nullptr) {
-        std::string filename = entry->d_name;
-        
-        if (filename[0] == '.') {
+    size_t removed = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
             continue;
         }
         
-        if (filename == "submissions.txt") {
+        if (unlinkat(dirfd(dir), ent->d_name, 0) == 0) {
+            removed++;
             continue;
         }
-        
-        std::string file_path = uploads_root + "/" + filename;
-        if (std::remove(file_path.c_str()) == 0) {
-            std::cout << " DELETED FILE " << filename << std::endl;
-            deleted_count++;
-        } else {
-            std::cout << "  FAILED TO DELETE: " << filename << std::endl;
+        if (errno == EISDIR) {
+            int sub = openat(dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (sub >= 0) {
+                removed += removeTree(sub);
+            }
+            unlinkat(dirfd(dir), ent->d_name, AT_REMOVEDIR);
         }
     }
     
     closedir(dir);
+    return removed;
+}
+
+//delete a tree swapped out by /delete-all on the blocking pool, then the blobs whose last
+//name was in it. one job per tree: it can keep a worker busy for a while, the rest stay free
+void Server::reclaimTrash(const std::string& dir, std::shared_ptr<std::vector<UploadEntry>> dropped) {
+    auto removed = std::make_shared<size_t>(0);
+    bool queued = pool.submit([this, dir, dropped, removed]() {
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd >= 0) {
+            *removed = removeTree(fd);
+            rmdir(dir.c_str());
+        }
+        for (size_t i = 0; dropped && i < dropped->size(); i++) {
+            store.release((*dropped)[i].hash, (*dropped)[i].size);
+        }
+    }, [dir, removed]() {
+        std::cout << "RECLAIMED " << *removed << " files from " << dir << std::endl;
+    });
     
-    std::cout << "DELETED " << deleted_count << " files" << std::endl;
-    
-    response.setStatus(200);
-    response.setHeader("Content-Type", "text/html");
+    if (!queued) {
+        std::cerr << "Warning: blocking pool full, " << dir << " is left for the next start" << std::endl;
+    }
+}
+
+void Server::handleDeleteAll(const HttpRequest&, HttpResponse& response) {
+    std::cout << "DELETING ALL UPLOADED FILES..." << std::endl;
     
-    std::string html = "<!DOCTYPE html><html><head><title>Files Deleted</title>"
-                      "<style>"
-                      "body { font-family: Arial; max-width: 600px; margin: 100px auto; text-align: center; }"
-                      "h1 { color: #dc3545; }"
-                      ".message { background: #f8d7da; border: 1px solid #f5c6cb; color: #721c24; "
-                      "padding: 20px; border-radius: 5px; margin: 20px 0; }"
-                      "a { display: inline-block; margin: 10px; padding: 10px 20px; "
-                      "background: #007bff; color: white; text-decoration: none; border-radius: 4px; }"
-                      "a:hover { background: #0056b3; }"
-                      "</style>"
-                      "</head><body>"
-                      "<h1>Files Deleted</h1>"
-                      "<div class='message'>"
-                      "<p><strong>" + std::to_string(deleted_count) + " files</strong> have been deleted.</p>"
-                      "</div>"
-                      "<a href='/files'>Back to Files</a>"
-                      "<a href='/'>Home</a>"
-                      "</body></html>";
-    
-    response.setBody(html);
+    //O(1) in the number of files: an empty copy of the shard tree is made on the blocking pool,
+    //swapped in for the live one back on the loop (16 renames), and the old tree with its
+    //files is removed in the background after the response has gone.
+    //dotfiles like .submissions and .gitkeep live outside the shards, so they stay
+    std::string trash = uploads_root + "/.trash/" +
+                        std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) +
+                        "-" + std::to_string(trash_counter++);
+    auto error = std::make_shared<int>(0);
+    
+    response.defer([trash, error]() {
+        if (mkdir(trash.c_str(), 0755) != 0 || !UploadCatalog::createShards(trash)) {
+            *error = errno;
+        }
+    }, [this, trash, error](HttpResponse& response) {
+        if (*error != 0) {
+            std::cout << "  FAILED TO PREPARE " << trash << ": " << strerror(*error) << std::endl;
+            reclaimTrash(trash, nullptr);
+            response.setStatus(500);
+            response.setHeader("Content-Type", "text/html");
+            response.setBody("<html><body><h1>500 Internal Server Error</h1>"
+                            "<p>Failed to delete the uploaded files.</p>"
+                            "</body></html>");
+            return;
+        }
+        
+        auto dropped = std::make_shared<std::vector<UploadEntry>>(catalog.swapShards(trash));
+        size_t deleted_count = dropped->size();
+        reclaimTrash(trash, dropped);
+        file_cache.clear();     //everything mapped from uploads/ is on its way out
+        
+        std::cout << "DELETED " << deleted_count << " files" << std::endl;
+        
+        response.setStatus(200);
+        response.setHeader("Content-Type", "text/html");
+        
+        std::string html = "<!DOCTYPE html><html><head><title>Files Deleted</title>"
+                          "<style>"
+                          "body { font-family: Arial; max-width: 600px; margin: 100px auto; text-align: center; }"
+                          "h1 { color: #dc3545; }"
+                          ".message { background: #f8d7da; border: 1px solid #f5c6cb; color: #721c24; "
+                          "padding: 20px; border-radius: 5px; margin: 20px 0; }"
+                          "a { display: inline-block; margin: 10px; padding: 10px 20px; "
+                          "background: #007bff; color: white; text-decoration: none; border-radius: 4px; }"
+                          "a:hover { background: #0056b3; }"
+                          "</style>"
+                          "</head><body>"
+                          "<h1>Files Deleted</h1>"
+                          "<div class='message'>"
+                          "<p><strong>" + std::to_string(deleted_count) + " files</strong> have been deleted.</p>"
+                          "</div>"
+                          "<a href='/files'>Back to Files</a>"
+                          "<a href='/'>Home</a>"
+                          "</body></html>";
+        
+        response.setBody(html);
+    });
 }
\ No newline at end of file
@@ -3,37 +3,151 @@
 
 #include "HttpRequest.h"
 #include "HttpResponse.h"
+#include "UploadCatalog.h"
+#include "ContentStore.h"
+#include "BlockingPool.h"
+#include "SubmissionLog.h"
+#include "Template.h"
+#include "FileCache.h"
+#include "PageCache.h"
+#include "Config.h"
 #include <string>
 #include <map>
+#include <memory>
+#include <functional>
+#include <vector>
+
+//file cards generated per piece of the streamed /files page
+#define FILES_PAGE_SIZE 200
+
+//default request body limits, enforced from the headers before the body is read
+//(admitRequest; max_*_body in ServerConfig)
+#define MAX_FORM_BODY (1024ULL * 1024)                  //buffered bodies in general
+#define MAX_UPLOAD_BODY (1024ULL * 1024 * 1024)         //multipart /upload, parsed in memory
+#define MAX_PUT_BODY (64ULL * 1024 * 1024 * 1024)       //PUT, streamed to disk
+
+//a PUT /uploads/<name> in progress: the body goes straight from the socket into fd
+//(see Connection), then finishPut() moves the file into place
+struct PutUpload {
+    std::string name;
+    std::string temp_path;
+    int fd;                 //-1 when no upload is in progress
+    uint64_t length;
+
+    PutUpload() : fd(-1), length(0) {}
+};
+
+//a write of length bytes at offset done off the loop thread by the I/O backend (io_uring's
+//IORING_OP_WRITE); done runs back on the loop with the bytes written or -errno
+typedef std::function<void(ssize_t result)> FileWriteDone;
+typedef std::function<void(int fd, const char* data, size_t length, uint64_t offset,
+                           FileWriteDone done)> FileWriter;
 
 class Server {
 private:
-    std::string www_root;
+    ServerConfig config;                           //as started, with reloads applied (reconfigure())
+    std::string www_root;                          //overrides the embedded www/ (empty: none)
     std::string uploads_root;
-    std::map<std::string, std::string> sessions;  //session_id -> username
+    int www_fd;                                    //the two roots, opened once; files are opened
+    int uploads_fd;                                //beneath them (openFile()). www_fd is -1 without overrides
+    std::map<std::string, std::string, std::less<>> sessions;  //session_id -> username (looked up by view)
+    uint64_t sessions_version;                     //bumped on login/logout, for page_cache
+    UploadCatalog catalog;                         //what's in uploads_root, for listings
+    ContentStore store;                            //deduplicated upload contents
+    bool upload_sha256;                            //also record SHA-256 of uploads
+    unsigned trash_counter;                        //names trees moved aside by /delete-all
+    FileCache file_cache;                          //mappings of recently served small files
+    PageCache page_cache;                          //recently rendered /files and /dashboard pages
+    BlockingPool pool;                             //after the rest, so its workers stop before the rest goes
+    SubmissionLog submissions;                     //after pool, which carries its completions
+    FileWriter file_writer;                        //set by a backend that writes files itself
+    
+    //a /upload file on its way to the store (handleUpload())
+    struct PendingUpload {
+        std::string name;
+        std::string path;
+        std::string content;
+        ContentDigest digest;
+        bool saved = false;
+        bool deduplicated = false;
+        int fd = -1;                               //with file_writer: the temp file being written
+        std::string temp_path;
+        size_t written = 0;
+    };
+    typedef std::shared_ptr<std::vector<PendingUpload>> PendingUploads;
     
-    std::string getContentType(const std::string& path);
-    std::string readFile(const std::string& path, bool& success);
-    bool fileExists(const std::string& path);
-    bool isPathSafe(const std::string& path);
+    //the generated pages, compiled from templates_root at startup
+    std::string templates_root;
+    Template dashboard_page;
+    Template upload_page;
+    Template submit_page;
+    Template files_page;
+    
+    int openFile(int dir_fd, const std::string& path, struct stat& st, bool& not_found);
+    void setFileResponse(int fd, const struct stat& st, HttpResponse& response);
     std::string generateSessionId();  
+    std::string chooseUploadName(const std::string& name, const ContentDigest& digest);
+    void reclaimTrash(const std::string& dir, std::shared_ptr<std::vector<UploadEntry>> dropped);
+    void runOnPool(BlockingPool::Job work, BlockingPool::Job done);
+    void saveUploads(PendingUploads pending, size_t index, std::function<void()> finish);
+    void writeUpload(PendingUploads pending, size_t index, std::function<void()> finish);
     
     void handleGET(const HttpRequest& request, HttpResponse& response);
     void handlePOST(const HttpRequest& request, HttpResponse& response);
     void handleDELETE(const HttpRequest& request, HttpResponse& response);
     void handleUpload(const HttpRequest& request, HttpResponse& response);
     void handleDeleteAll(const HttpRequest& request, HttpResponse& response);
+    void handleDeleteBatch(const HttpRequest& request, HttpResponse& response);
     
     //for cookies 
     void handleLogin(const HttpRequest& request, HttpResponse& response);
     void handleDashboard(const HttpRequest& request, HttpResponse& response);
     void handleLogout(const HttpRequest& request, HttpResponse& response);
     void handleFilesList(const HttpRequest& request, HttpResponse& response);
+    void handleFilesApi(const HttpRequest& request, HttpResponse& response);
+    void handleSubmit(const HttpRequest& request, HttpResponse& response);
+    void handleSubmissionsApi(const HttpRequest& request, HttpResponse& response);
+    
+    static bool parseSort(const std::string& value, UploadCatalog::SortKey& sort, bool& descending);
     
 public:
-    Server(const std::string& root = "./www", const std::string& uploads = "./uploads");
+    //config.www: a directory whose files are served in place of the copies of www/ built
+    //into the binary (EmbeddedAssets), or empty to serve only those
+    Server(const ServerConfig& config);
+    ~Server();
+    
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    
+    //pure helpers, static so they can be exercised on their own (bench/microbench.cpp)
+    static std::string getContentType(const std::string& path);
     
     void handleRequest(const HttpRequest& request, HttpResponse& response);
+    
+    const ServerConfig& getConfig() const { return config; }
+    
+    //SIGHUP: take next's reloadable settings (caches, queue, limits); the ones that need
+    //a restart (roots, workers, ...) keep their startup values
+    void reconfigure(const ServerConfig& next);
+    
+    //where deferred responses (HttpResponse::defer()) do their disk work; the event loop
+    //watches its eventFd() and runs the completions
+    BlockingPool& getPool() { return pool; }
+    
+    //how /upload bodies get written when the backend can do it (io_uring); without one they
+    //are written on the blocking pool
+    void setFileWriter(FileWriter writer) { file_writer = std::move(writer); }
+    
+    //vet a request with a body from its headers alone (route, size, free space); on false
+    //the response holds the refusal and the body should not be read
+    bool admitRequest(const HttpRequest& request, uint64_t length, HttpResponse& response);
+    
+    //PUT /uploads/<name>, in three steps around the body transfer (after admitRequest()).
+    //beginPut() opens the destination with length bytes reserved; on false the response
+    //holds the error and the body must not be read
+    bool beginPut(const HttpRequest& request, uint64_t length, PutUpload& upload, HttpResponse& response);
+    void finishPut(PutUpload& upload, HttpResponse& response);
+    void abortPut(PutUpload& upload);
 };
 
 #endif
\ No newline at end of file
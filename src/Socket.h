@@ -6,10 +6,32 @@
 #include <netinet/in.h>
 #include <unistd.h>
 
+#define SOCKET_BACKLOG 4096          //accept queue; the kernel caps it at net.core.somaxconn
+#define SOCKET_DEFER_ACCEPT 5        //seconds a silent connection is held back from accept()
+#define SOCKET_FASTOPEN_QUEUE 256    //pending TFO requests (takes net.ipv4.tcp_fastopen & 2)
+
+class TlsContext;
+
+//options for the listening socket. Linux copies them onto every connection accepted from
+//it, so nothing is set per connection; 0 turns a setting off (buffer sizes: leaves them at
+//the kernel's default, which once set only a restart brings back)
+struct SocketOptions {
+    int backlog;
+    bool nodelay;           //TCP_NODELAY: responses are written whole, nothing to coalesce
+    int defer_accept;       //TCP_DEFER_ACCEPT: wake up for a connection once its request is in
+    int fastopen_queue;     //TCP_FASTOPEN: a returning client's request rides on its SYN
+    int rcvbuf;             //SO_RCVBUF/SO_SNDBUF in bytes; setting them turns off autotuning
+    int sndbuf;
+
+    SocketOptions() : backlog(SOCKET_BACKLOG), nodelay(true), defer_accept(SOCKET_DEFER_ACCEPT),
+                      fastopen_queue(SOCKET_FASTOPEN_QUEUE), rcvbuf(0), sndbuf(0) {}
+};
+
 class Socket {
 private:
     int socket_fd;
     struct sockaddr_in address;
+    TlsContext* tls;    //connections accepted here speak TLS when set
     
 public:
     Socket();
@@ -19,8 +41,14 @@ public:
     //server socket methods
     void create();
     void bind(int port);
+    void adopt(int fd);     //instead of create() and bind(): a socket handed over already listening (Handoff)
+    int localPort() const;
+    void configure(const SocketOptions& options);
     void listen(int backlog);
-    int accept();
+    int accept();   //nonblocking, -1 with errno EAGAIN once the queue is drained
+    //also to reload: connections already accepted keep the context they started with
+    bool enableTls(const std::string& cert_file, const std::string& key_file, int session_timeout);
+    TlsContext* getTls() const { return tls; }
     
     //client socket methods (for accepted connections)
     int receive(char* buffer, int size);
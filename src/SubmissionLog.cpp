@@ -0,0 +1,331 @@
+#include "SubmissionLog.h"
+#include "Hash.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define LOG_MAGIC "SUBLOG1\n"
+#define LOG_MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE 8
+#define RECORD_MAX (64 * 1024 * 1024)   //anything longer is a corrupt length, not a record
+
+//fixed-width little-endian fields (memcpy on a little-endian host, like Hash.cpp's loads)
+template <typename T>
+static void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool take(const char*& p, const char* end, T& value) {
+    if ((size_t)(end - p) < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+static bool takeString(const char*& p, const char* end, size_t length, std::string& value) {
+    if ((size_t)(end - p) < length) {
+        return false;
+    }
+    value.assign(p, length);
+    p += length;
+    return true;
+}
+
+static bool decode(const char* p, size_t length, Submission& submission) {
+    const char* end = p + length;
+    uint64_t time_ms;
+    uint16_t count;
+    if (!take(p, end, time_ms) || !take(p, end, count)) {
+        return false;
+    }
+    submission.time_ms = (int64_t)time_ms;
+
+    submission.fields.resize(count);
+    for (auto& field : submission.fields) {
+        uint16_t name_length;
+        uint32_t value_length;
+        if (!take(p, end, name_length) || !takeString(p, end, name_length, field.first) ||
+            !take(p, end, value_length) || !takeString(p, end, value_length, field.second)) {
+            return false;
+        }
+    }
+    return p == end;
+}
+
+std::string Submission::get(const std::string& name) const {
+    for (const auto& field : fields) {
+        if (field.first == name) {
+            return field.second;
+        }
+    }
+    return "";
+}
+
+SubmissionLog::SubmissionLog(const std::string& path, BlockingPool& completions, int sync_ms)
+    : path(path), completions(completions), sync_ms(sync_ms), fd(-1), end(0), queued_bytes(0),
+      stopping(false) {
+}
+
+//whatever was queued is still written before the writer exits
+SubmissionLog::~SubmissionLog() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool SubmissionLog::open() {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "Warning: could not open " << path << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        if (write(fd, LOG_MAGIC, LOG_MAGIC_SIZE) != LOG_MAGIC_SIZE) {
+            std::cerr << "Warning: could not write " << path << ": " << strerror(errno) << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        st.st_size = LOG_MAGIC_SIZE;
+    }
+
+    char magic[LOG_MAGIC_SIZE];
+    if (pread(fd, magic, LOG_MAGIC_SIZE, 0) != LOG_MAGIC_SIZE || memcmp(magic, LOG_MAGIC, LOG_MAGIC_SIZE) != 0) {
+        std::cerr << "Warning: " << path << " is not a submissions log, form submissions won't be saved"
+                  << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    //a record cut short by a crash: drop it so new ones don't land behind garbage
+    size_t records = 0;
+    end = scan(fd, LOG_MAGIC_SIZE, [&records](Submission&, uint64_t) {
+        records++;
+        return true;
+    });
+    if (end < (uint64_t)st.st_size) {
+        std::cerr << "Warning: dropping " << st.st_size - end << " bytes of torn records at the end of "
+                  << path << std::endl;
+        if (ftruncate(fd, end) != 0) {
+            std::cerr << "Warning: could not truncate " << path << ": " << strerror(errno) << std::endl;
+        }
+    }
+
+    std::cout << "SUBMISSIONS: " << records << " in " << path << std::endl;
+    writer = std::thread(&SubmissionLog::writerLoop, this);
+    return true;
+}
+
+std::string SubmissionLog::encode(const Submission& submission) {
+    std::string payload;
+    put(payload, (uint64_t)submission.time_ms);
+
+    size_t count = std::min<size_t>(submission.fields.size(), UINT16_MAX);
+    put(payload, (uint16_t)count);
+    for (size_t i = 0; i < count; i++) {
+        const std::string& name = submission.fields[i].first;
+        const std::string& value = submission.fields[i].second;
+        size_t name_length = std::min<size_t>(name.length(), UINT16_MAX);
+
+        put(payload, (uint16_t)name_length);
+        payload.append(name, 0, name_length);
+        put(payload, (uint32_t)value.length());
+        payload += value;
+    }
+
+    std::string record;
+    record.reserve(RECORD_HEADER_SIZE + payload.length());
+    put(record, (uint32_t)payload.length());
+    put(record, (uint32_t)Hash64::of(payload.data(), payload.length()));
+    record += payload;
+    return record;
+}
+
+void SubmissionLog::append(const Submission& submission, Done done) {
+    if (fd < 0) {
+        completions.post([done]() { done(false); });
+        return;
+    }
+
+    std::string record = encode(submission);
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queued_bytes += record.length();
+        queue.push_back(Pending{std::move(record), std::move(done)});
+    }
+    queue_ready.notify_one();
+}
+
+void SubmissionLog::writerLoop() {
+    while (true) {
+        std::vector<Pending> batch;
+        int window = sync_ms;   //one value per batch, a reload may change it
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+
+            //the commit window: let more submissions join this write and sync
+            if (window > 0) {
+                queue_ready.wait_for(lock, std::chrono::milliseconds(window), [this] {
+                    return stopping || queued_bytes >= SUBMISSION_BATCH_MAX;
+                });
+            }
+
+            batch.swap(queue);
+            queued_bytes = 0;
+        }
+
+        std::string data;
+        for (const auto& pending : batch) {
+            data += pending.record;
+        }
+
+        bool saved = true;
+        size_t written = 0;
+        while (saved && written < data.length()) {
+            ssize_t n = write(fd, data.data() + written, data.length() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            saved = n > 0;
+            written += saved ? n : 0;
+        }
+        if (saved && window >= 0) {
+            saved = fdatasync(fd) == 0;
+        }
+
+        if (saved) {
+            end += written;
+        } else {
+            std::cerr << "Warning: could not write " << batch.size() << " submissions to " << path
+                      << ": " << strerror(errno) << std::endl;
+            //a partial batch would hide every record after it from readers
+            if (ftruncate(fd, end) != 0) {
+                std::cerr << "Warning: could not truncate " << path << ": " << strerror(errno) << std::endl;
+            }
+        }
+
+        for (auto& pending : batch) {
+            Done done = std::move(pending.done);
+            completions.post([done, saved]() { done(saved); });
+        }
+    }
+}
+
+//walk the records from offset, stopping at the first that is torn or corrupt, or when visit
+//returns false. returns the offset just past the last record walked
+uint64_t SubmissionLog::scan(int fd, uint64_t offset,
+                             const std::function<bool(Submission&, uint64_t next)>& visit) {
+    std::string buffer;         //file contents from buffer_offset on
+    uint64_t buffer_offset = offset;
+    size_t pos = 0;
+
+    //make sure need bytes from pos are buffered
+    auto fill = [&](size_t need) {
+        if (buffer.length() - pos >= need) {
+            return true;
+        }
+        buffer.erase(0, pos);
+        buffer_offset += pos;
+        pos = 0;
+
+        char chunk[65536];
+        while (buffer.length() < need) {
+            ssize_t n = pread(fd, chunk, sizeof(chunk), buffer_offset + buffer.length());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, n);
+        }
+        return true;
+    };
+
+    while (true) {
+        uint64_t start = buffer_offset + pos;
+        if (!fill(RECORD_HEADER_SIZE)) {
+            return start;
+        }
+
+        uint32_t length;
+        uint32_t check;
+        memcpy(&length, buffer.data() + pos, sizeof(length));
+        memcpy(&check, buffer.data() + pos + 4, sizeof(check));
+        if (length > RECORD_MAX || !fill(RECORD_HEADER_SIZE + length)) {
+            return start;
+        }
+
+        const char* payload = buffer.data() + pos + RECORD_HEADER_SIZE;
+        Submission submission;
+        if ((uint32_t)Hash64::of(payload, length) != check || !decode(payload, length, submission)) {
+            return start;
+        }
+
+        pos += RECORD_HEADER_SIZE + length;
+        uint64_t next = start + RECORD_HEADER_SIZE + length;
+        if (!visit(submission, next)) {
+            return next;
+        }
+    }
+}
+
+bool SubmissionLog::query(const std::string& path, uint64_t cursor, size_t limit,
+                          const std::string& field, const std::string& value,
+                          std::vector<Submission>& out, uint64_t& next_cursor) {
+    next_cursor = 0;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT;     //nothing submitted yet
+    }
+
+    char magic[LOG_MAGIC_SIZE];
+    if (pread(fd, magic, LOG_MAGIC_SIZE, 0) != LOG_MAGIC_SIZE || memcmp(magic, LOG_MAGIC, LOG_MAGIC_SIZE) != 0) {
+        close(fd);
+        return false;
+    }
+
+    scan(fd, std::max<uint64_t>(cursor, LOG_MAGIC_SIZE), [&](Submission& submission, uint64_t next) {
+        if (!field.empty() && submission.get(field) != value) {
+            return true;
+        }
+        out.push_back(std::move(submission));
+        if (limit > 0 && out.size() >= limit) {
+            next_cursor = next;
+            return false;
+        }
+        return true;
+    });
+
+    close(fd);
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef SUBMISSION_LOG_H
+#define SUBMISSION_LOG_H
+
+#include "BlockingPool.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#define SUBMISSION_SYNC_MS 10                   //default group-commit window
+#define SUBMISSION_BATCH_MAX (1024 * 1024)      //bytes queued that end the window early
+
+//one /submit form
+struct Submission {
+    int64_t time_ms;    //unix time
+    std::vector<std::pair<std::string, std::string>> fields;
+
+    Submission() : time_ms(0) {}
+
+    std::string get(const std::string& name) const;
+};
+
+//append-only binary log of form submissions (uploads_root/.submissions), written by one
+//thread that group-commits: whatever every connection submitted while the last write was in
+//flight, or within sync_ms of the first one, goes out in a single write() + fdatasync(),
+//and only then are the submitters told it's saved.
+//
+//file format, integers little-endian:
+//  "SUBLOG1\n"
+//  record*:  u32 payload length | u32 check (low half of the payload's Hash64) | payload
+//  payload:  u64 time_ms | u16 field count | (u16 name length | name | u32 value length | value)*
+//a crash can only leave a torn last record; open() cuts it off
+class SubmissionLog {
+public:
+    typedef std::function<void(bool saved)> Done;
+
+private:
+    struct Pending {
+        std::string record;
+        Done done;
+    };
+
+    std::string path;
+    BlockingPool& completions;      //where done callbacks go to reach the loop thread
+    std::atomic<int> sync_ms;       //commit window; 0 = sync each batch at once, < 0 = never sync
+    int fd;
+    uint64_t end;                   //bytes of complete records (writer thread once started)
+
+    std::thread writer;
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::vector<Pending> queue;
+    size_t queued_bytes;
+    bool stopping;
+
+    void writerLoop();
+    static std::string encode(const Submission& submission);
+    static uint64_t scan(int fd, uint64_t offset,
+                         const std::function<bool(Submission&, uint64_t next)>& visit);
+
+public:
+    SubmissionLog(const std::string& path, BlockingPool& completions, int sync_ms = SUBMISSION_SYNC_MS);
+    ~SubmissionLog();
+
+    SubmissionLog(const SubmissionLog&) = delete;
+    SubmissionLog& operator=(const SubmissionLog&) = delete;
+
+    //create or check the file, drop a torn tail and start the writer
+    bool open();
+
+    //loop thread: queue a submission. done runs back on the loop once it's durable
+    //(or written, when syncing is off), or with false if the write failed
+    void append(const Submission& submission, Done done);
+
+    //a new commit window (config reload), from the next batch on
+    void setSyncMs(int ms) { sync_ms = ms; }
+
+    //read up to limit records (0 = all) starting at byte offset cursor (0 = the first) whose
+    //field `field` equals `value` (no filter when field is empty). next_cursor is where to
+    //continue, or 0 at the end of the log. false if the file isn't a submissions log
+    static bool query(const std::string& path, uint64_t cursor, size_t limit,
+                      const std::string& field, const std::string& value,
+                      std::vector<Submission>& out, uint64_t& next_cursor);
+};
+
+#endif
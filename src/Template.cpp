@@ -0,0 +1,327 @@
+#include "Template.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+TemplateData& TemplateData::set(const std::string& name, std::string value) {
+    for (auto& pair : values) {
+        if (pair.first == name) {
+            pair.second = std::move(value);
+            return *this;
+        }
+    }
+    values.emplace_back(name, std::move(value));
+    return *this;
+}
+
+std::vector<TemplateData>& TemplateData::rows(const std::string& name) {
+    for (auto& pair : sections) {
+        if (pair.first == name) {
+            return pair.second;
+        }
+    }
+    sections.emplace_back(name, std::vector<TemplateData>());
+    return sections.back().second;
+}
+
+const std::string* TemplateData::findValue(std::string_view name) const {
+    for (const auto& pair : values) {
+        if (pair.first == name) {
+            return &pair.second;
+        }
+    }
+    return nullptr;
+}
+
+const std::vector<TemplateData>* TemplateData::findRows(std::string_view name) const {
+    for (const auto& pair : sections) {
+        if (pair.first == name) {
+            return &pair.second;
+        }
+    }
+    return nullptr;
+}
+
+bool Template::load(const std::string& path) {
+    this->path = path;
+    loaded = false;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Warning: could not read template " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    std::string error;
+    if (!compile(buffer.str(), error)) {
+        std::cerr << "Warning: template " << path << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Template::compile(const std::string& source, std::string& error) {
+    text.clear();
+    nodes.clear();
+    loaded = false;
+
+    std::vector<size_t> open;      //indices of the sections not closed yet
+    size_t pos = 0;
+
+    auto literal = [&](size_t from, size_t to) {
+        if (to > from) {
+            nodes.push_back(Node{TEXT, text.length(), to - from, "", 0});
+            text.append(source, from, to - from);
+        }
+    };
+
+    while (pos < source.length()) {
+        size_t tag = source.find("{{", pos);
+        if (tag == std::string::npos) {
+            literal(pos, source.length());
+            break;
+        }
+
+        bool triple = source.compare(tag, 3, "{{{") == 0;
+        size_t name_start = tag + (triple ? 3 : 2);
+        size_t close = source.find(triple ? "}}}" : "}}", name_start);
+        if (close == std::string::npos) {
+            error = "unterminated tag at byte " + std::to_string(tag);
+            return false;
+        }
+        size_t after = close + (triple ? 3 : 2);
+
+        std::string name = source.substr(name_start, close - name_start);
+        char sigil = triple || name.empty() ? '\0' : name[0];
+        if (sigil == '#' || sigil == '^' || sigil == '/') {
+            name.erase(0, 1);
+        }
+        size_t first = name.find_first_not_of(" \t");
+        size_t last = name.find_last_not_of(" \t");
+        name = first == std::string::npos ? "" : name.substr(first, last - first + 1);
+        if (name.empty()) {
+            error = "empty tag at byte " + std::to_string(tag);
+            return false;
+        }
+
+        //a section tag alone on its line takes the line with it, so templates can put them
+        //on lines of their own without leaving blank lines in the page
+        size_t literal_end = tag;
+        if (sigil == '#' || sigil == '^' || sigil == '/') {
+            size_t line_start = tag;
+            while (line_start > pos && (source[line_start - 1] == ' ' || source[line_start - 1] == '\t')) {
+                line_start--;
+            }
+            size_t line_end = after;
+            if (line_end < source.length() && source[line_end] == '\r') {
+                line_end++;
+            }
+            bool at_line_start = line_start == 0 || source[line_start - 1] == '\n';
+            bool at_line_end = line_end == source.length() || source[line_end] == '\n';
+            if (at_line_start && at_line_end) {
+                literal_end = line_start;
+                after = line_end < source.length() ? line_end + 1 : line_end;
+            }
+        }
+        literal(pos, literal_end);
+        pos = after;
+
+        if (sigil == '#' || sigil == '^') {
+            open.push_back(nodes.size());
+            nodes.push_back(Node{sigil == '#' ? SECTION : INVERTED, 0, 0, name, 0});
+        } else if (sigil == '/') {
+            if (open.empty() || nodes[open.back()].name != name) {
+                error = "{{/" + name + "}} closes nothing at byte " + std::to_string(tag);
+                return false;
+            }
+            nodes[open.back()].end = nodes.size();
+            open.pop_back();
+        } else {
+            nodes.push_back(Node{triple ? RAW : ESCAPED, 0, 0, name, 0});
+        }
+    }
+
+    if (!open.empty()) {
+        error = "{{#" + nodes[open.back()].name + "}} is never closed";
+        return false;
+    }
+    loaded = true;
+    return true;
+}
+
+const std::string* Template::lookup(const Scope& scope, std::string_view name) {
+    for (size_t i = scope.size(); i-- > 0;) {
+        if (const std::string* value = scope[i]->findValue(name)) {
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+const std::vector<TemplateData>* Template::lookupRows(const Scope& scope, std::string_view name) {
+    for (size_t i = scope.size(); i-- > 0;) {
+        if (const std::vector<TemplateData>* rows = scope[i]->findRows(name)) {
+            return rows;
+        }
+    }
+    return nullptr;
+}
+
+bool Template::isShown(const Scope& scope, std::string_view name) {
+    const std::vector<TemplateData>* rows = lookupRows(scope, name);
+    if (rows) {
+        return !rows->empty();
+    }
+    const std::string* value = lookup(scope, name);
+    return value && !value->empty();
+}
+
+void Template::renderNodes(size_t begin, size_t end, Scope& scope, std::string& out) const {
+    for (size_t i = begin; i < end; i++) {
+        const Node& node = nodes[i];
+        switch (node.kind) {
+            case TEXT:
+                out.append(text, node.offset, node.length);
+                break;
+            case ESCAPED:
+                if (const std::string* value = lookup(scope, node.name)) {
+                    appendEscaped(out, *value);
+                }
+                break;
+            case RAW:
+                if (const std::string* value = lookup(scope, node.name)) {
+                    out += *value;
+                }
+                break;
+            case SECTION: {
+                const std::vector<TemplateData>* rows = lookupRows(scope, node.name);
+                if (rows && !rows->empty()) {
+                    for (const TemplateData& row : *rows) {
+                        scope.push_back(&row);
+                        renderNodes(i + 1, node.end, scope, out);
+                        scope.pop_back();
+                    }
+                } else if (isShown(scope, node.name)) {
+                    renderNodes(i + 1, node.end, scope, out);
+                }
+                i = node.end - 1;
+                break;
+            }
+            case INVERTED:
+                if (!isShown(scope, node.name)) {
+                    renderNodes(i + 1, node.end, scope, out);
+                }
+                i = node.end - 1;
+                break;
+        }
+    }
+}
+
+void Template::render(const TemplateData& data, std::string& out) const {
+    //the static text is the floor of what gets written; one allocation covers most pages
+    out.reserve(out.length() + text.length() + text.length() / 2);
+    Scope scope{&data};
+    renderNodes(0, nodes.size(), scope, out);
+}
+
+//the top-level {{#name}} node, or nodes.size() if there isn't one
+size_t Template::findSection(const std::string& name) const {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].kind == SECTION && nodes[i].name == name) {
+            return i;
+        }
+        if (nodes[i].kind == SECTION || nodes[i].kind == INVERTED) {
+            i = nodes[i].end - 1;
+        }
+    }
+    return nodes.size();
+}
+
+void Template::renderBefore(const std::string& section, const TemplateData& data, std::string& out) const {
+    Scope scope{&data};
+    renderNodes(0, findSection(section), scope, out);
+}
+
+void Template::renderRows(const std::string& section, const TemplateData& data, std::string& out) const {
+    size_t i = findSection(section);
+    const std::vector<TemplateData>* rows = data.findRows(section);
+    if (i == nodes.size() || !rows) {
+        return;
+    }
+
+    Scope scope{&data, nullptr};
+    for (const TemplateData& row : *rows) {
+        scope.back() = &row;
+        renderNodes(i + 1, nodes[i].end, scope, out);
+    }
+}
+
+void Template::renderAfter(const std::string& section, const TemplateData& data, std::string& out) const {
+    size_t i = findSection(section);
+    if (i == nodes.size()) {
+        return;
+    }
+    Scope scope{&data};
+    renderNodes(nodes[i].end, nodes.size(), scope, out);
+}
+
+#if defined(__SSE2__)
+//bit i set where block[i] is one of & < > " '
+static unsigned specialMask(__m128i block) {
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('&')),
+                               _mm_cmpeq_epi8(block, _mm_set1_epi8('<')));
+    hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('>')),
+                                         _mm_cmpeq_epi8(block, _mm_set1_epi8('"'))));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, _mm_set1_epi8('\'')));
+    return _mm_movemask_epi8(hit);
+}
+#endif
+
+static bool isSpecial(char c) {
+    return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+}
+
+//how many bytes from p on (up to end) need no escaping
+static size_t plainRun(const char* p, const char* end) {
+    const char* start = p;
+#if defined(__SSE2__)
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = specialMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        if (mask != 0) {
+            return p - start + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && !isSpecial(*p)) {
+        p++;
+    }
+    return p - start;
+}
+
+void Template::appendEscaped(std::string& out, std::string_view str) {
+    const char* in = str.data();
+    const char* end = in + str.length();
+
+    while (in < end) {
+        size_t run = plainRun(in, end);
+        out.append(in, run);
+        in += run;
+        if (in == end) {
+            break;
+        }
+
+        switch (*in++) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += "&#39;"; break;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+//what one render fills a template's slots with: values by name, and the rows of each
+//{{#section}}. a row is itself a TemplateData; names it doesn't have are looked up outside it
+class TemplateData {
+private:
+    std::vector<std::pair<std::string, std::string>> values;
+    std::vector<std::pair<std::string, std::vector<TemplateData>>> sections;
+
+public:
+    TemplateData& set(const std::string& name, std::string value);
+    //the rows of section name, to push_back onto
+    std::vector<TemplateData>& rows(const std::string& name);
+
+    const std::string* findValue(std::string_view name) const;
+    const std::vector<TemplateData>* findRows(std::string_view name) const;
+};
+
+//an HTML page compiled once at startup into its static text and a list of slots, so a render
+//is one pass of appends into a buffer reserved up front instead of a string built by +=.
+//syntax (a subset of mustache):
+//  {{name}}               the value, HTML-escaped
+//  {{{name}}}             the value as it is (for values that are already safe, e.g. URLs
+//                         made by HttpRequest::urlEncode)
+//  {{#name}}...{{/name}}  once per row of section name; with no rows, once if value name is
+//                         non-empty, otherwise not at all
+//  {{^name}}...{{/name}}  once when {{#name}} would render nothing
+class Template {
+private:
+    enum Kind { TEXT, ESCAPED, RAW, SECTION, INVERTED };
+    struct Node {
+        Kind kind;
+        size_t offset;      //TEXT: where in text
+        size_t length;
+        std::string name;   //slot or section name
+        size_t end;         //SECTION/INVERTED: the index just past the section's nodes
+    };
+
+    std::string path;
+    std::string text;       //all the static bytes, back to back
+    std::vector<Node> nodes;
+    bool loaded;
+
+    typedef std::vector<const TemplateData*> Scope;     //innermost last
+
+    void renderNodes(size_t begin, size_t end, Scope& scope, std::string& out) const;
+    size_t findSection(const std::string& name) const;
+    static const std::string* lookup(const Scope& scope, std::string_view name);
+    static const std::vector<TemplateData>* lookupRows(const Scope& scope, std::string_view name);
+    static bool isShown(const Scope& scope, std::string_view name);
+
+public:
+    Template() : loaded(false) {}
+
+    //read and compile the file; false (with a warning) when it's missing or malformed
+    bool load(const std::string& path);
+    bool compile(const std::string& source, std::string& error);
+    bool isLoaded() const { return loaded; }
+
+    void render(const TemplateData& data, std::string& out) const;
+
+    //a page streamed in pieces (/files): everything before top-level section name, the
+    //section once per row in data, and everything after it
+    void renderBefore(const std::string& section, const TemplateData& data, std::string& out) const;
+    void renderRows(const std::string& section, const TemplateData& data, std::string& out) const;
+    void renderAfter(const std::string& section, const TemplateData& data, std::string& out) const;
+
+    //append str with & < > " ' as entities
+    static void appendEscaped(std::string& out, std::string_view str);
+};
+
+#endif
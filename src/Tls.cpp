@@ -0,0 +1,258 @@
+#include "Tls.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TLS_READ_SIZE 16384     //one full record
+
+//what we speak, in order of preference (ALPN wire format)
+static const unsigned char alpn_protocols[] = "\x02h2\x08http/1.1";
+
+static std::string lastError() {
+    char message[256];
+    unsigned long err = ERR_get_error();
+    if (err == 0) {
+        return strerror(errno);
+    }
+    ERR_error_string_n(err, message, sizeof(message));
+    ERR_clear_error();
+    return message;
+}
+
+static int selectAlpn(SSL*, const unsigned char** out, unsigned char* outlen,
+                      const unsigned char* in, unsigned int inlen, void*) {
+    unsigned char* selected;
+    if (SSL_select_next_proto(&selected, outlen, alpn_protocols, sizeof(alpn_protocols) - 1,
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;    //carry on without ALPN, as HTTP/1.1
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+//whether the kernel has the tls ULP: on an unconnected socket it's ENOTCONN if it does,
+//ENOENT if the module isn't there (and couldn't be loaded)
+static bool probeKtls() {
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return false;
+    }
+    bool available = setsockopt(probe, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 ||
+                     errno != ENOENT;
+    close(probe);
+    return available;
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(ctx);
+}
+
+TlsContext* TlsContext::create(const std::string& cert_file, const std::string& key_file,
+                               int session_timeout, const TlsContext* previous) {
+    TlsContext* context = new TlsContext();
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    context->ctx = ctx;
+    if (ctx == nullptr) {
+        std::cerr << "ERROR: Failed to create TLS context: " << lastError() << std::endl;
+        delete context;
+        return nullptr;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_RENEGOTIATION |
+                             SSL_OP_NO_COMPRESSION);
+    SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:"
+                                  "TLS_CHACHA20_POLY1305_SHA256");
+    SSL_CTX_set_cipher_list(ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                 "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                 "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305");
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1) {
+        std::cerr << "ERROR: Failed to load TLS certificate " << cert_file << ": " << lastError() << std::endl;
+        delete context;
+        return nullptr;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        std::cerr << "ERROR: Failed to load TLS key " << key_file << ": " << lastError() << std::endl;
+        delete context;
+        return nullptr;
+    }
+
+    //resumption: TLS 1.2 clients by session id from the cache, or by ticket; TLS 1.3 by
+    //ticket (two per handshake). ticket keys are OpenSSL's own, random per process; a reload
+    //keeps them (the session cache starts empty, TLS 1.2 clients without tickets do a full handshake)
+    static const unsigned char session_context[] = "http-server";
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, session_context, sizeof(session_context) - 1);
+    SSL_CTX_sess_set_cache_size(ctx, TLS_SESSION_CACHE);
+    SSL_CTX_set_timeout(ctx, session_timeout);
+    if (previous != nullptr) {
+        unsigned char keys[80];     //name, HMAC and AES keys
+        if (SSL_CTX_get_tlsext_ticket_keys(previous->ctx, keys, sizeof(keys)) == 1) {
+            SSL_CTX_set_tlsext_ticket_keys(ctx, keys, sizeof(keys));
+        }
+        OPENSSL_cleanse(keys, sizeof(keys));
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, selectAlpn, nullptr);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    context->ktls = probeKtls();
+    if (context->ktls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
+    return context;
+}
+
+TlsSession::TlsSession(TlsContext& context, int fd)
+    : ssl(SSL_new(context.get())), rbio(BIO_new(BIO_s_mem())), fd(fd), restore_flags(-1),
+      done(false), kernel_send(false) {
+    //reads go through rbio from the start, so OpenSSL never tries kTLS on the receive side;
+    //writes go to the socket, where it can switch sending over to the kernel
+    SSL_set_bio(ssl, rbio, BIO_new_socket(fd, BIO_NOCLOSE));
+    SSL_set_accept_state(ssl);
+
+    //the handshake's writes must not block the loop (io_uring's sockets are blocking)
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        restore_flags = flags;
+    }
+}
+
+TlsSession::~TlsSession() {
+    SSL_free(ssl);  //and both BIOs
+}
+
+TlsStatus TlsSession::handshake() {
+    char buffer[TLS_READ_SIZE];
+    bool closed = false;
+
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            BIO_write(rbio, buffer, n);
+            continue;
+        }
+        if (n == 0) {
+            closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return TLS_FAILED;
+        }
+        break;
+    }
+
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl);
+    if (ret != 1) {
+        int err = SSL_get_error(ssl, ret);
+        if (err == SSL_ERROR_WANT_READ && !closed) {
+            return TLS_WANT_READ;
+        }
+        if (err == SSL_ERROR_WANT_WRITE) {
+            return TLS_WANT_WRITE;
+        }
+        if (!closed) {
+            std::cerr << "TLS: handshake failed: " << lastError() << std::endl;
+        }
+        return TLS_FAILED;
+    }
+
+    done = true;
+#ifndef OPENSSL_NO_KTLS
+    kernel_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+#endif
+    if (!kernel_send) {
+        //records are built in memory from now on and go out through the output queue
+        SSL_set0_wbio(ssl, BIO_new(BIO_s_mem()));
+    }
+
+    if (restore_flags != -1) {
+        fcntl(fd, F_SETFL, restore_flags);
+        restore_flags = -1;
+    }
+    return TLS_DONE;
+}
+
+std::string TlsSession::alpn() const {
+    const unsigned char* protocol;
+    unsigned int length;
+    SSL_get0_alpn_selected(ssl, &protocol, &length);
+    return std::string(reinterpret_cast<const char*>(protocol), protocol ? length : 0);
+}
+
+std::string TlsSession::describe() const {
+    return std::string(SSL_get_version(ssl)) + " " + SSL_get_cipher_name(ssl);
+}
+
+bool TlsSession::isResumed() const {
+    return SSL_session_reused(ssl) == 1;
+}
+
+bool TlsSession::decrypt(const char* data, size_t len, std::string& plain, bool& closed) {
+    closed = false;
+    if (len > 0 && BIO_write(rbio, data, len) != (int)len) {
+        return false;
+    }
+
+    while (true) {
+        size_t start = plain.length();
+        plain.resize(start + TLS_READ_SIZE);
+        ERR_clear_error();
+        int n = SSL_read(ssl, &plain[start], TLS_READ_SIZE);
+        if (n > 0) {
+            plain.resize(start + n);
+            continue;
+        }
+        plain.resize(start);
+
+        int err = SSL_get_error(ssl, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            return true;
+        }
+        if (err == SSL_ERROR_ZERO_RETURN) {
+            closed = true;
+            return true;
+        }
+        std::cerr << "TLS: " << lastError() << std::endl;
+        return false;
+    }
+}
+
+bool TlsSession::seal(const char* data, size_t len, std::string& out) {
+    size_t offset = 0;
+    while (offset < len) {
+        ERR_clear_error();
+        int n = SSL_write(ssl, data + offset, std::min<size_t>(len - offset, INT_MAX));
+        if (n <= 0) {
+            std::cerr << "TLS: " << lastError() << std::endl;
+            return false;
+        }
+        offset += n;
+    }
+
+    //the BIO also holds anything SSL_read() wrote since the last seal (a KeyUpdate reply),
+    //ahead of these records
+    BIO* wbio = SSL_get_wbio(ssl);
+    size_t pending = BIO_ctrl_pending(wbio);
+    size_t start = out.length();
+    out.resize(start + pending);
+    if (pending > 0 && BIO_read(wbio, &out[start], pending) != (int)pending) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <string>
+#include <cstddef>
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+typedef struct bio_st BIO;
+
+#define TLS_SESSION_CACHE 20480     //server-side sessions kept for resumption by session id
+#define TLS_SESSION_TIMEOUT 3600    //default seconds a session (or ticket) can be resumed for
+#define TLS_SEAL_PIECE (64 * 1024)  //file bytes read and encrypted at a time without kTLS
+
+enum TlsStatus {
+    TLS_DONE,
+    TLS_WANT_READ,      //wait until the socket is readable and call again
+    TLS_WANT_WRITE,     //or writable
+    TLS_FAILED
+};
+
+//certificate, key and settings shared by every TLS connection on a listener: TLS 1.2+,
+//AES-GCM first (what kernel TLS implements everywhere), ALPN h2 and http/1.1, and
+//resumption by both the session cache and tickets (keys generated per process, and carried
+//over when a reload replaces the context)
+class TlsContext {
+private:
+    SSL_CTX* ctx;
+    bool ktls;          //the kernel has the tls ULP, so OpenSSL may hand records to it
+
+    TlsContext() : ctx(nullptr), ktls(false) {}
+
+public:
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    //nullptr (after saying why) if the certificate or key can't be used. previous: the
+    //context this one replaces, whose ticket keys it takes so tickets it issued still resume
+    static TlsContext* create(const std::string& cert_file, const std::string& key_file,
+                              int session_timeout = TLS_SESSION_TIMEOUT,
+                              const TlsContext* previous = nullptr);
+
+    SSL_CTX* get() const { return ctx; }
+    bool hasKtls() const { return ktls; }
+};
+
+//one connection's TLS state. the handshake reads the socket itself (backends call
+//handshake() on readiness); afterwards received bytes are passed in to decrypt().
+//on the way out, once the handshake is done, either the kernel encrypts (kTLS: plain
+//send/sendfile/splice keep working) or seal() turns plaintext into records to send
+class TlsSession {
+private:
+    SSL* ssl;
+    BIO* rbio;          //ciphertext from the socket waiting for OpenSSL
+    int fd;
+    int restore_flags;  //the socket's flags before the handshake made it nonblocking, -1 if unchanged
+    bool done;
+    bool kernel_send;
+
+public:
+    TlsSession(TlsContext& context, int fd);
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    TlsStatus handshake();
+    bool isDone() const { return done; }
+
+    //true when records are encrypted by the kernel and the socket takes plaintext
+    bool sendsInKernel() const { return kernel_send; }
+
+    //the protocol ALPN picked, empty without one
+    std::string alpn() const;
+    //e.g. "TLSv1.3 TLS_AES_128_GCM_SHA256", for the log
+    std::string describe() const;
+    bool isResumed() const;
+
+    //received ciphertext in, whatever it completes appended to plain. false on a fatal
+    //error; closed is set once the peer sent close_notify
+    bool decrypt(const char* data, size_t len, std::string& plain, bool& closed);
+
+    //plaintext in, records appended to out (only without kTLS)
+    bool seal(const char* data, size_t len, std::string& out);
+};
+
+#endif
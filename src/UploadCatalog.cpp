@@ -0,0 +1,635 @@
+#include "UploadCatalog.h"
+#include "Server.h"
+#include "Hash.h"
+#include <iostream>
+#include <iterator>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+//rewrite the journal once it holds this many records beyond the live entries
+#define JOURNAL_SLACK 1024
+
+#define SHARD_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+UploadCatalog::UploadCatalog(const std::string& uploads_root, bool with_sha256)
+    : root(uploads_root), journal_fd(-1), journal_records(0), inotify_fd(-1), with_sha256(with_sha256),
+      version(0) {
+}
+
+UploadCatalog::~UploadCatalog() {
+    if (journal_fd >= 0) {
+        close(journal_fd);
+    }
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+}
+
+bool UploadCatalog::isListed(const std::string& name) {
+    //skip . and .. and hidden files (the journal lives in .catalog, form submissions in
+    //.submissions), and the text log older versions kept submissions in
+    if (name.empty() || name[0] == '.') {
+        return false;
+    }
+    return name != "submissions.txt";
+}
+
+bool UploadCatalog::isFlatUpload(const std::string& name) {
+    //README.md describes the directory itself and stays at the top
+    return isListed(name) && name != "README.md";
+}
+
+std::string UploadCatalog::shardOf(const std::string& name) {
+    uint64_t hash = Hash64::of(name.data(), name.length());
+    std::string shard = "0/0";
+    shard[0] = "0123456789abcdef"[(hash >> 60) & 0xF];
+    shard[2] = "0123456789abcdef"[(hash >> 56) & 0xF];
+    return shard;
+}
+
+std::string UploadCatalog::pathOf(const std::string& name) const {
+    return root + "/" + shardOf(name) + "/" + name;
+}
+
+bool UploadCatalog::createShards(const std::string& uploads_root) {
+    for (int i = 0; i < SHARD_FANOUT; i++) {
+        std::string level1 = uploads_root + "/" + "0123456789abcdef"[i];
+        if (mkdir(level1.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        for (int j = 0; j < SHARD_FANOUT; j++) {
+            std::string level2 = level1 + "/" + "0123456789abcdef"[j];
+            if (mkdir(level2.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void UploadCatalog::open() {
+    if (!createShards(root)) {
+        std::cerr << "Warning: could not create the shard directories in " << root << ": "
+                  << strerror(errno) << std::endl;
+    }
+
+    //watch before scanning so nothing changing in between is missed
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watches.assign(SHARD_FANOUT * SHARD_FANOUT, -1);
+    for (int i = 0; i < SHARD_FANOUT * SHARD_FANOUT && inotify_fd >= 0; i++) {
+        std::string shard = root + "/" + "0123456789abcdef"[i / SHARD_FANOUT] + "/" +
+                            "0123456789abcdef"[i % SHARD_FANOUT];
+        watches[i] = inotify_add_watch(inotify_fd, shard.c_str(), SHARD_EVENTS);
+        if (watches[i] < 0) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+    if (inotify_fd < 0) {
+        std::cerr << "Warning: inotify unavailable (" << strerror(errno)
+                  << "), uploads changed outside the server won't be picked up" << std::endl;
+    }
+
+    loadJournal();
+    reconcile();
+    compact();
+
+    std::cout << "UPLOAD CATALOG: " << entries.size() << " files" << std::endl;
+}
+
+void UploadCatalog::insert(const UploadEntry& entry) {
+    erase(entry.name);
+
+    const UploadEntry* stored = &(entries[entry.name] = entry);
+    by_size.insert(IndexKey(stored->size, stored));
+    by_mtime.insert(IndexKey(stored->mtime_ns, stored));
+    version++;
+}
+
+bool UploadCatalog::erase(const std::string& name) {
+    auto it = entries.find(name);
+    if (it == entries.end()) {
+        return false;
+    }
+
+    const UploadEntry* stored = &it->second;
+    by_size.erase(IndexKey(stored->size, stored));
+    by_mtime.erase(IndexKey(stored->mtime_ns, stored));
+    entries.erase(it);
+    version++;
+    return true;
+}
+
+//stat a file and, only if it differs from what we have, hash it into entry
+UploadCatalog::ScanResult UploadCatalog::scanFile(const std::string& name, UploadEntry& entry) {
+    std::string path = pathOf(name);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        return SCAN_MISSING;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return SCAN_MISSING;
+    }
+
+    entry.name = name;
+    entry.size = st.st_size;
+    entry.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    entry.content_type = Server::getContentType(name);
+
+    const UploadEntry* known = find(name);
+    if (known && known->size == entry.size && known->mtime_ns == entry.mtime_ns &&
+        (!with_sha256 || !known->sha256.empty())) {
+        close(fd);
+        return SCAN_UNCHANGED;
+    }
+
+    ContentDigest digest;
+    bool hashed = ContentDigest::ofFile(fd, with_sha256, digest);
+    close(fd);
+
+    entry.hash = digest.hash;
+    entry.sha256 = digest.sha256;
+    return hashed ? SCAN_CHANGED : SCAN_MISSING;
+}
+
+void UploadCatalog::refresh(const std::string& name) {
+    UploadEntry entry;
+    ScanResult result = scanFile(name, entry);
+
+    if (result == SCAN_CHANGED) {
+        insert(entry);
+        appendAdd(entry);
+    } else if (result == SCAN_MISSING && erase(name)) {
+        appendRemove(name);
+    }
+}
+
+//bring the catalog in line with the shard directories: one readdir + stat per file,
+//hashing only files that are new or changed
+void UploadCatalog::reconcile() {
+    std::set<std::string> seen;
+    size_t hashed = 0;
+
+    for (int i = 0; i < SHARD_FANOUT * SHARD_FANOUT; i++) {
+        std::string shard = std::string(1, "0123456789abcdef"[i / SHARD_FANOUT]) + "/" +
+                            "0123456789abcdef"[i % SHARD_FANOUT];
+        DIR* dir = opendir((root + "/" + shard).c_str());
+        if (!dir) {
+            continue;
+        }
+
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            std::string name = ent->d_name;
+            if (!isListed(name) || ent->d_type == DT_DIR || shardOf(name) != shard) {
+                continue;
+            }
+
+            UploadEntry entry;
+            ScanResult result = scanFile(name, entry);
+            if (result == SCAN_MISSING) {
+                continue;
+            }
+            if (result == SCAN_CHANGED) {
+                insert(entry);
+                appendAdd(entry);
+                hashed++;
+            }
+            seen.insert(name);
+        }
+
+        closedir(dir);
+    }
+
+    std::vector<std::string> gone;
+    for (const auto& item : entries) {
+        if (seen.find(item.first) == seen.end()) {
+            gone.push_back(item.first);
+        }
+    }
+    for (const auto& name : gone) {
+        erase(name);
+        appendRemove(name);
+    }
+
+    if (hashed > 0 || !gone.empty()) {
+        std::cout << "UPLOAD CATALOG: rescanned " << root << ", " << hashed << " new or changed, "
+                  << gone.size() << " gone" << std::endl;
+    }
+
+    warnFlatFiles();
+}
+
+//uploads from before sharding sit directly in uploads_root and aren't served any more
+void UploadCatalog::warnFlatFiles() {
+    DIR* dir = opendir(root.c_str());
+    if (!dir) {
+        return;
+    }
+
+    size_t flat = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (isFlatUpload(ent->d_name) && ent->d_type == DT_REG) {
+            flat++;
+        }
+    }
+    closedir(dir);
+
+    if (flat > 0) {
+        std::cerr << "Warning: " << flat << " uploads in " << root << " use the old flat layout, "
+                  << "stop the server and run ./migrate-uploads " << root << std::endl;
+    }
+}
+
+void UploadCatalog::sync() {
+    if (inotify_fd < 0) {
+        return;
+    }
+
+    alignas(struct inotify_event) char buffer[16384];
+    std::set<std::string> changed;
+    bool overflow = false;
+
+    while (true) {
+        ssize_t n = read(inotify_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;  //EAGAIN: drained
+        }
+
+        for (char* p = buffer; p < buffer + n; ) {
+            struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else if (event->len > 0 && isListed(event->name) && !isReserved(event->name)) {
+                changed.insert(event->name);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    //our own writes show up here too; refresh() sees they match and skips them.
+    //the name alone says which shard a file belongs in, so the watch it came from doesn't matter
+    if (overflow) {
+        reconcile();
+        return;
+    }
+    for (const auto& name : changed) {
+        refresh(name);
+    }
+}
+
+void UploadCatalog::reserveWrite(const std::string& name, const ContentDigest& digest) {
+    auto it = busy.find(name);
+    if (it == busy.end()) {
+        busy[name] = Reservation{digest.hash, digest.size, true, 1};
+    } else {
+        it->second.holders++;
+    }
+}
+
+void UploadCatalog::reserveChange(const std::string& name) {
+    auto it = busy.find(name);
+    if (it == busy.end()) {
+        busy[name] = Reservation{0, 0, false, 1};
+    } else {
+        it->second.writing = false;     //nothing can count on what it will hold any more
+        it->second.holders++;
+    }
+}
+
+void UploadCatalog::release(const std::string& name) {
+    auto it = busy.find(name);
+    if (it != busy.end() && --it->second.holders == 0) {
+        busy.erase(it);
+    }
+}
+
+bool UploadCatalog::isReservedFor(const std::string& name, const ContentDigest& digest) const {
+    auto it = busy.find(name);
+    return it != busy.end() && it->second.writing && it->second.hash == digest.hash &&
+           it->second.size == digest.size;
+}
+
+void UploadCatalog::recordWrite(const std::string& name, const ContentDigest& digest) {
+    if (!isListed(name)) {
+        return;
+    }
+
+    struct stat st;
+    std::string path = pathOf(name);
+    if (stat(path.c_str(), &st) != 0) {
+        return;
+    }
+
+    UploadEntry entry;
+    entry.name = name;
+    entry.size = digest.size;
+    entry.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    entry.hash = digest.hash;
+    entry.sha256 = digest.sha256;
+    entry.content_type = Server::getContentType(name);
+
+    insert(entry);
+    appendAdd(entry);
+}
+
+void UploadCatalog::recordRemove(const std::string& name) {
+    if (erase(name)) {
+        appendRemove(name);
+    }
+}
+
+std::vector<UploadEntry> UploadCatalog::swapShards(const std::string& fresh) {
+    sync();     //events from the old directories, before their watches go
+
+    bool swapped[SHARD_FANOUT] = {};
+    for (int i = 0; i < SHARD_FANOUT; i++) {
+        std::string top = std::string(1, "0123456789abcdef"[i]);
+        std::string live = root + "/" + top;
+        std::string spare = fresh + "/" + top;
+
+        swapped[i] = renameat2(AT_FDCWD, live.c_str(), AT_FDCWD, spare.c_str(), RENAME_EXCHANGE) == 0;
+        if (!swapped[i] && (errno == EINVAL || errno == ENOSYS)) {
+            //no RENAME_EXCHANGE on this filesystem: two renames, the shard briefly missing
+            std::string aside = spare + ".old";
+            swapped[i] = rename(live.c_str(), aside.c_str()) == 0;
+            if (swapped[i] && rename(spare.c_str(), live.c_str()) != 0) {
+                createShards(root);
+            }
+        }
+        if (!swapped[i]) {
+            std::cerr << "Warning: could not move " << live << " aside: " << strerror(errno) << std::endl;
+            continue;
+        }
+
+        for (int j = 0; j < SHARD_FANOUT && inotify_fd >= 0; j++) {
+            int& wd = watches[i * SHARD_FANOUT + j];
+            inotify_rm_watch(inotify_fd, wd);
+            wd = inotify_add_watch(inotify_fd, (live + "/" + "0123456789abcdef"[j]).c_str(), SHARD_EVENTS);
+        }
+    }
+
+    //no journal record per file: compact() writes what's left in one go
+    std::vector<UploadEntry> dropped;
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        char top = shardOf(it->first)[0];
+        if (!swapped[top <= '9' ? top - '0' : top - 'a' + 10]) {
+            ++it;
+            continue;
+        }
+        by_size.erase(IndexKey(it->second.size, &it->second));
+        by_mtime.erase(IndexKey(it->second.mtime_ns, &it->second));
+        dropped.push_back(std::move(it->second));
+        it = entries.erase(it);
+        version++;
+    }
+    compact();
+    return dropped;
+}
+
+const UploadEntry* UploadCatalog::find(const std::string& name) const {
+    auto it = entries.find(name);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+std::vector<std::string> UploadCatalog::names() const {
+    std::vector<std::string> result;
+    result.reserve(entries.size());
+    for (const auto& item : entries) {
+        result.push_back(item.first);
+    }
+    return result;
+}
+
+static const UploadEntry* entryOf(const std::pair<const std::string, UploadEntry>& item) {
+    return &item.second;
+}
+
+static const UploadEntry* entryOf(const std::pair<int64_t, const UploadEntry*>& item) {
+    return item.second;
+}
+
+//copy up to limit entries, true if some were left over
+template <typename Iter>
+static bool collect(Iter it, Iter end, size_t limit, std::vector<const UploadEntry*>& out) {
+    for (; it != end; ++it) {
+        if (limit > 0 && out.size() == limit) {
+            return true;
+        }
+        out.push_back(entryOf(*it));
+    }
+    return false;
+}
+
+//name order: the cursor is the last name. size/mtime order: "<key>:<name>",
+//the name breaking ties so equal keys page correctly
+std::string UploadCatalog::cursorFor(const UploadEntry& entry, SortKey sort) {
+    if (sort == SORT_NAME) {
+        return entry.name;
+    }
+    int64_t key = sort == SORT_SIZE ? (int64_t)entry.size : entry.mtime_ns;
+    return std::to_string(key) + ":" + entry.name;
+}
+
+void UploadCatalog::query(SortKey sort, bool descending, const std::string& cursor, size_t limit,
+                          std::vector<const UploadEntry*>& out, std::string& next_cursor) const {
+    out.clear();
+    next_cursor.clear();
+    bool more;
+
+    if (sort == SORT_NAME) {
+        auto pos = descending ? entries.end() : entries.begin();
+        if (!cursor.empty()) {
+            pos = descending ? entries.lower_bound(cursor) : entries.upper_bound(cursor);
+        }
+        more = descending ? collect(std::make_reverse_iterator(pos), entries.rend(), limit, out)
+                          : collect(pos, entries.end(), limit, out);
+    } else {
+        const Index& index = sort == SORT_SIZE ? by_size : by_mtime;
+        auto pos = descending ? index.end() : index.begin();
+
+        size_t colon = cursor.find(':');
+        if (colon != std::string::npos) {
+            UploadEntry probe;
+            probe.name = cursor.substr(colon + 1);
+            IndexKey key(strtoll(cursor.c_str(), nullptr, 10), &probe);
+            pos = descending ? index.lower_bound(key) : index.upper_bound(key);
+        }
+        more = descending ? collect(std::make_reverse_iterator(pos), index.rend(), limit, out)
+                          : collect(pos, index.end(), limit, out);
+    }
+
+    if (more && !out.empty()) {
+        next_cursor = cursorFor(*out.back(), sort);
+    }
+}
+
+//journal format, one record per line:
+//  +\t<name>\t<size>\t<mtime ns>\t<hash hex>\t<content type>\t<sha256 hex or empty>
+//  -\t<name>
+//names are %-escaped so tabs and newlines can't break the framing.
+//appends aren't fsynced: a lost tail just means a few files get re-hashed at startup
+void UploadCatalog::loadJournal() {
+    int fd = ::open(journalPath().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    std::string data;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, n);
+    }
+    close(fd);
+
+    size_t start = 0;
+    while (start < data.length()) {
+        size_t end = data.find('\n', start);
+        if (end == std::string::npos) {
+            break;  //torn final record from a crash
+        }
+
+        std::vector<std::string> fields;
+        size_t field_start = start;
+        while (field_start <= end) {
+            size_t tab = data.find('\t', field_start);
+            if (tab == std::string::npos || tab > end) {
+                tab = end;
+            }
+            fields.push_back(data.substr(field_start, tab - field_start));
+            field_start = tab + 1;
+        }
+        start = end + 1;
+
+        //journals written before SHA-256 support have no last field
+        if ((fields.size() == 6 || fields.size() == 7) && fields[0] == "+") {
+            UploadEntry entry;
+            entry.name = unescapeName(fields[1]);
+            entry.size = strtoull(fields[2].c_str(), nullptr, 10);
+            entry.mtime_ns = strtoll(fields[3].c_str(), nullptr, 10);
+            entry.hash = strtoull(fields[4].c_str(), nullptr, 16);
+            entry.content_type = fields[5];
+            entry.sha256 = fields.size() == 7 ? fields[6] : "";
+            if (isListed(entry.name)) {
+                insert(entry);
+            }
+        } else if (fields.size() == 2 && fields[0] == "-") {
+            erase(unescapeName(fields[1]));
+        }
+    }
+}
+
+//write the live entries to a fresh journal and swap it in
+bool UploadCatalog::compact() {
+    std::string tmp_path = journalPath() + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Warning: could not write " << tmp_path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::string data;
+    bool ok = true;
+    for (const auto& item : entries) {
+        data += addRecord(item.second);
+
+        if (data.length() >= 65536) {
+            ok = ok && write(fd, data.data(), data.length()) == (ssize_t)data.length();
+            data.clear();
+        }
+    }
+    if (!data.empty()) {
+        ok = ok && write(fd, data.data(), data.length()) == (ssize_t)data.length();
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(tmp_path.c_str(), journalPath().c_str()) != 0) {
+        std::cerr << "Warning: could not write " << journalPath() << ": " << strerror(errno) << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (journal_fd >= 0) {
+        close(journal_fd);
+    }
+    journal_fd = ::open(journalPath().c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    journal_records = entries.size();
+    return true;
+}
+
+std::string UploadCatalog::addRecord(const UploadEntry& entry) {
+    return "+\t" + escapeName(entry.name) + "\t" + std::to_string(entry.size) + "\t" +
+           std::to_string(entry.mtime_ns) + "\t" + Hash64::toHex(entry.hash) + "\t" +
+           entry.content_type + "\t" + entry.sha256 + "\n";
+}
+
+void UploadCatalog::appendAdd(const UploadEntry& entry) {
+    appendRecord(addRecord(entry));
+}
+
+void UploadCatalog::appendRemove(const std::string& name) {
+    appendRecord("-\t" + escapeName(name) + "\n");
+}
+
+void UploadCatalog::appendRecord(const std::string& record) {
+    if (journal_fd < 0) {
+        return;  //still loading, compact() writes everything at the end
+    }
+
+    if (write(journal_fd, record.data(), record.length()) != (ssize_t)record.length()) {
+        std::cerr << "Warning: catalog journal write failed: " << strerror(errno) << std::endl;
+    }
+
+    journal_records++;
+    if (journal_records > 2 * entries.size() + JOURNAL_SLACK) {
+        compact();
+    }
+}
+
+std::string UploadCatalog::escapeName(const std::string& name) {
+    std::string result;
+    result.reserve(name.length());
+    for (size_t i = 0; i < name.length(); i++) {
+        unsigned char c = name[i];
+        if (c == '%' || c == '\t' || c == '\n' || c == '\r') {
+            result += '%';
+            result += "0123456789ABCDEF"[c >> 4];
+            result += "0123456789ABCDEF"[c & 0x0F];
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+std::string UploadCatalog::unescapeName(const std::string& name) {
+    std::string result;
+    result.reserve(name.length());
+    for (size_t i = 0; i < name.length(); i++) {
+        if (name[i] == '%' && i + 2 < name.length() && isxdigit((unsigned char)name[i + 1]) &&
+            isxdigit((unsigned char)name[i + 2])) {
+            result += (char)strtol(name.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else {
+            result += name[i];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,147 @@
+#ifndef UPLOAD_CATALOG_H
+#define UPLOAD_CATALOG_H
+
+#include "Hash.h"
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct UploadEntry {
+    std::string name;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;              //Hash64 of the contents
+    std::string sha256;         //hex, only when the catalog was opened with SHA-256 on
+    std::string content_type;
+};
+
+//uploads live in SHARD_FANOUT^2 directories picked by a hash of the name, so no single
+//directory gets huge and a name resolves to its path without any lookup
+#define SHARD_FANOUT 16
+
+//in-memory index of the files in uploads_root, so listings don't readdir + sort per request.
+//kept current three ways: handlers report their own writes/deletes, inotify catches
+//anything else touching the shard directories, and a reconcile pass at startup.
+//persisted as an append-only journal (uploads_root/.catalog) so a restart only
+//re-hashes files whose size or mtime changed while we were down
+class UploadCatalog {
+public:
+    enum SortKey { SORT_NAME, SORT_SIZE, SORT_MTIME };
+
+private:
+    typedef std::pair<int64_t, const UploadEntry*> IndexKey;
+    struct IndexLess {
+        bool operator()(const IndexKey& a, const IndexKey& b) const {
+            if (a.first != b.first) {
+                return a.first < b.first;
+            }
+            return a.second->name < b.second->name;
+        }
+    };
+    typedef std::set<IndexKey, IndexLess> Index;
+
+    std::string root;
+    std::map<std::string, UploadEntry> entries;     //the name index, owns the entries
+    Index by_size;
+    Index by_mtime;
+
+    int journal_fd;
+    size_t journal_records;
+    int inotify_fd;
+    std::vector<int> watches;   //inotify watch per leaf shard, x * SHARD_FANOUT + y
+    bool with_sha256;
+    uint64_t version;           //bumped by every change to the entries
+    //names a handler is changing off the loop (see reserve())
+    struct Reservation {
+        uint64_t hash;
+        uint64_t size;
+        bool writing;       //hash/size are what it will hold (see reserveWrite())
+        unsigned holders;
+    };
+    std::map<std::string, Reservation> busy;
+
+    std::string journalPath() const { return root + "/.catalog"; }
+
+    enum ScanResult { SCAN_MISSING, SCAN_UNCHANGED, SCAN_CHANGED };
+
+    void insert(const UploadEntry& entry);
+    bool erase(const std::string& name);
+    void refresh(const std::string& name);
+    ScanResult scanFile(const std::string& name, UploadEntry& entry);
+
+    void loadJournal();
+    void reconcile();
+    void warnFlatFiles();
+    bool compact();
+    void appendAdd(const UploadEntry& entry);
+    static std::string addRecord(const UploadEntry& entry);
+    void appendRemove(const std::string& name);
+    void appendRecord(const std::string& record);
+
+    static std::string escapeName(const std::string& name);
+    static std::string unescapeName(const std::string& name);
+    static std::string cursorFor(const UploadEntry& entry, SortKey sort);
+
+public:
+    UploadCatalog(const std::string& uploads_root, bool with_sha256 = false);
+    ~UploadCatalog();
+
+    UploadCatalog(const UploadCatalog&) = delete;
+    UploadCatalog& operator=(const UploadCatalog&) = delete;
+
+    //load the journal, reconcile it with the directory and start watching it
+    void open();
+
+    //apply whatever inotify has queued since the last call (cheap when nothing changed)
+    void sync();
+
+    //handlers report their own changes so the catalog is current without waiting for inotify
+    void recordWrite(const std::string& name, const ContentDigest& digest);
+    void recordRemove(const std::string& name);
+
+    //a handler is about to change name from a BlockingPool worker: until release() (and its
+    //recordWrite()/recordRemove()), inotify events for it are ignored rather than re-hashing
+    //a file that is still being written. reserveWrite() says what the name will hold, so an
+    //upload of the same bytes can share it; reserveChange() is for a delete, or a PUT that
+    //isn't hashed yet. new uploads pick another name
+    void reserveWrite(const std::string& name, const ContentDigest& digest);
+    void reserveChange(const std::string& name);
+    void release(const std::string& name);
+    bool isReserved(const std::string& name) const { return busy.count(name) > 0; }
+    bool isReservedFor(const std::string& name, const ContentDigest& digest) const;
+
+    //empty the catalog in O(shards) rather than O(files): each top-level shard directory is
+    //atomically exchanged (renameat2 RENAME_EXCHANGE) with its empty twin in fresh, a tree
+    //made by createShards(fresh) on the same filesystem, and the watches move to the new
+    //ones. fresh then holds the old files for the caller to remove at leisure. returns the
+    //entries dropped; a shard that couldn't be swapped keeps its files and entries
+    std::vector<UploadEntry> swapShards(const std::string& fresh);
+
+    //up to limit entries (0 = all) after cursor, in sort order.
+    //next_cursor is set when more remain, empty otherwise
+    void query(SortKey sort, bool descending, const std::string& cursor, size_t limit,
+               std::vector<const UploadEntry*>& out, std::string& next_cursor) const;
+
+    //where an upload lives: uploads_root/<x>/<y>/<name>, x and y the first two hex digits
+    //of the name's Hash64. O(1), the URL space (/uploads/<name>) stays flat
+    std::string pathOf(const std::string& name) const;
+    static std::string shardOf(const std::string& name);
+    static bool createShards(const std::string& uploads_root);
+
+    const UploadEntry* find(const std::string& name) const;
+    size_t size() const { return entries.size(); }
+    //changes whenever the entries do, whoever made the change (a handler or inotify), so
+    //anything built from a listing can tell whether it's still current (PageCache)
+    uint64_t getVersion() const { return version; }
+    std::vector<std::string> names() const;
+
+    //files that belong in listings (not dotfiles or the old submissions.txt)
+    static bool isListed(const std::string& name);
+    //files left directly in uploads_root by the old flat layout
+    static bool isFlatUpload(const std::string& name);
+};
+
+#endif
@@ -0,0 +1,807 @@
+#include "UringBackend.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define RING_ENTRIES 1024
+#define BUFFER_GROUP 0
+#define PIPE_SIZE (256 * 1024)
+
+//user_data is a Client* with the operation packed into the low (alignment) bits
+#define OP_ACCEPT 0
+#define OP_RECV 1
+#define OP_SEND 2
+#define OP_SPLICE_IN 3
+#define OP_SPLICE_OUT 4
+#define OP_UPLOAD_IN 5
+#define OP_UPLOAD_OUT 6
+#define OP_CANCEL 7
+#define OP_WAKEUP 8                 //the blocking pool has finished jobs
+#define OP_HANDSHAKE 9              //the socket is ready for the next step of a TLS handshake
+#define OP_DRAIN_TIMEOUT 10         //draining is out of time
+#define OP_FILE_WRITE 11            //user_data is a FileWrite*, not a Client*
+#define FILE_WRITE_MAX (1 << 30)    //bytes per write SQE (len is 32 bits), the rest follows
+#define OP_MASK 15ULL
+
+static unsigned long long tag(void* client, int op) {
+    return reinterpret_cast<uintptr_t>(client) | op;
+}
+
+UringBackend::Client::Client(int fd, Server& server, TlsContext* tls)
+    : conn(fd, server, tls), pipe_capacity(0), pipe_pending(0), recv_armed(false),
+      recv_cancelling(false), inflight(0), upload_pipe_capacity(0), upload_pending(0),
+      upload_inflight(0), failed(false), shut_down(false), handshake_armed(false) {
+    pipe_fds[0] = -1;
+    pipe_fds[1] = -1;
+    upload_pipe[0] = -1;
+    upload_pipe[1] = -1;
+}
+
+UringBackend::Client::~Client() {
+    if (pipe_fds[0] != -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+    if (upload_pipe[0] != -1) {
+        close(upload_pipe[0]);
+        close(upload_pipe[1]);
+    }
+}
+
+UringBackend::UringBackend(Server& server)
+    : IoBackend(server), ring_fd(-1), listen_fd(-1), listener(nullptr),
+      sq_ring(MAP_FAILED), sq_ring_size(0), sq_head(nullptr), sq_tail(nullptr),
+      sq_mask(0), sq_entries(0), sq_local_tail(0), sqes(nullptr), sqes_size(0),
+      cq_ring(MAP_FAILED), cq_ring_size(0), cq_head(nullptr), cq_tail(nullptr),
+      cq_mask(0), cqes(nullptr), buf_ring(nullptr), buf_ring_size(0),
+      buffer_count(server.getConfig().recv_buffers), buffers(nullptr) {
+}
+
+UringBackend::~UringBackend() {
+    server.setFileWriter(nullptr);
+    if (buf_ring != nullptr) {
+        munmap(buf_ring, buf_ring_size);
+    }
+    free(buffers);
+
+    if (sqes != nullptr) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (ring_fd != -1) {
+        close(ring_fd);
+    }
+}
+
+bool UringBackend::init(Socket& listener) {
+    this->listener = &listener;
+    listen_fd = listener.getFd();
+
+    if (!setupRing()) {
+        std::cerr << "ERROR: io_uring is not available" << std::endl;
+        return false;
+    }
+
+    if (!setupBufferRing()) {
+        std::cerr << "ERROR: io_uring provided buffer rings need Linux 5.19+" << std::endl;
+        return false;
+    }
+
+    server.setFileWriter([this](int fd, const char* data, size_t length, uint64_t offset, FileWriteDone done) {
+        writeFile(fd, data, length, offset, std::move(done));
+    });
+    return true;
+}
+
+bool UringBackend::setupRing() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+
+    ring_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring_fd < 0 && errno == EINVAL) {
+        //older kernel, the flags are only optimizations
+        memset(&params, 0, sizeof(params));
+        ring_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    }
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqes_ptr);
+
+    char* sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+
+    //SQ slots map 1:1 onto SQEs, set the indirection array once
+    unsigned* sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; i++) {
+        sq_array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool UringBackend::setupBufferRing() {
+    buf_ring_size = buffer_count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    buf_ring = static_cast<struct io_uring_buf_ring*>(ring);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(buf_ring);
+    reg.ring_entries = buffer_count;
+    reg.bgid = BUFFER_GROUP;
+
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+
+    buffers = static_cast<char*>(malloc((size_t)buffer_count * buffer_size));
+    if (buffers == nullptr) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < buffer_count; i++) {
+        recycleBuffer(i);
+    }
+
+    return true;
+}
+
+//make sure count SQEs fit without a flush, so a link chain is never split across submits
+void UringBackend::reserveSqes(unsigned count) {
+    if (sq_entries - (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) < count) {
+        submit(0);
+    }
+}
+
+//next free SQE, flushing the queue to the kernel if it's full
+struct io_uring_sqe* UringBackend::getSqe() {
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        submit(0);
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            std::cerr << "ERROR: io_uring submission queue full" << std::endl;
+            return nullptr;
+        }
+    }
+
+    struct io_uring_sqe* sqe = &sqes[sq_local_tail & sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_local_tail++;
+    return sqe;
+}
+
+//publish queued SQEs and optionally wait for completions, all in one syscall
+int UringBackend::submit(unsigned wait_nr) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+    //stop signals are only deliverable while we sleep in here (see IoBackend::installStopHandler)
+    int ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr,
+                      wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0,
+                      wait_nr > 0 ? &wait_mask : nullptr, _NSIG / 8);
+    return ret < 0 ? -errno : ret;
+}
+
+void UringBackend::run() {
+    armAccept();
+    armWakeup();
+
+    while (!shouldStop()) {
+        checkReload();      //a SIGHUP interrupts the wait, and we're straight back here
+        int ret = submit(1);
+
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            std::cerr << "ERROR: io_uring_enter failed: " << strerror(-ret) << std::endl;
+            return;
+        }
+
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            struct io_uring_cqe* cqe = &cqes[head & cq_mask];
+            unsigned long long user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+
+            //release the slot before handling, handlers may queue more work
+            head++;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+            handleCompletion(user_data, res, flags);
+            tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+}
+
+void UringBackend::handleCompletion(unsigned long long user_data, int res, unsigned flags) {
+    int op = user_data & OP_MASK;
+    Client* client = reinterpret_cast<Client*>(user_data & ~OP_MASK);
+
+    switch (op) {
+        case OP_ACCEPT:
+            onAccept(res, flags);
+            return;
+        case OP_CANCEL:
+        case OP_DRAIN_TIMEOUT:
+            return;     //the cancelled recv/accept reports for itself; the timeout only wakes us
+        case OP_WAKEUP:
+            onWakeup(flags);
+            return;
+        case OP_FILE_WRITE: {
+            FileWrite* write = reinterpret_cast<FileWrite*>(user_data & ~OP_MASK);
+            FileWriteDone done = std::move(write->done);
+            delete write;
+            done(res);
+            return;
+        }
+        case OP_RECV:
+            onRecv(client, res, flags);
+            break;
+        case OP_HANDSHAKE:
+            client->handshake_armed = false;
+            if (!client->shut_down) {
+                continueHandshake(client);
+            }
+            break;
+        case OP_UPLOAD_IN:
+        case OP_UPLOAD_OUT:
+            onUploadComplete(client, op, res);
+            break;
+        default:
+            onSendComplete(client, op, res);
+            break;
+    }
+
+    maybeFree(client);
+}
+
+void UringBackend::armAccept() {
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = tag(nullptr, OP_ACCEPT);
+}
+
+//multishot poll on the blocking pool's eventfd
+void UringBackend::armWakeup() {
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = server.getPool().eventFd();
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = tag(nullptr, OP_WAKEUP);
+}
+
+void UringBackend::onWakeup(unsigned flags) {
+    server.getPool().runCompletions();
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        armWakeup();
+    }
+}
+
+void UringBackend::onAccept(int res, unsigned flags) {
+    if (res >= 0) {
+        Client* client = new Client(res, server, listener->getTls());
+        clients.insert(client);
+        if (draining) {
+            client->conn.drain();   //accepted just before the cancel took effect
+        }
+
+        //a response finished on the blocking pool: send it, and let the client go if that
+        //was all it was waiting for
+        client->conn.setOutputReadyHandler([this, client]() {
+            continueSend(client);
+            maybeFree(client);
+        });
+        if (client->conn.isHandshaking()) {
+            continueHandshake(client);
+            maybeFree(client);      //the handshake may have failed outright
+        } else {
+            armRecv(client);
+        }
+    } else if (res != -ECANCELED) {
+        std::cerr << "ERROR: Failed to accept connection: " << strerror(-res) << std::endl;
+    }
+
+    //multishot accept stays armed until the kernel says otherwise
+    if (!(flags & IORING_CQE_F_MORE) && !draining) {
+        armAccept();
+    }
+}
+
+void UringBackend::armRecv(Client* client) {
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        startShutdown(client);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->conn.getFd();
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = tag(client, OP_RECV);
+    client->recv_armed = true;
+}
+
+//TLS: the handshake reads and writes the (for now nonblocking) socket itself; we poll for
+//what it asks for, and start the multishot recv once it's done
+void UringBackend::continueHandshake(Client* client) {
+    TlsStatus status = client->conn.continueHandshake();
+
+    if (status == TLS_FAILED) {
+        startShutdown(client);
+        return;
+    }
+    if (status == TLS_DONE) {
+        armRecv(client);
+        continueSend(client);   //a request that came in with the handshake may already be answered
+        return;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        startShutdown(client);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = client->conn.getFd();
+    sqe->poll32_events = status == TLS_WANT_WRITE ? POLLOUT : POLLIN;
+    sqe->user_data = tag(client, OP_HANDSHAKE);
+    client->handshake_armed = true;
+}
+
+//give a recv buffer back to the kernel
+//(the ring is indexed by hand: in C++ the header's flex array member doesn't start at offset 0)
+void UringBackend::recycleBuffer(unsigned short bid) {
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(buf_ring);
+    unsigned short* tail = &bufs[0].resv;  //the ring tail overlays the first entry's resv field
+
+    struct io_uring_buf* buf = &bufs[*tail & (buffer_count - 1)];
+    buf->addr = reinterpret_cast<uintptr_t>(buffers + (size_t)bid * buffer_size);
+    buf->len = buffer_size;
+    buf->bid = bid;
+    __atomic_store_n(tail, (unsigned short)(*tail + 1), __ATOMIC_RELEASE);
+}
+
+void UringBackend::onRecv(Client* client, int res, unsigned flags) {
+    bool more = flags & IORING_CQE_F_MORE;
+    if (!more) {
+        client->recv_armed = false;
+        client->recv_cancelling = false;
+    }
+
+    if (res > 0) {
+        unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!client->conn.isClosing()) {
+            client->conn.onReceive(buffers + (size_t)bid * buffer_size, res);
+        }
+        recycleBuffer(bid);
+        resumeReceiving(client);
+    } else if (res == -ENOBUFS || res == -ECANCELED) {
+        //every buffer was in use (they're back in the ring by now), or we stopped it for an upload
+        resumeReceiving(client);
+    } else {
+        //0 is an orderly close, anything else is a reset
+        client->conn.onPeerClosed();
+        if (res < 0) {
+            client->failed = true;
+        }
+    }
+
+    continueSend(client);
+}
+
+//after a recv completion: keep recv going, or hand the socket over to upload splicing
+void UringBackend::resumeReceiving(Client* client) {
+    if (client->shut_down) {
+        return;
+    }
+
+    if (client->conn.isReceivingUpload() && !client->conn.isClosing()) {
+        if (client->recv_armed) {
+            cancelRecv(client);     //recv still owns the socket until its final completion
+        } else {
+            continueUpload(client);
+        }
+    } else if (!client->recv_armed) {
+        armRecv(client);
+    }
+}
+
+void UringBackend::cancelRecv(Client* client) {
+    if (client->recv_cancelling) {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        startShutdown(client);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = tag(client, OP_RECV);
+    sqe->user_data = tag(nullptr, OP_CANCEL);
+    client->recv_cancelling = true;
+}
+
+//move the next piece of an upload body socket -> pipe -> file, or finish emptying the pipe
+//if the last socket splice came up short (which breaks the link to the file splice)
+void UringBackend::continueUpload(Client* client) {
+    Connection& conn = client->conn;
+    if (client->upload_inflight > 0 || client->shut_down || !conn.isReceivingUpload()) {
+        return;
+    }
+
+    if (client->upload_pipe[0] == -1) {
+        if (pipe2(client->upload_pipe, O_CLOEXEC) < 0) {
+            conn.onUploadFailed();
+            return;
+        }
+        fcntl(client->upload_pipe[1], F_SETPIPE_SZ, PIPE_SIZE);
+        client->upload_pipe_capacity = fcntl(client->upload_pipe[1], F_GETPIPE_SZ);
+    }
+
+    reserveSqes(2);
+
+    size_t length = client->upload_pending;
+    if (length == 0) {
+        length = std::min<uint64_t>(conn.uploadRemaining(), client->upload_pipe_capacity);
+
+        struct io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr) {
+            startShutdown(client);
+            return;
+        }
+
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->splice_fd_in = conn.getFd();
+        sqe->splice_off_in = (unsigned long long)-1;
+        sqe->fd = client->upload_pipe[1];
+        sqe->off = (unsigned long long)-1;
+        sqe->len = length;
+        sqe->splice_flags = SPLICE_F_MOVE;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = tag(client, OP_UPLOAD_IN);
+        client->upload_inflight++;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        startShutdown(client);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = client->upload_pipe[0];
+    sqe->splice_off_in = (unsigned long long)-1;
+    sqe->fd = conn.uploadFd();
+    sqe->off = conn.uploadOffset();
+    sqe->len = length;
+    sqe->splice_flags = SPLICE_F_MOVE;
+    sqe->user_data = tag(client, OP_UPLOAD_OUT);
+    client->upload_inflight++;
+}
+
+void UringBackend::onUploadComplete(Client* client, int op, int res) {
+    client->upload_inflight--;
+    Connection& conn = client->conn;
+
+    if (res == -ECANCELED) {
+        //the file splice behind a short socket splice, continueUpload() retries it
+    } else if (op == OP_UPLOAD_IN) {
+        if (res > 0) {
+            client->upload_pending += res;
+        } else {
+            conn.onPeerClosed();    //gone mid-body, the connection drops the partial file
+            if (res < 0) {
+                client->failed = true;
+            }
+        }
+    } else if (res > 0 && conn.isReceivingUpload()) {
+        client->upload_pending -= res;
+        conn.onUploadWritten(res);
+    } else if (conn.isReceivingUpload()) {
+        errno = res < 0 ? -res : EIO;
+        conn.onUploadFailed();
+    }
+
+    if (client->upload_inflight == 0) {
+        if (conn.isReceivingUpload()) {
+            continueUpload(client);
+        } else {
+            //body is in: back to recv for whatever the client sends next
+            client->upload_pending = 0;
+            resumeReceiving(client);
+        }
+    }
+
+    continueSend(client);
+}
+
+//queue the next piece of output: headers/body with a send, file bodies as linked splices
+void UringBackend::continueSend(Client* client) {
+    if (client->inflight > 0 || client->shut_down) {
+        return;
+    }
+
+    Connection& conn = client->conn;
+
+    while (conn.hasReadyOutput() && !client->failed) {
+        OutputChunk& chunk = conn.frontOutput();
+        bool has_data = chunk.sent < chunk.data.length() || chunk.static_remaining > 0;
+        bool has_file = chunk.file_remaining > 0 || client->pipe_pending > 0;
+
+        if (!has_data && !has_file) {
+            conn.popOutput();
+            continue;
+        }
+
+        if (has_file && client->pipe_fds[0] == -1) {
+            if (pipe2(client->pipe_fds, O_CLOEXEC) < 0) {
+                client->failed = true;
+                break;
+            }
+            fcntl(client->pipe_fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+            client->pipe_capacity = fcntl(client->pipe_fds[1], F_GETPIPE_SZ);
+        }
+
+        reserveSqes(3);
+
+        if (has_data) {
+            struct io_uring_sqe* sqe = getSqe();
+            if (sqe == nullptr) {
+                client->failed = true;
+                break;
+            }
+
+            //MSG_WAITALL so a short send breaks the link instead of letting the file overtake it
+            sqe->fd = conn.getFd();
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            if (chunk.static_remaining == 0) {
+                sqe->opcode = IORING_OP_SEND;
+                sqe->addr = reinterpret_cast<uintptr_t>(chunk.data.data() + chunk.sent);
+                sqe->len = chunk.data.length() - chunk.sent;
+            } else {
+                //a static body is gathered from where it is, in the same send as the headers
+                int count = 0;
+                if (chunk.sent < chunk.data.length()) {
+                    client->send_iov[count].iov_base = const_cast<char*>(chunk.data.data() + chunk.sent);
+                    client->send_iov[count++].iov_len = chunk.data.length() - chunk.sent;
+                }
+                client->send_iov[count].iov_base = const_cast<char*>(chunk.static_data);
+                client->send_iov[count++].iov_len = chunk.static_remaining;
+                
+                memset(&client->send_msg, 0, sizeof(client->send_msg));
+                client->send_msg.msg_iov = client->send_iov;
+                client->send_msg.msg_iovlen = count;
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->addr = reinterpret_cast<uintptr_t>(&client->send_msg);
+                sqe->len = 1;
+            }
+            sqe->user_data = tag(client, OP_SEND);
+            if (has_file) {
+                //MSG_MORE so Nagle doesn't hold the file back behind a lone header segment
+                sqe->msg_flags |= MSG_MORE;
+                sqe->flags = IOSQE_IO_LINK;
+            }
+            client->inflight++;
+        }
+
+        if (has_file) {
+            size_t length = client->pipe_pending;
+
+            if (length == 0) {
+                length = std::min(chunk.file_remaining, client->pipe_capacity);
+
+                struct io_uring_sqe* sqe = getSqe();
+                if (sqe == nullptr) {
+                    client->failed = true;
+                    break;
+                }
+
+                sqe->opcode = IORING_OP_SPLICE;
+                sqe->splice_fd_in = chunk.file_fd;
+                sqe->splice_off_in = chunk.file_offset;
+                sqe->fd = client->pipe_fds[1];
+                sqe->off = (unsigned long long)-1;
+                sqe->len = length;
+                sqe->splice_flags = SPLICE_F_MOVE;
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->user_data = tag(client, OP_SPLICE_IN);
+                client->inflight++;
+            }
+
+            struct io_uring_sqe* sqe = getSqe();
+            if (sqe == nullptr) {
+                client->failed = true;
+                break;
+            }
+
+            sqe->opcode = IORING_OP_SPLICE;
+            sqe->splice_fd_in = client->pipe_fds[0];
+            sqe->splice_off_in = (unsigned long long)-1;
+            sqe->fd = conn.getFd();
+            sqe->off = (unsigned long long)-1;
+            sqe->len = length;
+            sqe->splice_flags = SPLICE_F_MOVE;
+            sqe->user_data = tag(client, OP_SPLICE_OUT);
+            client->inflight++;
+        }
+
+        return;
+    }
+
+    if (client->failed || conn.shouldClose()) {
+        startShutdown(client);
+    }
+}
+
+void UringBackend::onSendComplete(Client* client, int op, int res) {
+    client->inflight--;
+
+    if (res == -ECANCELED) {
+        //the rest of a broken link chain, continueSend() retries it
+    } else if (res < 0 || (res == 0 && op == OP_SPLICE_IN)) {
+        client->failed = true;
+    } else if (client->conn.hasOutput()) {
+        OutputChunk& chunk = client->conn.frontOutput();
+
+        if (op == OP_SEND) {
+            chunk.advance(res);
+        } else if (op == OP_SPLICE_IN) {
+            chunk.file_offset += res;
+            chunk.file_remaining -= res;
+            client->pipe_pending += res;
+        } else {
+            client->pipe_pending -= res;
+        }
+    }
+
+    if (client->inflight == 0) {
+        continueSend(client);
+    }
+}
+
+//the loop thread (a blocking pool completion) asks; done runs from handleCompletion()
+void UringBackend::writeFile(int fd, const char* data, size_t length, uint64_t offset, FileWriteDone done) {
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        done(-EBUSY);
+        return;
+    }
+
+    FileWrite* write = new FileWrite;
+    write->done = std::move(done);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(data);
+    sqe->len = std::min<size_t>(length, FILE_WRITE_MAX);
+    sqe->off = offset;
+    sqe->user_data = tag(write, OP_FILE_WRITE);
+}
+
+//shutdown() wakes the multishot recv with a final 0, after which the client can go.
+//draining, only our side is shut: recv (discarding) carries on until the peer closes too,
+//as closing with input unread would reset the connection and lose the end of the response
+void UringBackend::startShutdown(Client* client) {
+    if (client->shut_down) {
+        return;
+    }
+
+    shutdown(client->conn.getFd(), draining ? SHUT_WR : SHUT_RDWR);
+    client->shut_down = true;
+}
+
+void UringBackend::maybeFree(Client* client) {
+    if (client->shut_down && !client->recv_armed && client->inflight == 0 &&
+        client->upload_inflight == 0 && !client->handshake_armed) {
+        clients.erase(client);
+        delete client;
+    }
+}
+
+void UringBackend::beginDrain() {
+    struct io_uring_sqe* sqe = getSqe();
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(nullptr, OP_ACCEPT);
+        sqe->user_data = tag(nullptr, OP_CANCEL);
+    }
+    listener->close();
+
+    int left = waitTimeoutMs();
+    drain_timeout.tv_sec = left / 1000;
+    drain_timeout.tv_nsec = (left % 1000) * 1000000LL;
+    sqe = getSqe();
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uintptr_t>(&drain_timeout);
+        sqe->len = 0;       //a pure timeout, not "after n completions"
+        sqe->user_data = tag(nullptr, OP_DRAIN_TIMEOUT);
+    }
+
+    std::vector<Client*> open(clients.begin(), clients.end());
+    for (Client* client : open) {
+        client->conn.drain();
+        continueSend(client);
+        maybeFree(client);
+    }
+}
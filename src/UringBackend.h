@@ -0,0 +1,119 @@
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include "IoBackend.h"
+#include "Connection.h"
+#include <cstddef>
+#include <unordered_set>
+#include <linux/time_types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+//io_uring event loop (Linux 6.0+): multishot accept, multishot recv into a provided
+//buffer ring, and responses sent as a linked send -> splice(file, pipe) -> splice(pipe, socket)
+//chain. PUT bodies take the reverse path: recv is cancelled once the headers are in and the
+//body comes in as linked splice(socket, pipe) -> splice(pipe, file) pairs. /upload files,
+//parsed in memory, are written to disk through the ring too (IORING_OP_WRITE).
+//each loop iteration is a single io_uring_enter() that both submits and waits
+class UringBackend : public IoBackend {
+private:
+    struct alignas(16) Client {     //the low four bits of a Client* carry the operation
+        Connection conn;
+        int pipe_fds[2];        //created the first time a file body is spliced
+        size_t pipe_capacity;
+        size_t pipe_pending;    //spliced into the pipe but not yet out to the socket
+        bool recv_armed;        //multishot recv still active
+        bool recv_cancelling;   //asked the kernel to stop it for an upload body
+        int inflight;           //send/splice operations not completed yet
+        struct msghdr send_msg; //headers + static body of the send in flight (SENDMSG)
+        struct iovec send_iov[2];
+        int upload_pipe[2];     //upload bodies get their own pipe, responses may be mid-splice
+        size_t upload_pipe_capacity;
+        size_t upload_pending;  //body bytes in the pipe, not yet in the file
+        int upload_inflight;
+        bool failed;            //a send failed, the rest of the output is dropped
+        bool shut_down;
+        bool handshake_armed;   //TLS handshake waiting on a readiness poll
+
+        Client(int fd, Server& server, TlsContext* tls);
+        ~Client();
+    };
+
+    struct alignas(16) FileWrite {  //an upload body write (Server::setFileWriter()) in flight
+        FileWriteDone done;
+    };
+
+    int ring_fd;
+    int listen_fd;
+    Socket* listener;       //its TLS context is looked up per connection, a reload replaces it
+    std::unordered_set<Client*> clients;
+    struct __kernel_timespec drain_timeout;     //wakes the loop when draining runs out of time
+
+    //submission queue
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;         //SQEs filled in but not yet published to the kernel
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    //completion queue (may share the SQ ring mapping)
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    //provided buffers the kernel picks from for multishot recv
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    unsigned buffer_count;  //a power of two, required by the buffer ring
+    char* buffers;          //buffer_count of buffer_size bytes
+
+    bool setupRing();
+    bool setupBufferRing();
+    void reserveSqes(unsigned count);
+    struct io_uring_sqe* getSqe();
+    int submit(unsigned wait_nr);
+
+    void armAccept();
+    void armWakeup();
+    void armRecv(Client* client);
+    void continueHandshake(Client* client);
+    void recycleBuffer(unsigned short bid);
+    void continueSend(Client* client);
+    void cancelRecv(Client* client);
+    void continueUpload(Client* client);
+    void resumeReceiving(Client* client);
+    void writeFile(int fd, const char* data, size_t length, uint64_t offset, FileWriteDone done);
+    void startShutdown(Client* client);
+    void maybeFree(Client* client);
+
+    void beginDrain();
+    size_t connectionCount() const { return clients.size(); }
+
+    void handleCompletion(unsigned long long user_data, int res, unsigned flags);
+    void onAccept(int res, unsigned flags);
+    void onWakeup(unsigned flags);
+    void onRecv(Client* client, int res, unsigned flags);
+    void onSendComplete(Client* client, int op, int res);
+    void onUploadComplete(Client* client, int op, int res);
+
+public:
+    UringBackend(Server& server);
+    ~UringBackend();
+
+    const char* getName() const { return "io_uring"; }
+    bool init(Socket& listener);
+    void run();
+};
+
+#endif
@@ -1,166 +1,140 @@
 #include "Socket.h"
-#include "HttpRequest.h"
-#include "HttpResponse.h"
 #include "Server.h"
+#include "IoBackend.h"
+#include "Config.h"
+#include "Handoff.h"
 #include <iostream>
 #include <cstring>
+#include <csignal>
+#include <fcntl.h>
 
-#define PORT 8080
-#define BUFFER_SIZE 8192  
-std::string readFullRequest(Socket& client_socket) {
-    std::string full_request;
-    char buffer[BUFFER_SIZE];
-    int content_length = -1;
-    size_t headers_end_pos = std::string::npos;
+int main(int argc, char* argv[]) {
+    std::cout << "=== HTTP SERVER ===" << std::endl;
     
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = client_socket.receive(buffer, BUFFER_SIZE - 1);
-        
-        if (bytes_received <= 0) {
-            break;
-        }
-        
-        buffer[bytes_received] = '\0';
-        full_request.append(buffer, bytes_received);
-        
-        //find end of headers if we haven't yet
-        if (headers_end_pos == std::string::npos) {
-            headers_end_pos = full_request.find("\r\n\r\n");
-            if (headers_end_pos == std::string::npos) {
-                headers_end_pos = full_request.find("\n\n");
-            }
-            
-            //parse Content-Length if we found headers
-            if (headers_end_pos != std::string::npos && content_length == -1) {
-                std::string headers = full_request.substr(0, headers_end_pos); //extract headers section
-                
-                //find Content-Length header 
-                size_t cl_pos = headers.find("Content-Length:");
-                if (cl_pos == std::string::npos) {
-                    cl_pos = headers.find("content-length:");
-                }
-                
-                if (cl_pos != std::string::npos) {
-                    size_t line_end = headers.find("\n", cl_pos);
-                    std::string cl_line = headers.substr(cl_pos, line_end - cl_pos);
-                    size_t colon_pos = cl_line.find(":");
-                    if (colon_pos != std::string::npos) {
-                        std::string cl_value = cl_line.substr(colon_pos + 1);
-                        cl_value.erase(0, cl_value.find_first_not_of(" \t\r\n"));
-                        cl_value.erase(cl_value.find_last_not_of(" \t\r\n") + 1);
-                        content_length = std::stoi(cl_value);
-                        
-                        std::cout << "📏 Content-Length: " << content_length << " bytes" << std::endl;
-                    }
-                }
-            }
-        }
-        
-        //received the complete request?
-        if (headers_end_pos != std::string::npos && content_length >= 0) {
-            size_t header_size = (full_request.find("\r\n\r\n") != std::string::npos) ? 
-                                headers_end_pos + 4 : headers_end_pos + 2;
-            size_t body_size = full_request.length() - header_size;
-            
-            std::cout << "RECIEVED: " << body_size << " / " << content_length << " bytes" << std::endl;
-            
-            if (body_size >= (size_t)content_length) {
-                std::cout << "Complete request received" << std::endl;
-                break;
-            }
-        }
-        
-        //no Content-Length -- check for common patterns that indicate end
-        if (content_length == -1 && headers_end_pos != std::string::npos) {
-            //for GET requests with no body
-            if (full_request.find("GET ") == 0 || full_request.find("DELETE ") == 0) {
-                break;
-            }
-            
-            //wait a bit more for POST/PUT
-            if (bytes_received < BUFFER_SIZE - 1) {
-                break;
-            }
+    if (argc > 1 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
+        ServerConfig::printUsage(argv[0]);
+        return 0;
+    }
+    
+    //built-in defaults, then --config FILE, then the other flags (see Config.h)
+    ServerConfig config;
+    std::string error;
+    if (!ServerConfig::load(argc, argv, config, error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        ServerConfig::printUsage(argv[0]);
+        return 1;
+    }
+    if (!config.config_file.empty()) {
+        std::cout << "Configuration file: " << config.config_file << std::endl;
+    }
+    bool use_tls = config.useTls();
+    int port = config.listenPort();
+    
+    //a client hanging up mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    IoBackend::installStopHandler();
+    
+    //hot upgrade: a server already running with this upgrade socket hands over its listener
+    //and keeps accepting on it too until we're up
+    Handoff* handoff = config.upgrade_socket.empty() ? nullptr : new Handoff(config.upgrade_socket);
+    int inherited_fd = handoff ? handoff->takeOver() : -1;
+    if (inherited_fd >= 0) {
+        //the two backends want the (shared) listener nonblocking and blocking respectively
+        std::string running = (fcntl(inherited_fd, F_GETFL) & O_NONBLOCK) ? "epoll" : "uring";
+        if ((config.io == "epoll") != (running == "epoll")) {
+            std::cerr << "Warning: the running server uses " << running
+                      << " on the same listener, keeping it (switching takes a restart)" << std::endl;
+            config.io = running;
         }
     }
     
-    return full_request;
-}
-
-void handleClient(int client_fd, Server& server) {
-    Socket client_socket(client_fd);
+    //create server, www/ comes from the binary unless --www overrides it
+    Server server(config);
     
-    //read full request
-    std::string raw_request = readFullRequest(client_socket);
+    Socket server_socket;
+    if (inherited_fd >= 0) {
+        server_socket.adopt(inherited_fd);
+        port = server_socket.localPort();
+    } else {
+        server_socket.create();
+        server_socket.bind(port);
+    }
+    server_socket.configure(config.socket);
+    server_socket.listen(config.socket.backlog);
+    if (use_tls && !server_socket.enableTls(config.tls_cert, config.tls_key, config.tls_session_timeout)) {
+        return 1;
+    }
     
-    if (raw_request.empty()) {
-        std::cerr << "Error: Empty request" << std::endl;
-        client_socket.close();
-        return;
+    IoBackend* backend = IoBackend::create(config.io, server);
+    if (backend == nullptr) {
+        std::cerr << "ERROR: Unknown I/O backend: " << config.io << std::endl;
+        return 1;
     }
     
-    //show request info
-    size_t first_line_end = raw_request.find('\n');
-    std::string request_line = raw_request.substr(0, first_line_end);
-    std::cout << "\n " << request_line;
-    std::cout << "   Total size: " << raw_request.length() << " bytes" << std::endl;
+    if (!backend->init(server_socket)) {
+        //io_uring needs a recent kernel, epoll is always there
+        std::cerr << "Falling back to epoll" << std::endl;
+        delete backend;
+        backend = IoBackend::create("epoll", server);
+        
+        if (!backend->init(server_socket)) {
+            return 1;
+        }
+    }
     
-    HttpRequest request;
-    if (!request.parse(raw_request)) {
-        std::cerr << "Failed to parse HTTP request" << std::endl;
+    //SIGHUP: read the file and flags again and apply what can change without a restart.
+    //connections stay up; new ones get the new listener settings and certificate
+    backend->setReloadHandler([&]() {
+        std::cout << "\nReloading configuration" << std::endl;
+        ServerConfig next;
+        std::string reload_error;
+        if (!ServerConfig::load(argc, argv, next, reload_error)) {
+            std::cerr << "ERROR: " << reload_error << ", keeping the running configuration" << std::endl;
+            return;
+        }
         
-        HttpResponse response;
-        response.setStatus(400);
-        response.setHeader("Content-Type", "text/html");
-        response.setBody("<html><body><h1>400 Bad Request</h1></body></html>");
+        const ServerConfig& current = server.getConfig();
+        std::string restart = current.restartChanges(next);
+        if (!restart.empty()) {
+            std::cerr << "Warning: changing " << restart << " takes a restart, keeping the running values" << std::endl;
+        }
+        if (current.useTls() != next.useTls()) {
+            next.tls_cert = current.tls_cert;
+            next.tls_key = current.tls_key;
+        }
+        if (next.useTls() && !server_socket.enableTls(next.tls_cert, next.tls_key, next.tls_session_timeout)) {
+            std::cerr << "Warning: keeping the previous certificate" << std::endl;
+            next.tls_cert = current.tls_cert;
+            next.tls_key = current.tls_key;
+        }
         
-        std::string response_str = response.build();
-        client_socket.send(response_str.c_str(), response_str.length());
-        client_socket.close();
-        return;
+        server_socket.configure(next.socket);
+        if (next.socket.backlog != current.socket.backlog) {
+            server_socket.listen(next.socket.backlog);
+        }
+        server.reconfigure(next);
+        std::cout << "Configuration reloaded" << std::endl;
+    });
+    
+    //SIGTERM: the listener isn't offered to a successor any more once we start draining
+    backend->setDrainHandler([handoff]() {
+        if (handoff != nullptr) {
+            handoff->stop();
+        }
+    });
+    if (handoff != nullptr && !handoff->serve(server_socket.getFd())) {
+        std::cerr << "Warning: hot upgrades are off" << std::endl;
     }
     
-    std::cout << "[" << request.getMethod() << " " << request.getPath() << "]" << std::endl;
-    
-    //create HTTP response and let server handle it
-    HttpResponse response;
-    response.setHeader("Server", "MyHTTPServer/1.0");
-    response.setHeader("Connection", "close");
-    server.handleRequest(request, response);
-    
-    std::string response_str = response.build();
-    
-    std::cout << "SENDING: " << response_str.length() << " bytes" << std::endl;
-    
-    client_socket.send(response_str.c_str(), response_str.length());
-    client_socket.close();
-}
-
-int main() {
-    std::cout << "=== HTTP SERVER ===" << std::endl;
-    
-    //create server with www root
-    Server server("./www", "./uploads");
-    
-    Socket server_socket;
-    server_socket.create();
-    server_socket.bind(PORT);
-    server_socket.listen(5);
-    
-    std::cout << "\nHTTP server running on http://localhost:" << PORT << std::endl;
+    std::cout << "\nHTTP server running on " << (use_tls ? "https" : "http") << "://localhost:" << port
+              << " (" << backend->getName() << ")" << std::endl;
     std::cout << "Press Ctrl+C to stop the server\n" << std::endl;
     
     //main server loop
-    while (true) {
-        int client_fd = server_socket.accept();
-        
-        if (client_fd < 0) {
-            continue;
-        }
-        
-        handleClient(client_fd, server);
-    }
+    backend->run();
     
+    std::cout << "\nShutting down" << std::endl;
+    delete backend;
+    delete handoff;
     return 0;
-}
\ No newline at end of file
+}
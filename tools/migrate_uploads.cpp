@@ -0,0 +1,100 @@
+//one-time migration of an uploads directory from the old flat layout (uploads/<name>)
+//to the sharded one (uploads/<x>/<y>/<name>, see UploadCatalog::pathOf).
+//stop the server first. files are renamed, not copied, so links into .store and
+//mtimes survive and the catalog picks them up at the next start without rehashing.
+//safe to run again: anything already in its shard is left alone
+
+#include "UploadCatalog.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+int main(int argc, char* argv[]) {
+    std::string root = argc > 1 ? argv[1] : "uploads";
+    if (argc > 2 || root == "-h" || root == "--help") {
+        std::cerr << "Usage: " << argv[0] << " [UPLOADS_DIR]   (default: uploads)" << std::endl;
+        return 1;
+    }
+
+    DIR* dir = opendir(root.c_str());
+    if (!dir) {
+        std::cerr << "Error: could not open " << root << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    //names to move, and where each one is right now
+    std::vector<std::string> flat;
+    std::vector<std::string> sources;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        std::string name = ent->d_name;
+        std::string path = root + "/" + name;
+
+        //parked by an earlier run that didn't finish
+        if (name.compare(0, 9, ".migrate-") == 0) {
+            name = name.substr(9);
+        }
+
+        struct stat st;
+        if (UploadCatalog::isFlatUpload(name) && lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            flat.push_back(name);
+            sources.push_back(path);
+        }
+    }
+    closedir(dir);
+
+    //an old upload called "0".."f" sits where a shard directory has to go: park it first
+    for (size_t i = 0; i < flat.size(); i++) {
+        if (flat[i].length() == 1 && strchr("0123456789abcdef", flat[i][0]) &&
+            sources[i] == root + "/" + flat[i]) {
+            std::string parked = root + "/.migrate-" + flat[i];
+            if (rename(sources[i].c_str(), parked.c_str()) != 0) {
+                std::cerr << "Error: could not move " << sources[i] << " aside: " << strerror(errno) << std::endl;
+                return 1;
+            }
+            sources[i] = parked;
+        }
+    }
+
+    if (!UploadCatalog::createShards(root)) {
+        std::cerr << "Error: could not create the shard directories in " << root << ": "
+                  << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    UploadCatalog layout(root);
+    size_t moved = 0;
+    size_t skipped = 0;
+
+    for (size_t i = 0; i < flat.size(); i++) {
+        std::string target = layout.pathOf(flat[i]);
+
+        //never replace something already sharded under the same name
+        struct stat st;
+        if (lstat(target.c_str(), &st) == 0) {
+            std::cerr << "Skipped " << flat[i] << ": " << target << " already exists" << std::endl;
+            skipped++;
+            continue;
+        }
+
+        if (rename(sources[i].c_str(), target.c_str()) != 0) {
+            std::cerr << "Skipped " << flat[i] << ": " << strerror(errno) << std::endl;
+            skipped++;
+            continue;
+        }
+        moved++;
+    }
+
+    std::cout << "Migrated " << moved << " uploads in " << root << " to the sharded layout";
+    if (skipped > 0) {
+        std::cout << ", " << skipped << " skipped (left in place)";
+    }
+    std::cout << std::endl;
+    return skipped > 0 ? 2 : 0;
+}
@@ -0,0 +1,224 @@
+//build step: pack every file under a directory (www/) into OUT_DIR/assets.bin and write
+//OUT_DIR/assets.cpp, which pulls the blob into the executable's read-only data with .incbin
+//and defines the index EmbeddedAssets looks paths up in: offset, length, Content-Type, ETag
+//and a gzip variant for files it makes meaningfully smaller (when built with zlib).
+//dotfiles are skipped
+
+#include "Hash.h"
+#include "MimeTypes.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define GZIP_MIN_SAVING 10      //percent a gzip variant has to save to be kept
+#define ASSET_ALIGN 64          //each asset starts on a cache line
+
+struct PackedAsset {
+    std::string path;
+    std::string mime;
+    uint64_t hash;
+    size_t offset;
+    size_t length;
+    size_t gzip_offset;
+    size_t gzip_length;
+};
+
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+//files under dir, as URL paths below prefix
+static bool collect(const std::string& dir, const std::string& prefix, std::vector<std::string>& paths) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        std::cerr << "Error: could not open " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct dirent* ent;
+    bool ok = true;
+    while (ok && (ent = readdir(handle)) != nullptr) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        std::string full = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(full.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            ok = collect(full, prefix + ent->d_name + "/", paths);
+        } else if (S_ISREG(st.st_mode)) {
+            paths.push_back(prefix + ent->d_name);
+        }
+    }
+    closedir(handle);
+    return ok;
+}
+
+#ifdef HAVE_ZLIB
+static bool gzip(const std::string& in, std::string& out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    //windowBits 15 + 16: a gzip header and trailer rather than raw zlib
+    if (deflateInit2(&stream, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    out.resize(deflateBound(&stream, in.length()) + 32);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = in.length();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.length();
+
+    bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ok;
+}
+#endif
+
+//s as a C++ string literal
+static std::string quote(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20 || c >= 0x7F || c == '?') {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\%03o", c);  //octal can't swallow what follows
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static bool writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << contents;
+    if (!file) {
+        std::cerr << "Error: could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " WWW_DIR OUT_DIR" << std::endl;
+        return 1;
+    }
+    std::string root = argv[1];
+    std::string out_dir = argv[2];
+
+    std::vector<std::string> paths;
+    if (!collect(root, "/", paths)) {
+        return 1;
+    }
+    std::sort(paths.begin(), paths.end());  //EmbeddedAssets::find() binary searches
+
+    std::string blob;
+    std::vector<PackedAsset> assets;
+    size_t gzip_count = 0;
+
+    for (const std::string& path : paths) {
+        std::string contents;
+        if (!readFile(root + path, contents)) {
+            std::cerr << "Error: could not read " << root << path << std::endl;
+            return 1;
+        }
+
+        PackedAsset asset;
+        asset.path = path;
+        asset.mime = MimeTypes::of(path);
+        asset.hash = Hash64::of(contents.data(), contents.length());
+        asset.offset = blob.length();
+        asset.length = contents.length();
+        asset.gzip_offset = 0;
+        asset.gzip_length = 0;
+        blob += contents;
+        blob.resize((blob.length() + ASSET_ALIGN - 1) / ASSET_ALIGN * ASSET_ALIGN, '\0');
+
+#ifdef HAVE_ZLIB
+        std::string compressed;
+        if (gzip(contents, compressed) &&
+            compressed.length() * 100 <= contents.length() * (100 - GZIP_MIN_SAVING)) {
+            asset.gzip_offset = blob.length();
+            asset.gzip_length = compressed.length();
+            blob += compressed;
+            blob.resize((blob.length() + ASSET_ALIGN - 1) / ASSET_ALIGN * ASSET_ALIGN, '\0');
+            gzip_count++;
+        }
+#endif
+        assets.push_back(asset);
+    }
+
+    //.incbin resolves relative paths against the compiler's working directory, not the file
+    std::string blob_path = out_dir + "/assets.bin";
+    if (!writeFile(blob_path, blob)) {
+        return 1;
+    }
+    char resolved[PATH_MAX];
+    if (realpath(blob_path.c_str(), resolved) == nullptr) {
+        std::cerr << "Error: could not resolve " << blob_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::ostringstream source;
+    source << "//generated by tools/pack_assets.cpp from " << root << ", do not edit\n"
+           << "#include \"EmbeddedAssets.h\"\n\n"
+           << "__asm__(\".section .rodata.embedded_assets,\\\"a\\\"\\n\"\n"
+           << "        \".balign " << ASSET_ALIGN << "\\n\"\n"
+           << "        \".globl embedded_asset_data\\n\"\n"
+           << "        \".type embedded_asset_data, @object\\n\"\n"
+           << "        \"embedded_asset_data:\\n\"\n"
+           << "        \".incbin \\\"\" " << quote(resolved) << " \"\\\"\\n\"\n"
+           << "        \".byte 0\\n\"\n"
+           << "        \".size embedded_asset_data, " << blob.length() + 1 << "\\n\"\n"
+           << "        \".previous\\n\");\n\n"
+           << "extern const EmbeddedAsset embedded_assets[] = {\n";
+    for (const PackedAsset& asset : assets) {
+        std::string etag = Hash64::toHex(asset.hash);
+        source << "    {" << quote(asset.path) << ", " << quote(asset.mime) << ", "
+               << quote("\"" + etag + "\"") << ", " << quote("\"" + etag + "-gz\"") << ", "
+               << asset.offset << ", " << asset.length << ", "
+               << asset.gzip_offset << ", " << asset.gzip_length << "},\n";
+    }
+    if (assets.empty()) {
+        source << "    {\"\", \"\", \"\", \"\", 0, 0, 0, 0},     //no zero-length arrays\n";
+    }
+    source << "};\n"
+           << "extern const size_t embedded_asset_count = " << assets.size() << ";\n";
+
+    if (!writeFile(out_dir + "/assets.cpp", source.str())) {
+        return 1;
+    }
+
+    std::cout << "Packed " << assets.size() << " assets from " << root << " (" << blob.length()
+              << " bytes, " << gzip_count << " with gzip variants)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+//print the form submissions log (uploads/.submissions, see SubmissionLog) as text, in the
+//layout the old submissions.txt had, or as one JSON object per line with --json.
+//--field/--value keep only submissions where that field has that value.
+//safe to run while the server is writing: a record still being appended is just not shown yet
+
+#include "SubmissionLog.h"
+#include "JsonWriter.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <ctime>
+
+int main(int argc, char* argv[]) {
+    std::string path = "uploads/.submissions";
+    std::string field;
+    std::string value;
+    bool json = false;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--field") == 0 && i + 1 < argc) {
+            field = argv[++i];
+        } else if (strcmp(argv[i], "--value") == 0 && i + 1 < argc) {
+            value = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || field.empty() != value.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--field NAME --value VALUE] [--json] [LOG]"
+                  << "   (default: uploads/.submissions)" << std::endl;
+        return 1;
+    }
+
+    std::vector<Submission> found;
+    uint64_t next_cursor;
+    if (!SubmissionLog::query(path, 0, 0, field, value, found, next_cursor)) {
+        std::cerr << "Error: could not read " << path << " as a submissions log" << std::endl;
+        return 1;
+    }
+
+    for (const Submission& submission : found) {
+        if (json) {
+            std::string line;
+            JsonWriter writer(line);
+            writer.beginObject().key("time").value(submission.time_ms / 1000).key("fields").beginObject();
+            for (const auto& pair : submission.fields) {
+                writer.key(pair.first).value(pair.second);
+            }
+            writer.endObject().endObject();
+            std::cout << line << "\n";
+            continue;
+        }
+
+        time_t seconds = submission.time_ms / 1000;
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+
+        std::cout << "NEW SUBMISSION: " << stamp << "\n";
+        for (const auto& pair : submission.fields) {
+            std::cout << pair.first << ": " << pair.second << "\n";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}